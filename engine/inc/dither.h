@@ -0,0 +1,33 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DITHER_H
+#define DITHER_H
+
+#include "engine_types.h"
+
+//Width and height of the tileable dither threshold map, power of 2
+#define DITHER_SIZE (64)
+//Threshold values are in range 0..DITHER_MAX-1: pixel is selected when threshold < blend*257
+#define DITHER_MAX (65535)
+
+void dither_init();
+void dither_cleanup();
+void dither_animate(bool on);
+void dither_offset(INT *dx, INT *dy);
+const INT *dither_row(INT y);
+
+#endif
@@ -0,0 +1,31 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DYN_RES_H
+#define DYN_RES_H
+
+#include "engine_types.h"
+
+//Scale factor steps: scale factor is level/DYN_RES_LEVELS
+#define DYN_RES_LEVELS (16)
+
+DYN_RES *DYN_RES_alloc(INT width, INT height, INT z_buf_on, FLOAT target_time);
+void DYN_RES_free(DYN_RES *dr);
+void DYN_RES_begin(DYN_RES *dr);
+void DYN_RES_end(DYN_RES *dr, RENDER_BUFFER *out);
+FLOAT DYN_RES_scale(DYN_RES *dr);
+
+#endif
@@ -29,14 +29,20 @@
 #include "annotations.h"
 #include "color.h"
 #include "display.h"
+#include "dither.h"
+#include "dyn_res.h"
 #include "gradient.h"
 #include "map.h"
 #include "map_generators.h"
 #include "map_filters.h"
+#include "map_graph.h"
+#include "map_pool.h"
+#include "parallel.h"
 #include "render_buffer.h"
 #include "transitions.h"
 #include "utils.h"
 
+#include "v_deferred.h"
 #include "v_geometry.h"
 #include "v_lighting.h"
 #include "v_obj_3d.h"
@@ -44,6 +50,7 @@
 #include "v_obj_3d_generators.h"
 #include "v_rasterizer.h"
 #include "v_scene.h"
+#include "v_span_buffer.h"
 
 
 INT engine_init(INT window_width, INT window_height, INT window_flags, const char *window_name);
@@ -35,6 +35,7 @@ typedef double FLOAT;
 
 typedef uint32_t ARGB_PIXEL;
 typedef uint32_t Z_PIXEL;
+typedef uint16_t Z16_PIXEL;
 typedef uint32_t BUMP_PIXEL;
 
 #define FRACT_SHIFT 16
@@ -56,16 +57,88 @@ typedef uint32_t BUMP_PIXEL;
 #define G_OVFL 0x00010000
 #define B_OVFL 0x00000100
 
+//Visibility buffer pixel (deferred shading): render queue object index,
+//face index and index of the triangle in the face triangle fan
+#define VIS_TRI_BITS 3
+#define VIS_FACE_BITS 21
+#define VIS_MAX_OBJECTS (255)
+#define VIS_MAX_FACES (1<<VIS_FACE_BITS)
+#define VIS_EMPTY (0xFFFFFFFF)
+#define VIS_ID(obj, face, tri) ((UINT)(obj) << (VIS_FACE_BITS+VIS_TRI_BITS) | (UINT)(face) << VIS_TRI_BITS | (UINT)(tri))
+#define VIS_ID_OBJ(id) ((id) >> (VIS_FACE_BITS+VIS_TRI_BITS))
+#define VIS_ID_FACE(id) (((id) >> VIS_TRI_BITS) & (VIS_MAX_FACES-1))
+#define VIS_ID_TRI(id) ((id) & ((1<<VIS_TRI_BITS)-1))
+//Deferred shading is done in DEFERRED_TILE_SIZE x DEFERRED_TILE_SIZE screen tiles
+#define DEFERRED_TILE_SIZE (32)
+//Number of deferred shading tile columns/rows of the w x h screen
+#define DEFERRED_TILE_COLS(w) (((w) + DEFERRED_TILE_SIZE-1)/DEFERRED_TILE_SIZE)
+#define DEFERRED_TILE_ROWS(h) (((h) + DEFERRED_TILE_SIZE-1)/DEFERRED_TILE_SIZE)
+
+//Tile size of tiled ARGB_MAPs: MAP_TILE_SIZE x MAP_TILE_SIZE pixels
+#define MAP_TILE_SHIFT 2
+#define MAP_TILE_SIZE (1<<MAP_TILE_SHIFT)
+#define MAP_TILE_MASK (MAP_TILE_SIZE-1)
+//Index of the tiled map pixel (x, y), row_shift is log_2 of map width
+#define MAP_TILED_INDEX(x, y, row_shift) \
+    (((y) & ~MAP_TILE_MASK) << (row_shift) | ((x) & ~MAP_TILE_MASK) << MAP_TILE_SHIFT | \
+    ((y) & MAP_TILE_MASK) << MAP_TILE_SHIFT | ((x) & MAP_TILE_MASK))
+//Dirty tiles of ARGB_MAPs (see ARGB_MAP_track_dirty()): MAP_DIRTY_TILE_SIZE x MAP_DIRTY_TILE_SIZE pixels
+#define MAP_DIRTY_TILE_SHIFT 6
+#define MAP_DIRTY_TILE_SIZE (1<<MAP_DIRTY_TILE_SHIFT)
+//Map rows start at MAP_ALIGN byte boundaries: stride (in pixels) of a map with given width
+#define MAP_ALIGN (64)
+#define MAP_STRIDE(width) (((width) + MAP_ALIGN/4 - 1) & ~(MAP_ALIGN/4 - 1))
+//First pixel of row y of ARGB_MAP or 32 bit Z_MAP
+#define MAP_ROW(map, y) ((map)->data + (y)*(map)->stride)
+
 #define ARGB_PIXEL_ALPHA(P) ((P)>>24)
 #define ARGB_PIXEL_RED(P) (((P)>>16)&0x000000FF)
 #define ARGB_PIXEL_GREEN(P) (((P)>>8)&0x000000FF)
 #define ARGB_PIXEL_BLUE(P) ((P)&0x000000FF)
+//Linear interpolation between ARGB pixels p0 and p1 with 8 bit weight f of p1.
+//Red/blue and alpha/green channel pairs are interpolated at once, each in its own 16 bit lane.
+#define ARGB_LERP(p0, p1, f) \
+    (((((p0) & 0x00FF00FF)*(256 - (f)) + ((p1) & 0x00FF00FF)*(f)) >> 8 & 0x00FF00FF) | \
+    (((((p0) >> 8) & 0x00FF00FF)*(256 - (f)) + (((p1) >> 8) & 0x00FF00FF)*(f)) & 0xFF00FF00))
 
 #define Z_BUFFER_ON 1
 #define Z_BUFFER_OFF 0
-//#define Z_BUFFER_MAX (65535) //2^16-1
+#define Z_BUFFER_ON_16 2 //Z buffer with 16 bit Z values
 #define Z_BUFFER_MAX (2147483647) //2^31-1
 //#define Z_BUFFER_MAX (4294967295) //2^32-1
+//Projected Z is kept in [0, Z_BUFFER_MAX] range for all Z buffer formats.
+//16 bit Z buffers store its upper bits: [0, Z_BUFFER_MAX] is mapped to [0, 65535].
+#define Z16_SHIFT 15
+#define Z16_CLEAR (0xFFFF)
+//16 bit Z value of projected Z. Negative Z (before the near plane) gives value above Z16_CLEAR.
+#define Z_TO_Z16(z) ((UINT)(z) >> Z16_SHIFT)
+//Frame epoch Z (Z_MAP.epoch_on, 32 bit Z maps only): Z values are stored with Z_EPOCH_BITS lower
+//precision, with frame epoch in the upper bits. Epoch decreases with every Z_MAP_clear(), so values
+//of older epochs are higher than any value of the current one and act as cleared pixels.
+//Full clear is done only when the epoch wraps, once every Z_EPOCH_MAX+1 frames.
+#define Z_EPOCH_BITS 6
+#define Z_EPOCH_SHIFT (31 - Z_EPOCH_BITS)
+#define Z_EPOCH_MAX ((1 << Z_EPOCH_BITS) - 2)
+
+//Subpixel precision of projected X, Y coordinates (28.4 fixed point): SUBPIXEL_SIZE steps per pixel
+#define SUBPIXEL_SHIFT 4
+#define SUBPIXEL_SIZE (1<<SUBPIXEL_SHIFT)
+#define SUBPIXEL_MASK (SUBPIXEL_SIZE-1)
+//First pixel with center not less than subpixel coordinate c. Pixel p has center at p + 0.5.
+#define SUBPIXEL_CEIL(c) (((c) + (SUBPIXEL_SIZE>>1) - 1) >> SUBPIXEL_SHIFT)
+//Change over s subpixels of value changing by d over dy subpixels
+#define SUBPIXEL_STEP(d, s, dy) ((INT)((int64_t)(d)*(s)/(dy)))
+//Block size of half-space triangle rasterizer: TRI_BLOCK_SIZE x TRI_BLOCK_SIZE pixels
+#define TRI_BLOCK_SHIFT 3
+#define TRI_BLOCK_SIZE (1<<TRI_BLOCK_SHIFT)
+#define TRI_BLOCK_MASK (TRI_BLOCK_SIZE-1)
+//32 bit edge function value standing for edges a block is fully inside of, in vector row masks.
+//Triangles with edge function span across the block below TRI_EDGE_INSIDE/2 use vector masks.
+#define TRI_EDGE_INSIDE (1<<29)
+
+//Z_MAP tiles size: Z_TILE_SIZE x Z_TILE_SIZE pixels
+#define Z_TILE_SHIFT 3
+#define Z_TILE_SIZE (1<<Z_TILE_SHIFT)
 
 #define MAX_FACE_VERTICES (6)
 
@@ -80,6 +153,12 @@ typedef struct {
     double music_position;
 } RUN_STATS;
 
+//Rasterizer overdraw counters. Collected only if engine is built with RENDER_STATS defined.
+typedef struct {
+    uint64_t shaded; //Pixels that passed Z test and were shaded
+    uint64_t covered; //Distinct pixels covered by the geometry at the end of the render
+} OVERDRAW_STATS;
+
 /** Types for object generators*/
 typedef enum {
     TETRAHEDRON,
@@ -249,23 +328,48 @@ typedef FLOAT VEC_4[4];
 typedef FLOAT MAT_4_4[4][4]; //Transform matrix type for transforming 3D coordinates
 /*
  Coordinates in rendering space
- Each entry has: [0] - screen X, [1] - screen Y, [2] - zbuffer Z.
+ Each entry has: [0] - screen X, [1] - screen Y (both in subpixels, see SUBPIXEL_SHIFT), [2] - zbuffer Z.
  Negative/over max limit values are allowed.
 */
 typedef INT PROJECTION_COORD[3];
 
-typedef struct {
+typedef struct ARGB_MAP {
     //Alpha channel by default is set to 0 for RENDER_BUFFERs and
     //ARGB_MAPs used a rasterization targets.
     //Alpha channel is set to 255 for ARGB_MAPs holding textures without alpha channel
     //Alpha channel is set between 0-255 for ARGB_MAPs holding textures with alpha channel
     ARGB_PIXEL *data;
     INT width, height, height_with_margin;
+    INT stride; //distance between rows in pixels, at least width
+    void *storage; //allocated pixels block, NULL in views (see ARGB_MAP_view())
+    struct ARGB_MAP *view_of; //parent map of the view, view_x, view_y: view position in it
+    INT view_x, view_y;
+    //If true, data is stored in MAP_TILE_SIZE x MAP_TILE_SIZE tiles, see ARGB_MAP_tile()
+    bool tiled;
+    //If true, color channels are premultiplied by alpha, see ARGB_MAP_premultiply()
+    bool premultiplied;
+    struct ARGB_MAP *mip; //Next mipmap level (half width and height), NULL if there is none
+    //Dirty tiles tracking, see ARGB_MAP_track_dirty(). dirty is NULL when it's off.
+    uint64_t *dirty; //write stamp of every tile, tiles written after stamp S have dirty > S (64 bit, never wraps)
+    INT dirty_cols, dirty_rows;
+    uint64_t dirty_seq; //stamp of the last map operation which wrote all rows
+    UINT dirty_op; //hash of function and parameters of that operation
 } ARGB_MAP;
 
 typedef struct {
-    Z_PIXEL *data;
+    Z_PIXEL *data; //32 bit Z values, NULL in 16 bit Z maps
+    Z16_PIXEL *data16; //16 bit Z values, NULL in 32 bit Z maps
     INT width, height;
+    INT stride; //distance between rows in Z values, same as in ARGB_MAP of the same width
+    void *storage; //allocated Z values block
+    //Coarse Z buffer: maximum Z of every tile (projected Z range, for both Z formats).
+    //It can be higher than the actual tile maximum, but never lower.
+    //Tiles inside of the dirty range are refreshed by Z_MAP_update_tiles().
+    Z_PIXEL *tile_max;
+    INT tile_cols, tile_rows;
+    INT dirty_x0, dirty_y0, dirty_x1, dirty_y1; //dirty tiles range, empty if x0 > x1
+    bool epoch_on; //if true: Z_MAP_clear() only advances the frame epoch, see Z_EPOCH_BITS
+    INT epoch; //current frame epoch, next Z_MAP_clear() is a full one if it's 0
 } Z_MAP;
 
 typedef struct {
@@ -278,8 +382,49 @@ typedef struct {
     ARGB_MAP *map; //pixels buffer
     Z_MAP *z; //z buffer
     INT width, height;
+    INT alloc_width, alloc_height; //allocated dimensions, limit of RENDER_BUFFER_set_size()
+    ARGB_MAP *background; //pending lazy background, see RENDER_BUFFER_background()
 } RENDER_BUFFER;
 
+//Span of flat colored pixels with linear Z, x0 and x1 included
+typedef struct {
+    INT x0, x1;
+    INT z, dz; //Z at x0, Z increment per pixel
+    ARGB_PIXEL color;
+    INT next; //index of the next span in the row, -1 for the last one
+} SPAN;
+
+//Span buffer (S-buffer): per row lists of sorted, non-overlapping spans
+typedef struct {
+    INT height;
+    INT *row; //index of the first span in every row, -1 for empty rows
+    SPAN *span; //span pool, grown on demand
+    INT span_cnt, span_max;
+} SPAN_BUFFER;
+
+//Dynamic resolution controller: scene is rendered into buf with dimensions scaled down
+//when render time exceeds the target, and upscaled into the output render buffer
+typedef struct {
+    RENDER_BUFFER *buf; //render buffer of the scaled scene, allocated with output dimensions
+    INT width, height; //output dimensions
+    FLOAT target_time; //target render time of a frame [s]
+    INT level, min_level; //current and minimum scale level, scale factor is level/DYN_RES_LEVELS
+    INT over_cnt, under_cnt; //consecutive frames rendered slower than the target / fast enough for the next level
+    bool bilinear; //if true: upscale with bilinear filtering, otherwise with nearest neighbour sampling
+    uint64_t start; //performance counter value at the beginning of the frame
+    FLOAT time; //render time of the last frame [s]
+} DYN_RES;
+
+//Parameters of a full map operation executed in row bands (see parallel_rows())
+typedef struct {
+    ARGB_MAP *out, *map0, *map1, *p; //output map, input maps, per pixel parameter map
+    ARGB_PIXEL pixval; //constant color
+    INT n[4]; //integer parameters
+    FLOAT f[4]; //floating point parameters
+    INT dither_x, dither_y; //offset of the dither threshold map
+    void *data; //tables prepared for the operation, read only in bands
+} MAP_JOB;
+
 typedef struct {
     FLOAT u;
     FLOAT v;
@@ -301,6 +446,7 @@ typedef struct {
     COLOR color_diff; //diffuse lighting component
     COLOR color_spec; //specular lighting component
     PROJECTION_COORD projection; //perspective projected coordinates
+    FLOAT projection_w_inv; //1/W of perspective projection, for perspective correct texture mapping
     INT avcnt; //count of adjacent vertices
     //TODO: avi should be preferably allocated dynamically...
     INT avi[8]; //adjacent vertices indexes (inside OBJ_3D.vertices) - for wireframe
@@ -319,14 +465,23 @@ typedef struct {
     //REMARK: for texture mapped objects color_surf is not used.
     COLOR color_diff; //diffuse lighting component
     COLOR color_spec; //specular lighting component
+    INT zmin; //Nearest projected Z of face vertices, for front-to-back face sorting
 } FACE;
 
 typedef struct {
     FLOAT specular_power;
     bool wireframe_on;
+    bool perspective_on; //perspective correct texture mapping of base map
+    bool bilinear_on; //bilinear filtering of base map (without reflection/mul/add/bump maps)
+    //half-space triangle rasterization of solid, interpolated and affine textured types (base map, diffuse/specular
+    //textured, fake reflection). Not supported (polygon rasterizer is used) with perspective_on, bilinear_on and
+    //for base mul/add and bump map types.
+    bool halfspace_on;
 
     // Zero point coordinates transformed to camera space. Used for determination of transformed normals origin
     VEC_4 zero_camera;
+    INT zmin; //Nearest projected Z of front vertices, for front-to-back render ordering
+    bool z_equal; //if true: object Z is already in Z buffer (pre-pass), only pixels with equal Z are shaded
 
     INT fcnt; // Object total face count
     FACE *faces;
@@ -400,6 +555,26 @@ struct SCENE_3D{
     //if true rotate v-normals for every object in the scene
     //if false - do it on per-object basis
     bool rotate_all_objects_vertex_normals;
+
+    //Render queue, built by scene_3d_transform_and_light.
+    //Opaque objects are ordered front-to-back to maximize early Z rejection.
+    INT queue_cnt;
+    OBJ_3D_CONTAINER** queue;
+    bool sort_objects; //if true: sort objects front-to-back (default)
+    bool sort_faces; //if true: sort front faces of each object front-to-back too
+    //if true: expensive object types (INTERP_DIFF_SPEC_TEXTURED, TX_MAP_BUMP_REFLECTION)
+    //are drawn after all other objects, with Z-only pre-pass, so each visible pixel is shaded once
+    bool z_prepass;
+    //if true: textured and interpolated object types are rasterized into visibility buffer
+    //(object/face IDs and Z) and shaded afterwards once per visible pixel, see v_deferred.c
+    bool deferred;
+    ARGB_MAP *vis; //visibility buffer, allocated on first deferred render
+    INT *vis_tiles; //count of shaded pixels in each DEFERRED_TILE_SIZE tile, allocated with vis
+    //if true: SOLID_* objects are rendered through span buffer, without Z buffer tests and overdraw.
+    //Scenes made only of such objects (and wireframes) can use render buffer without Z buffer (Z_BUFFER_OFF),
+    //then RENDER_BUFFER_zero() has no Z buffer to clear.
+    bool span_buffer;
+    SPAN_BUFFER *sbuf; //span buffer, allocated on first span buffer render
 };
 
 // Signature for parametric surface calculation function
@@ -21,6 +21,7 @@
 
 void GRADIENT_add_point(GRADIENT *g, FLOAT t, COLOR *color);
 COLOR *GRADIENT_get_value(GRADIENT *g, FLOAT t);
+ARGB_PIXEL GRADIENT_get_pixval(GRADIENT *g, FLOAT t);
 
 DISCRETE_GRADIENT *DISCRETE_GRADIENT_alloc(INT length);
 void DISCRETE_GRADIENT_from_GRADIENT(DISCRETE_GRADIENT *dg, GRADIENT *g);
@@ -19,21 +19,37 @@
 
 #include "engine_types.h"
 
+//Side of square blocks transposed at once by ARGB_MAP_transpose() [pixels]
+#define MAP_TRANSPOSE_BLOCK (32)
+
 ARGB_MAP *ARGB_MAP_alloc(INT width, INT height, INT wrap_margin);
+ARGB_MAP *ARGB_MAP_view(ARGB_MAP *parent, INT x, INT y, INT w, INT h);
 void ARGB_MAP_clear(ARGB_MAP *map);
 void ARGB_MAP_fill(ARGB_MAP *map, COLOR *color);
 void ARGB_MAP_copy(ARGB_MAP *dst, ARGB_MAP *src);
+void ARGB_MAP_transpose(ARGB_MAP *out, ARGB_MAP *in);
 void ARGB_MAP_free(ARGB_MAP* map);
+void ARGB_MAP_build_mipmaps(ARGB_MAP *map);
+void ARGB_MAP_tile(ARGB_MAP *map);
+void ARGB_MAP_track_dirty(ARGB_MAP *map, bool on);
+void ARGB_MAP_mark_dirty(ARGB_MAP *map, INT x0, INT y0, INT x1, INT y1);
+uint64_t ARGB_MAP_dirty_stamp();
+void ARGB_MAP_dirty_rows(MAP_JOB *job, UINT op, INT height, INT halo, INT *y0, INT *y1);
 
 BUMP_MAP *BUMP_MAP_alloc(INT width, INT height);
 void BUMP_MAP_free(BUMP_MAP* map);
 
-Z_MAP *Z_MAP_alloc(INT width, INT height);
+Z_MAP *Z_MAP_alloc(INT width, INT height, INT bits);
+void Z_MAP_set_size(Z_MAP *map, INT width, INT height);
 void Z_MAP_clear(Z_MAP *map);
+bool Z_MAP_clear_tiles(Z_MAP *map);
+void Z_MAP_clear_rows(Z_MAP *map, INT y0, INT y1);
 void Z_MAP_copy(Z_MAP *dst, Z_MAP *src);
+void Z_MAP_update_tiles(Z_MAP *map);
 void Z_MAP_free(Z_MAP* map);
 
 void ARGB_MAP_multiplex(ARGB_MAP *dst, ARGB_MAP **src, ARGB_MAP *mask);
+void ARGB_MAP_copy_uncovered(ARGB_MAP *dst, ARGB_MAP *src, Z_MAP *z);
 
 void ARGB_MAP_fade_dither_global(ARGB_MAP *out, COLOR* color, ARGB_MAP *map, FLOAT p);
 void ARGB_MAP_fade_mul_global(ARGB_MAP *out, COLOR* color, ARGB_MAP *map, FLOAT p);
@@ -52,6 +68,10 @@ void ARGB_MAP_blend_mul_f_per_pixel(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map
 
 void ARGB_MAP_sat_add(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1);
 
+void ARGB_MAP_premultiply(ARGB_MAP *out, ARGB_MAP *in);
+void ARGB_MAP_unpremultiply(ARGB_MAP *out, ARGB_MAP *in);
+void ARGB_MAP_blend_premultiplied(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg);
+
 ARGB_MAP *ARGB_MAP_read_image(const char * const map_filename, INT u_wrap_margin);
 BUMP_MAP *BUMP_MAP_from_ARGB_MAP(ARGB_MAP* in_map, FLOAT margin);
 
@@ -23,6 +23,10 @@ void map_filters_init();
 void map_filters_cleanup();
 
 #define MAX_EDGE_WIDTH (15)
+//Maximum number of box passes of separable blurs in each direction
+#define MAP_BLUR_MAX_PASSES (4)
+//Number of box passes approximating Gaussian blur
+#define MAP_BLUR_GAUSS_PASSES (3)
 
 void ARGB_MAP_green_gradient_global_copy(ARGB_MAP *out, ARGB_MAP *in, GRADIENT *g, const INT p);
 void ARGB_MAP_green_gradient_global_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, GRADIENT *g, const INT p);
@@ -39,6 +43,14 @@ void ARGB_MAP_blur_nx1_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg
 void ARGB_MAP_blur_1xn_global_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p);
 void ARGB_MAP_blur_1xn_global_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, const INT p);
 
+void ARGB_MAP_blur_1xn_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, ARGB_MAP *p);
+void ARGB_MAP_blur_1xn_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, ARGB_MAP *p);
+
+void ARGB_MAP_gaussian_blur_copy(ARGB_MAP *out, ARGB_MAP *in, FLOAT sigma_x, FLOAT sigma_y);
+void ARGB_MAP_gaussian_blur_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, FLOAT sigma_x, FLOAT sigma_y);
+void ARGB_MAP_gaussian_blur_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, FLOAT sigma_x, FLOAT sigma_y, ARGB_MAP *p);
+void ARGB_MAP_gaussian_blur_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, FLOAT sigma_x, FLOAT sigma_y, ARGB_MAP *p);
+
 void ARGB_MAP_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p);
 void ARGB_MAP_pixelize_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, const INT p);
 void ARGB_MAP_rand_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in,
@@ -47,4 +59,7 @@ void ARGB_MAP_rand_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in,
 void ARGB_MAP_rand_pixelize_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg,
                                   const INT l_min, const INT l_max, UINT seed_l,
                                   const INT h_min, const INT h_max, UINT seed_h);
+
+void ARGB_MAP_scale_nearest(ARGB_MAP *out, ARGB_MAP *in);
+void ARGB_MAP_scale_bilinear(ARGB_MAP *out, ARGB_MAP *in);
 #endif
\ No newline at end of file
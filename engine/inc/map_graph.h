@@ -0,0 +1,35 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef MAP_GRAPH_H
+#define MAP_GRAPH_H
+
+#include "engine_types.h"
+#include "parallel.h"
+
+//Maximum number of operations recorded before the graph is flushed
+#define MAP_GRAPH_MAX_NODES (64)
+//Size of buffer for copies of operation tables (gradients, sine tables) [bytes]
+#define MAP_GRAPH_DATA_SIZE (1024*1024)
+
+void map_graph_init();
+void map_graph_cleanup();
+void map_graph_defer(bool on);
+bool map_graph_deferred();
+void map_graph_flush();
+void map_graph_rows(PARALLEL_ROWS_FUNC func, MAP_JOB *job, INT height, INT row_bytes, INT halo, INT data_size);
+
+#endif
@@ -0,0 +1,40 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef MAP_POOL_H
+#define MAP_POOL_H
+
+#include "engine_types.h"
+
+//Maximum number of released maps and render buffers kept for reuse (each)
+#define MAP_POOL_MAX_ENTRIES (32)
+//Maximum size of pixels kept in the pool, larger releases are freed [bytes]
+#define MAP_POOL_MAX_BYTES (256*1024*1024)
+//Maximum number of maps and render buffers acquired for the current frame (each)
+#define MAP_POOL_MAX_FRAME (64)
+
+void map_pool_init();
+void map_pool_cleanup();
+void map_pool_trim();
+void map_pool_end_frame();
+ARGB_MAP *ARGB_MAP_acquire(INT width, INT height, bool zero);
+ARGB_MAP *ARGB_MAP_acquire_frame(INT width, INT height, bool zero);
+void ARGB_MAP_release(ARGB_MAP *map);
+RENDER_BUFFER *RENDER_BUFFER_acquire(INT width, INT height, INT z_buf_on, bool zero);
+RENDER_BUFFER *RENDER_BUFFER_acquire_frame(INT width, INT height, INT z_buf_on, bool zero);
+void RENDER_BUFFER_release(RENDER_BUFFER *buf);
+
+#endif
@@ -0,0 +1,39 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "engine_types.h"
+
+//Maximum number of workers (calling thread included)
+#define PARALLEL_MAX_WORKERS (64)
+//Assumed L2 cache size per core. Row bands are sized to use half of it.
+#define PARALLEL_L2_SIZE (256*1024)
+
+//Function processing rows y0 to y1-1 of a map operation, worker: index of the executing worker
+typedef void (*PARALLEL_ROWS_FUNC)(MAP_JOB *job, INT y0, INT y1, INT worker);
+
+void parallel_init(INT workers);
+void parallel_cleanup();
+void parallel_enable(bool on);
+bool parallel_enabled();
+void parallel_limit(INT workers);
+INT parallel_workers();
+void parallel_rows(PARALLEL_ROWS_FUNC func, MAP_JOB *job, INT height, INT row_bytes);
+void parallel_rows_range(PARALLEL_ROWS_FUNC func, MAP_JOB *job, INT y0, INT y1, INT row_bytes);
+
+#endif
@@ -20,10 +20,14 @@
 #include "engine_types.h"
 
 RENDER_BUFFER *RENDER_BUFFER_alloc(INT width, INT height, INT z_buf_on);
+void RENDER_BUFFER_set_size(RENDER_BUFFER *buf, INT width, INT height);
+void RENDER_BUFFER_set_z_buffer(RENDER_BUFFER *buf, INT z_buf_on);
 void RENDER_BUFFER_free(RENDER_BUFFER *buf);
 void RENDER_BUFFER_zero(RENDER_BUFFER *buf);
 void RENDER_BUFFER_fill(RENDER_BUFFER *buf, COLOR *color);
 void RENDER_BUFFER_copy(RENDER_BUFFER *dst, RENDER_BUFFER *src);
 void RENDER_BUFFER_ARGB_MAP_copy(RENDER_BUFFER *dst, ARGB_MAP *src);
+void RENDER_BUFFER_background(RENDER_BUFFER *buf, ARGB_MAP *background);
+void RENDER_BUFFER_resolve_background(RENDER_BUFFER *buf);
 
 #endif
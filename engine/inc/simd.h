@@ -0,0 +1,289 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * Vector operations for ARGB_PIXEL processing loops.
+ * Selected at compile time: AVX2 (8 pixels per vector) when built with
+ * -march=haswell (release build), SSE2 (4 pixels per vector) otherwise.
+ * Build with -DNO_SIMD to use plain C loops only.
+ * SIMD_PIXELS is defined only when vector operations are available.
+ * 8 bit channels are unpacked to 16 bit lanes (VEC_UNPACK_LO/HI) in the same
+ * in-lane order in which VEC_PACK puts them back.
+ * Row helpers below the vector operations have plain C fallbacks, so they are
+ * available in all builds.
+ */
+#if !defined(NO_SIMD) && defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define SIMD_PIXELS 8
+typedef __m256i VEC;
+#define VEC_LOAD(p) _mm256_loadu_si256((const VEC*)(p))
+#define VEC_STORE(p, v) _mm256_storeu_si256((VEC*)(p), (v))
+#define VEC_SET32(x) _mm256_set1_epi32(x)
+#define VEC_SET16(x) _mm256_set1_epi16(x)
+#define VEC_ZERO() _mm256_setzero_si256()
+#define VEC_AND(a, b) _mm256_and_si256((a), (b))
+#define VEC_OR(a, b) _mm256_or_si256((a), (b))
+#define VEC_ANDNOT(a, b) _mm256_andnot_si256((a), (b)) //~a & b
+#define VEC_CMPGT32(a, b) _mm256_cmpgt_epi32((a), (b))
+#define VEC_ADD32(a, b) _mm256_add_epi32((a), (b))
+#define VEC_SUB32(a, b) _mm256_sub_epi32((a), (b))
+#define VEC_SRL32(a, n) _mm256_srli_epi32((a), (n))
+#define VEC_SLL32(a, n) _mm256_slli_epi32((a), (n))
+#define VEC_ADD16(a, b) _mm256_add_epi16((a), (b))
+#define VEC_SUB16(a, b) _mm256_sub_epi16((a), (b))
+#define VEC_MUL16(a, b) _mm256_mullo_epi16((a), (b))
+#define VEC_SRL16(a, n) _mm256_srli_epi16((a), (n))
+#define VEC_UNPACK_LO(a) _mm256_unpacklo_epi8((a), _mm256_setzero_si256())
+#define VEC_UNPACK_HI(a) _mm256_unpackhi_epi8((a), _mm256_setzero_si256())
+#define VEC_UNPACK32_LO(a) _mm256_unpacklo_epi32((a), (a))
+#define VEC_UNPACK32_HI(a) _mm256_unpackhi_epi32((a), (a))
+#define VEC_PACK(lo, hi) _mm256_packus_epi16((lo), (hi))
+#define VEC_MOVEMASK32(a) _mm256_movemask_ps(_mm256_castsi256_ps(a)) //sign bits of 32 bit lanes
+
+#elif !defined(NO_SIMD) && defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define SIMD_PIXELS 4
+typedef __m128i VEC;
+#define VEC_LOAD(p) _mm_loadu_si128((const VEC*)(p))
+#define VEC_STORE(p, v) _mm_storeu_si128((VEC*)(p), (v))
+#define VEC_SET32(x) _mm_set1_epi32(x)
+#define VEC_SET16(x) _mm_set1_epi16(x)
+#define VEC_ZERO() _mm_setzero_si128()
+#define VEC_AND(a, b) _mm_and_si128((a), (b))
+#define VEC_OR(a, b) _mm_or_si128((a), (b))
+#define VEC_ANDNOT(a, b) _mm_andnot_si128((a), (b)) //~a & b
+#define VEC_CMPGT32(a, b) _mm_cmpgt_epi32((a), (b))
+#define VEC_ADD32(a, b) _mm_add_epi32((a), (b))
+#define VEC_SUB32(a, b) _mm_sub_epi32((a), (b))
+#define VEC_SRL32(a, n) _mm_srli_epi32((a), (n))
+#define VEC_SLL32(a, n) _mm_slli_epi32((a), (n))
+#define VEC_ADD16(a, b) _mm_add_epi16((a), (b))
+#define VEC_SUB16(a, b) _mm_sub_epi16((a), (b))
+#define VEC_MUL16(a, b) _mm_mullo_epi16((a), (b))
+#define VEC_SRL16(a, n) _mm_srli_epi16((a), (n))
+#define VEC_UNPACK_LO(a) _mm_unpacklo_epi8((a), _mm_setzero_si128())
+#define VEC_UNPACK_HI(a) _mm_unpackhi_epi8((a), _mm_setzero_si128())
+#define VEC_UNPACK32_LO(a) _mm_unpacklo_epi32((a), (a))
+#define VEC_UNPACK32_HI(a) _mm_unpackhi_epi32((a), (a))
+#define VEC_PACK(lo, hi) _mm_packus_epi16((lo), (hi))
+#define VEC_MOVEMASK32(a) _mm_movemask_ps(_mm_castsi128_ps(a)) //sign bits of 32 bit lanes
+
+#endif
+
+#ifdef SIMD_PIXELS
+/*
+ * Multiplicative blend of 16 bit lanes: (c1*w + c0*(255 - w)) >> 8.
+ * Channel values and weights are in range 0..255, so products and their sum
+ * fit in unsigned 16 bits and the result matches the scalar formula exactly.
+ */
+#define VEC_BLEND16(c0, c1, w) \
+    VEC_SRL16(VEC_ADD16(VEC_MUL16((c1), (w)), \
+        VEC_MUL16((c0), VEC_SUB16(VEC_SET16(255), (w)))), 8)
+
+/*
+ * Per pixel weights from alpha channel of p, replicated to all 16 bit lanes
+ * of their pixels: w_lo for pixels unpacked with VEC_UNPACK_LO, w_hi for
+ * VEC_UNPACK_HI.
+ */
+#define VEC_ALPHA_WEIGHTS(p, w_lo, w_hi) do { \
+    VEC w32_ = VEC_SRL32((p), 24); \
+    w32_ = VEC_OR(w32_, VEC_SLL32(w32_, 16)); \
+    (w_lo) = VEC_UNPACK32_LO(w32_); \
+    (w_hi) = VEC_UNPACK32_HI(w32_); \
+} while (0)
+
+/*
+ * Multiplicative blend of pixels v0, v1 with weights prepared for unpacked
+ * low and high halves. Alpha channel of the result is cleared.
+ */
+static inline VEC vec_blend_mul(VEC v0, VEC v1, VEC w_lo, VEC w_hi) {
+    VEC lo = VEC_BLEND16(VEC_UNPACK_LO(v0), VEC_UNPACK_LO(v1), w_lo);
+    VEC hi = VEC_BLEND16(VEC_UNPACK_HI(v0), VEC_UNPACK_HI(v1), w_hi);
+    return VEC_AND(VEC_PACK(lo, hi), VEC_SET32(0x00FFFFFF));
+}
+
+/*
+ * Premultiplied alpha "over" blend: fg + (bg*(255 - fg alpha) + 255) >> 8.
+ * Exact for fg alpha 0 (bg) and 255 (fg). Alpha channel of the result is cleared.
+ */
+static inline VEC vec_blend_premultiplied(VEC fg, VEC bg) {
+    VEC w_lo, w_hi;
+    VEC_ALPHA_WEIGHTS(fg, w_lo, w_hi);
+    VEC lo = VEC_ADD16(VEC_UNPACK_LO(fg), VEC_SRL16(VEC_ADD16(
+        VEC_MUL16(VEC_UNPACK_LO(bg), VEC_SUB16(VEC_SET16(255), w_lo)), VEC_SET16(255)), 8));
+    VEC hi = VEC_ADD16(VEC_UNPACK_HI(fg), VEC_SRL16(VEC_ADD16(
+        VEC_MUL16(VEC_UNPACK_HI(bg), VEC_SUB16(VEC_SET16(255), w_hi)), VEC_SET16(255)), 8));
+    return VEC_AND(VEC_PACK(lo, hi), VEC_SET32(0x00FFFFFF));
+}
+#endif
+
+/*
+ * ARGB_LERP() of rows p0, p1 with weight f (0..256) of p1, written to out. All four channels
+ * are interpolated in 16 bit lanes, results match ARGB_LERP() exactly.
+ */
+static inline void lerp_row(ARGB_PIXEL *out, const ARGB_PIXEL *p0, const ARGB_PIXEL *p1, ARGB_PIXEL f, INT width) {
+    INT x = 0;
+#ifdef SIMD_PIXELS
+    VEC w0 = VEC_SET16(256 - f), w1 = VEC_SET16(f), v0, v1, lo, hi;
+    for (; x + SIMD_PIXELS <= width; x += SIMD_PIXELS) {
+        v0 = VEC_LOAD(p0 + x);
+        v1 = VEC_LOAD(p1 + x);
+        lo = VEC_SRL16(VEC_ADD16(VEC_MUL16(VEC_UNPACK_LO(v0), w0), VEC_MUL16(VEC_UNPACK_LO(v1), w1)), 8);
+        hi = VEC_SRL16(VEC_ADD16(VEC_MUL16(VEC_UNPACK_HI(v0), w0), VEC_MUL16(VEC_UNPACK_HI(v1), w1)), 8);
+        VEC_STORE(out + x, VEC_PACK(lo, hi));
+    }
+#endif
+    for (; x < width; x++)
+        out[x] = ARGB_LERP(p0[x], p1[x], f);
+}
+
+/*
+ * Coverage mask of a TRI_BLOCK_SIZE pixels row of half-space triangle block (see triangle.h):
+ * bit k is set if e[i] + step[i][k] >= 0 for all three edge functions.
+ */
+static inline UINT edge_row_mask(const INT *e, INT step[3][TRI_BLOCK_SIZE]) {
+    UINT neg = 0;
+    INT k = 0;
+#ifdef SIMD_PIXELS
+    for (; k < TRI_BLOCK_SIZE; k += SIMD_PIXELS) {
+        VEC s = VEC_OR(VEC_OR(VEC_ADD32(VEC_SET32(e[0]), VEC_LOAD(step[0] + k)),
+                              VEC_ADD32(VEC_SET32(e[1]), VEC_LOAD(step[1] + k))),
+                       VEC_ADD32(VEC_SET32(e[2]), VEC_LOAD(step[2] + k)));
+        neg |= (UINT)VEC_MOVEMASK32(s) << k;
+    }
+#endif
+    for (; k < TRI_BLOCK_SIZE; k++)
+        neg |= (UINT)(((e[0] + step[0][k]) | (e[1] + step[1][k]) | (e[2] + step[2][k])) < 0) << k;
+    return ~neg & ((1 << TRI_BLOCK_SIZE) - 1);
+}
+
+/*
+ * Channel vectors: all four channels of one pixel in 32 bit lanes (B, G, R, A),
+ * used for running and prefix sums of separable blurs. SSE2 is used in all
+ * vector builds (AVX2 included), a plain C struct with -DNO_SIMD.
+ * cvec_average(): (sum*inv + 2^23) >> 24 per channel, packed back to a pixel,
+ * inv is 2^24/count (see BLUR in map_filters.c).
+ */
+#if !defined(NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+
+typedef __m128i CVEC;
+#define CVEC_ZERO() _mm_setzero_si128()
+#define CVEC_ADD(a, b) _mm_add_epi32((a), (b))
+#define CVEC_SUB(a, b) _mm_sub_epi32((a), (b))
+
+static inline CVEC cvec_unpack(ARGB_PIXEL p) {
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(p), _mm_setzero_si128()), _mm_setzero_si128());
+}
+
+static inline ARGB_PIXEL cvec_average(CVEC sum, UINT inv) {
+    CVEC m = _mm_set1_epi32(inv), r = _mm_set1_epi64x(1 << 23);
+    CVEC even = _mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(sum, m), r), 24);
+    CVEC odd = _mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(sum, 32), m), r), 24);
+    CVEC v = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+    v = _mm_packs_epi32(v, v);
+    return _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+}
+
+#else
+
+typedef struct { UINT c[4]; } CVEC;
+
+static inline CVEC CVEC_ZERO() {
+    return (CVEC){{0, 0, 0, 0}};
+}
+
+static inline CVEC CVEC_ADD(CVEC a, CVEC b) {
+    return (CVEC){{a.c[0] + b.c[0], a.c[1] + b.c[1], a.c[2] + b.c[2], a.c[3] + b.c[3]}};
+}
+
+static inline CVEC CVEC_SUB(CVEC a, CVEC b) {
+    return (CVEC){{a.c[0] - b.c[0], a.c[1] - b.c[1], a.c[2] - b.c[2], a.c[3] - b.c[3]}};
+}
+
+static inline CVEC cvec_unpack(ARGB_PIXEL p) {
+    return (CVEC){{p & 0xFF, (p >> 8) & 0xFF, (p >> 16) & 0xFF, p >> 24}};
+}
+
+static inline ARGB_PIXEL cvec_average(CVEC sum, UINT inv) {
+    ARGB_PIXEL p = 0;
+    for (INT i = 0; i < 4; i++) {
+        uint64_t c = ((uint64_t)sum.c[i]*inv + (1 << 23)) >> 24;
+        p |= (ARGB_PIXEL)(c > 255 ? 255 : c) << 8*i;
+    }
+    return p;
+}
+
+#endif
+
+/*
+ * Transpose a 4x4 pixel block: dst[x*dst_stride + y] = src[y*src_stride + x].
+ * SSE2 in all vector builds, scalar with -DNO_SIMD.
+ */
+static inline void transpose_4x4(ARGB_PIXEL *dst, INT dst_stride, const ARGB_PIXEL *src, INT src_stride) {
+#if !defined(NO_SIMD) && defined(__SSE2__)
+    __m128i r0 = _mm_loadu_si128((const __m128i*)src);
+    __m128i r1 = _mm_loadu_si128((const __m128i*)(src + src_stride));
+    __m128i r2 = _mm_loadu_si128((const __m128i*)(src + 2*src_stride));
+    __m128i r3 = _mm_loadu_si128((const __m128i*)(src + 3*src_stride));
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t2 = _mm_unpacklo_epi32(r2, r3), t3 = _mm_unpackhi_epi32(r2, r3);
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*)(dst + dst_stride), _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*)(dst + 2*dst_stride), _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128((__m128i*)(dst + 3*dst_stride), _mm_unpackhi_epi64(t1, t3));
+#else
+    for (INT y = 0; y < 4; y++)
+        for (INT x = 0; x < 4; x++)
+            dst[x*dst_stride + y] = src[y*src_stride + x];
+#endif
+}
+
+/*
+ * Scalar vec_blend_premultiplied(), channels are saturated like VEC_PACK does.
+ */
+#define PREMUL_OVER_CHANNEL(fg, bg, ia, shift) \
+    ((((fg) >> (shift) & 0xFF) + ((((bg) >> (shift) & 0xFF)*(ia) + 255) >> 8)) > 255 ? 255 : \
+     (((fg) >> (shift) & 0xFF) + ((((bg) >> (shift) & 0xFF)*(ia) + 255) >> 8)))
+
+static inline ARGB_PIXEL blend_premultiplied(ARGB_PIXEL fg, ARGB_PIXEL bg) {
+    ARGB_PIXEL ia = 255 - ARGB_PIXEL_ALPHA(fg);
+    return PREMUL_OVER_CHANNEL(fg, bg, ia, R_SHIFT) << R_SHIFT |
+           PREMUL_OVER_CHANNEL(fg, bg, ia, G_SHIFT) << G_SHIFT |
+           PREMUL_OVER_CHANNEL(fg, bg, ia, B_SHIFT) << B_SHIFT;
+}
+
+/*
+ * Premultiplied fg row over bg row of width pixels, written to out.
+ */
+static inline void blend_premultiplied_row(ARGB_PIXEL *out, const ARGB_PIXEL *bg, const ARGB_PIXEL *fg, INT width) {
+    INT x = 0;
+#ifdef SIMD_PIXELS
+    for (; x + SIMD_PIXELS <= width; x += SIMD_PIXELS)
+        VEC_STORE(out + x, vec_blend_premultiplied(VEC_LOAD(fg + x), VEC_LOAD(bg + x)));
+#endif
+    for (; x < width; x++)
+        out[x] = blend_premultiplied(fg[x], bg[x]);
+}
+
+#endif
@@ -0,0 +1,27 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef VECTOR_DEFERRED_H
+#define VECTOR_DEFERRED_H
+
+#include "engine_types.h"
+
+bool deferred_object(SCENE_3D *scene, INT queue_index);
+void deferred_rasterize(SCENE_3D *scene);
+INT deferred_shade_tile(SCENE_3D *scene, INT x0, INT y0, INT x1, INT y1);
+void deferred_shade(SCENE_3D *scene);
+
+#endif
\ No newline at end of file
@@ -29,8 +29,11 @@ void obj_3d_init_geometry(OBJ_3D *obj);
 void obj_3d_determine_edges(OBJ_3D *obj);
 void obj_3d_calc_face_normals(OBJ_3D *obj);
 void obj_3d_calc_vertex_normals(OBJ_3D *obj);
+void obj_3d_sort_front_faces(OBJ_3D *obj);
 
 void obj_3d_draw_wireframe(OBJ_3D *obj);
+void obj_3d_draw_z_only(OBJ_3D *obj);
+void obj_3d_draw_solid_span(OBJ_3D *obj);
 void obj_3d_draw_solid_unshaded(OBJ_3D *obj);
 void obj_3d_draw_solid_shaded(OBJ_3D *obj);
 void obj_3d_draw_interp_unshaded(OBJ_3D *obj);
@@ -21,15 +21,32 @@
 
 void vr_init();
 void vr_set_render_buffer(const RENDER_BUFFER* rb);
+void vr_set_span_buffer(SPAN_BUFFER* sb);
 void vr_cleanup();
+OVERDRAW_STATS vr_overdraw_stats();
+void vr_overdraw_stats_reset();
+void vr_overdraw_add_shaded(INT cnt);
+void vr_overdraw_count_coverage();
+const ARGB_MAP *map_mip_level(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mc, const ARGB_MAP *map, INT *level);
 
 void line_flat(INT x0, INT y0, INT x1, INT y1, COLOR *color);
 void line_flat_z(PROJECTION_COORD** v, COLOR *color);
 
 void polygon_solid(INT vcnt, PROJECTION_COORD** vp, COLOR *color);
 void polygon_solid_z(INT vcnt, PROJECTION_COORD** vp, COLOR *color);
+void polygon_solid_span(INT vcnt, PROJECTION_COORD** vp, COLOR *color);
 void polygon_solid_spec_z(INT vcnt, PROJECTION_COORD** vp, COLOR *color, COLOR *spec);
+void polygon_id_z(INT vcnt, PROJECTION_COORD** vp, UINT id);
 void polygon_interp_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vcolor);
+void triangle_solid_z(INT vcnt, PROJECTION_COORD** vp, COLOR *color);
+void triangle_interp_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vcolor);
+void triangle_texture_base_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void triangle_solid_diff_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void triangle_solid_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void triangle_solid_diff_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void triangle_interp_diff_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void triangle_interp_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void triangle_interp_diff_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
 void polygon_texture_bump_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const BUMP_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mref);
 void polygon_texture_base_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const ARGB_MAP * const mbase);
 void polygon_texture_base_mul_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const ARGB_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mmul);
@@ -42,4 +59,38 @@ void polygon_interp_diff_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdif
 void polygon_interp_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
 void polygon_interp_diff_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
 
+void polygon_texture_base_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_texture_bump_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const BUMP_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mref);
+void polygon_texture_base_mul_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mmul);
+void polygon_texture_base_add_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const madd);
+void polygon_texture_base_mul_add_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mmul, const ARGB_MAP * const madd);
+void polygon_solid_diff_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_diff_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_texture_base_bilinear_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_diff_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_diff_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_texture_base_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_diff_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_solid_diff_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+
+void polygon_z_only(INT vcnt, PROJECTION_COORD** vp);
+void polygon_texture_bump_zeq(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const BUMP_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mref);
+void polygon_texture_bump_persp_zeq(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const BUMP_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mref);
+void polygon_interp_diff_spec_texture_zeq(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_spec_texture_persp_zeq(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_spec_texture_bilinear_zeq(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+void polygon_interp_diff_spec_texture_bilinear_persp_zeq(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase);
+
 #endif
\ No newline at end of file
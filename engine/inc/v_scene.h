@@ -26,6 +26,7 @@ void scene_3d_lighting_set_settings(SCENE_3D *scene, GLOBAL_LIGHT_SETTINGS *sett
 void scene_3d_add_root_container(SCENE_3D *scene, OBJ_3D_CONTAINER *root);
 void scene_3d_add_child_container(OBJ_3D_CONTAINER *parent, OBJ_3D_CONTAINER *child);
 void scene_3d_transform_and_light(SCENE_3D* scene);
+void scene_3d_build_render_queue(SCENE_3D* scene);
 void scene_3d_render(SCENE_3D* scene);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef VECTOR_SPAN_BUFFER_H
+#define VECTOR_SPAN_BUFFER_H
+
+#include "engine_types.h"
+
+SPAN_BUFFER *SPAN_BUFFER_alloc(INT height);
+void SPAN_BUFFER_clear(SPAN_BUFFER *sb);
+void SPAN_BUFFER_free(SPAN_BUFFER *sb);
+void SPAN_BUFFER_insert(SPAN_BUFFER *sb, INT y, INT x0, INT x1, INT z, INT dz, ARGB_PIXEL color);
+INT SPAN_BUFFER_emit(SPAN_BUFFER *sb, RENDER_BUFFER *rb, bool write_z);
+
+#endif
\ No newline at end of file
@@ -32,6 +32,8 @@ int prev_frame_ticks;
 double interval_time;
 int interval_frames;
 
+static uint64_t shown_stamp; //write stamp of the display buffer map uploaded to the texture, see display_show()
+
 int display_init(int window_width, int window_height, int window_flags, const char *window_name) {
     SDL_DisplayMode disp_mode;
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
@@ -72,8 +74,36 @@ int display_init(int window_width, int window_height, int window_flags, const ch
     return 1;
 }
 
+/*
+ Upload tiles of the display buffer map written since the last upload (see ARGB_MAP_track_dirty()).
+ Adjacent dirty tiles of a tile row are uploaded together.
+*/
+static void display_update_dirty(ARGB_MAP *map) {
+    SDL_Rect rect;
+    INT tx, ty, tx0;
+    for (ty = 0; ty < map->dirty_rows; ty++) {
+        for (tx = 0; tx < map->dirty_cols; tx++) {
+            if (map->dirty[ty*map->dirty_cols + tx] <= shown_stamp)
+                continue;
+            for (tx0 = tx; tx < map->dirty_cols && map->dirty[ty*map->dirty_cols + tx] > shown_stamp; tx++);
+            rect.x = tx0 << MAP_DIRTY_TILE_SHIFT;
+            rect.y = ty << MAP_DIRTY_TILE_SHIFT;
+            rect.w = (tx << MAP_DIRTY_TILE_SHIFT < map->width ? tx << MAP_DIRTY_TILE_SHIFT : map->width) - rect.x;
+            rect.h = ((ty + 1) << MAP_DIRTY_TILE_SHIFT < map->height ? (ty + 1) << MAP_DIRTY_TILE_SHIFT : map->height) - rect.y;
+            SDL_UpdateTexture(display_texture, &rect, MAP_ROW(map, rect.y) + rect.x, map->stride * sizeof(ARGB_PIXEL));
+        }
+    }
+}
+
 void display_show(const int delay) {
-    SDL_UpdateTexture(display_texture, NULL, (ARGB_PIXEL*)display_buf->map->data, display_buf->width * sizeof(ARGB_PIXEL));
+    RENDER_BUFFER_resolve_background(display_buf);
+    map_graph_flush();
+    if (display_buf->map->dirty != NULL)
+        display_update_dirty(display_buf->map);
+    else
+        SDL_UpdateTexture(display_texture, NULL, (ARGB_PIXEL*)display_buf->map->data, display_buf->map->stride * sizeof(ARGB_PIXEL));
+    shown_stamp = ARGB_MAP_dirty_stamp();
+    map_pool_end_frame(); //frame transient maps and render buffers
     SDL_RenderCopy(display_renderer, display_texture, NULL, NULL);
     SDL_RenderPresent(display_renderer);
     SDL_Delay(delay);
@@ -104,7 +134,15 @@ void periodic_fps_printf(double period) {
     if ((engine_run_stats().time - interval_time) > period) {
         int cur_frames = engine_run_stats().frames - interval_frames;
         double cur_time = engine_run_stats().time - interval_time;
+#ifdef RENDER_STATS
+        //Average shading passes per covered pixel in the last period
+        OVERDRAW_STATS od = vr_overdraw_stats();
+        printf("FPS: %d, overdraw: %.2f    \r", (int)(cur_frames / cur_time),
+            od.covered ? (double)od.shaded/od.covered : 0.0);
+        vr_overdraw_stats_reset();
+#else
         printf("FPS: %d    \r", (int)(cur_frames / cur_time));
+#endif
         fflush(stdout);
         interval_time = engine_run_stats().time;
         interval_frames = engine_run_stats().frames;
@@ -0,0 +1,168 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "engine.h"
+
+/*
+ Blue noise threshold map for dithered fading and blending, generated with void-and-cluster method
+ on a DITHER_SIZE x DITHER_SIZE torus, so it tiles without seams.
+ Rows are stored twice (2*DITHER_SIZE thresholds), so DITHER_SIZE thresholds can be read from any
+ starting column without wrapping.
+*/
+#define DITHER_N (DITHER_SIZE*DITHER_SIZE)
+#define DITHER_SIGMA (1.5)
+//Offset of the threshold map between frames (7 frame cycle)
+#define DITHER_STEP_X (37)
+#define DITHER_STEP_Y (21)
+
+static INT *dither_map = NULL;
+static bool dither_animated = true;
+
+//Energy terms are calculated in double regardless of FLOAT, so the map is the same in all builds
+static double *kernel = NULL; //gaussian weight of toroidal distance, indexed by (dy, dx)
+static double *energy = NULL; //sum of kernel weights from all set points
+static bool *set = NULL;
+
+static void update_energy(INT i, double sign) {
+    INT x0 = i & (DITHER_SIZE-1), y0 = i / DITHER_SIZE;
+    for (INT y = 0; y < DITHER_SIZE; y++) {
+        const double *k = kernel + ((y - y0) & (DITHER_SIZE-1))*DITHER_SIZE;
+        double *e = energy + y*DITHER_SIZE;
+        for (INT x = 0; x < DITHER_SIZE; x++) {
+            e[x] += sign*k[(x - x0) & (DITHER_SIZE-1)];
+        }
+    }
+    set[i] = sign > 0;
+}
+
+//Set point with highest energy (tightest cluster)
+static INT tightest_cluster() {
+    INT best = -1;
+    for (INT i = 0; i < DITHER_N; i++) {
+        if (set[i] && (best < 0 || energy[i] > energy[best]))
+            best = i;
+    }
+    return best;
+}
+
+//Unset point with lowest energy (largest void)
+static INT largest_void() {
+    INT best = -1;
+    for (INT i = 0; i < DITHER_N; i++) {
+        if (!set[i] && (best < 0 || energy[i] < energy[best]))
+            best = i;
+    }
+    return best;
+}
+
+void dither_init() {
+    INT i, c, v, rank, ones = 0;
+    UINT seed = 1;
+    INT *ranks = calloc(DITHER_N, sizeof(INT));
+    bool *proto = calloc(DITHER_N, sizeof(bool));
+    double *proto_energy = calloc(DITHER_N, sizeof(double));
+    dither_map = calloc(2*DITHER_N, sizeof(INT));
+    kernel = calloc(DITHER_N, sizeof(double));
+    energy = calloc(DITHER_N, sizeof(double));
+    set = calloc(DITHER_N, sizeof(bool));
+
+    for (i = 0; i < DITHER_N; i++) {
+        INT dx = i & (DITHER_SIZE-1), dy = i / DITHER_SIZE;
+        dx = dx > DITHER_SIZE/2 ? DITHER_SIZE - dx : dx;
+        dy = dy > DITHER_SIZE/2 ? DITHER_SIZE - dy : dy;
+        kernel[i] = exp(-(dx*dx + dy*dy)/(2.0*DITHER_SIGMA*DITHER_SIGMA));
+    }
+
+    //Initial pattern: random tenth of points, redistributed by moving tightest cluster to largest void
+    while (ones < DITHER_N/10) {
+        i = PRN(seed) % DITHER_N;
+        if (!set[i]) {
+            update_energy(i, 1.0);
+            ones++;
+        }
+    }
+    while (1) {
+        c = tightest_cluster();
+        update_energy(c, -1.0);
+        v = largest_void();
+        if (v == c) {
+            update_energy(c, 1.0);
+            break;
+        }
+        update_energy(v, 1.0);
+    }
+    memcpy(proto, set, DITHER_N*sizeof(bool));
+    memcpy(proto_energy, energy, DITHER_N*sizeof(double));
+
+    //Ranks of initial points: tightest clusters are removed first and get highest ranks
+    for (rank = ones - 1; rank >= 0; rank--) {
+        c = tightest_cluster();
+        update_energy(c, -1.0);
+        ranks[c] = rank;
+    }
+    //Ranks of remaining points: largest voids are filled first
+    memcpy(set, proto, DITHER_N*sizeof(bool));
+    memcpy(energy, proto_energy, DITHER_N*sizeof(double));
+    for (rank = ones; rank < DITHER_N; rank++) {
+        v = largest_void();
+        update_energy(v, 1.0);
+        ranks[v] = rank;
+    }
+
+    for (i = 0; i < DITHER_N; i++) {
+        INT x = i & (DITHER_SIZE-1), y = i / DITHER_SIZE;
+        dither_map[2*y*DITHER_SIZE + x] = dither_map[2*y*DITHER_SIZE + x + DITHER_SIZE] =
+            (INT)((int64_t)ranks[i]*DITHER_MAX/DITHER_N);
+    }
+
+    free(ranks);
+    free(proto);
+    free(proto_energy);
+    free(kernel);
+    free(energy);
+    free(set);
+    kernel = energy = NULL;
+    set = NULL;
+}
+
+void dither_cleanup() {
+    free(dither_map);
+    dither_map = NULL;
+}
+
+/*
+ Switch offsetting of the threshold map between frames on/off.
+*/
+void dither_animate(bool on) {
+    dither_animated = on;
+}
+
+/*
+ Offset of the threshold map for the current frame. Positions repeat every 7 frames
+ (better with lower framerates).
+*/
+void dither_offset(INT *dx, INT *dy) {
+    INT k = dither_animated ? engine_run_stats().frames%7 : 0;
+    *dx = (k*DITHER_STEP_X) & (DITHER_SIZE-1);
+    *dy = (k*DITHER_STEP_Y) & (DITHER_SIZE-1);
+}
+
+/*
+ Thresholds of row y (wrapped to the map), 2*DITHER_SIZE values.
+*/
+const INT *dither_row(INT y) {
+    return dither_map + 2*(y & (DITHER_SIZE-1))*DITHER_SIZE;
+}
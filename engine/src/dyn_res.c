@@ -0,0 +1,105 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include <SDL2/SDL.h>
+
+#include "engine.h"
+
+/*
+ Dynamic resolution controller.
+ Usage per frame: DYN_RES_begin(), rendering into DYN_RES.buf, DYN_RES_end().
+ Render time is measured between these calls. Resolution is lowered by one level only after
+ DYN_RES_DOWN_FRAMES consecutive frames slower than the target, and raised by one level only after
+ DYN_RES_UP_FRAMES consecutive frames fast enough to stay below DYN_RES_UP_RATIO of the target
+ at the next level (render time is assumed proportional to the pixel count). This hysteresis
+ prevents oscillation between two levels.
+*/
+
+#define DYN_RES_DOWN_FRAMES (3)
+#define DYN_RES_UP_FRAMES (30)
+#define DYN_RES_UP_RATIO (0.9)
+
+DYN_RES *DYN_RES_alloc(INT width, INT height, INT z_buf_on, FLOAT target_time) {
+    DYN_RES *dr = calloc(1, sizeof(DYN_RES));
+    dr->buf = RENDER_BUFFER_alloc(width, height, z_buf_on);
+    dr->width = width;
+    dr->height = height;
+    dr->target_time = target_time;
+    dr->level = DYN_RES_LEVELS;
+    dr->min_level = DYN_RES_LEVELS/4;
+    dr->bilinear = true;
+    return dr;
+}
+
+void DYN_RES_free(DYN_RES *dr) {
+    if (dr == NULL)
+        return;
+    RENDER_BUFFER_free(dr->buf);
+    free(dr);
+}
+
+/*
+ Set dimensions of the render buffer for current scale level and start measuring render time.
+ Has to be called before scene_3d_transform_and_light(), as the projection depends on them.
+*/
+void DYN_RES_begin(DYN_RES *dr) {
+    RENDER_BUFFER_set_size(dr->buf,
+        (dr->width*dr->level + DYN_RES_LEVELS/2)/DYN_RES_LEVELS,
+        (dr->height*dr->level + DYN_RES_LEVELS/2)/DYN_RES_LEVELS);
+    dr->start = SDL_GetPerformanceCounter();
+}
+
+/*
+ Finish measuring render time, update the scale level and upscale the render buffer into out.
+*/
+void DYN_RES_end(DYN_RES *dr, RENDER_BUFFER *out) {
+    FLOAT next;
+
+    dr->time = (FLOAT)(SDL_GetPerformanceCounter() - dr->start)/SDL_GetPerformanceFrequency();
+    //Expected render time at the next level
+    next = dr->time*(dr->level + 1)*(dr->level + 1)/(dr->level*dr->level);
+    if (dr->time > dr->target_time) {
+        dr->under_cnt = 0;
+        if (++dr->over_cnt >= DYN_RES_DOWN_FRAMES && dr->level > dr->min_level) {
+            dr->level--;
+            dr->over_cnt = 0;
+        }
+    }
+    else if (next < dr->target_time*DYN_RES_UP_RATIO) {
+        dr->over_cnt = 0;
+        if (++dr->under_cnt >= DYN_RES_UP_FRAMES && dr->level < DYN_RES_LEVELS) {
+            dr->level++;
+            dr->under_cnt = 0;
+        }
+    }
+    else {
+        dr->over_cnt = 0;
+        dr->under_cnt = 0;
+    }
+
+    RENDER_BUFFER_resolve_background(dr->buf);
+    if (dr->bilinear)
+        ARGB_MAP_scale_bilinear(out->map, dr->buf->map);
+    else
+        ARGB_MAP_scale_nearest(out->map, dr->buf->map);
+}
+
+/*
+ Current scale factor of the render buffer dimensions, (0.0, 1.0]
+*/
+FLOAT DYN_RES_scale(DYN_RES *dr) {
+    return (FLOAT)dr->level/DYN_RES_LEVELS;
+}
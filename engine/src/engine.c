@@ -61,6 +61,10 @@ INT engine_init(INT window_width, INT window_height, INT window_flags, const cha
         return 1;
     }
     init_keyboard_handler();
+    parallel_init(0);
+    map_graph_init();
+    map_pool_init();
+    dither_init();
     map_generator_init();
     map_filters_init();
     /** Init 3d rendering */
@@ -142,9 +146,13 @@ EVENT* engine_poll_events() {
 }
 
 INT engine_cleanup() {
+    map_pool_cleanup();
+    map_graph_cleanup();
+    dither_cleanup();
     vr_cleanup();
     map_generator_cleanup();
     map_filters_cleanup();
+    parallel_cleanup();
     Mix_FreeMusic(engine_music);
     engine_music = NULL;
     Mix_Quit();
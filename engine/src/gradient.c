@@ -44,6 +44,41 @@ COLOR *GRADIENT_get_value(GRADIENT *g, FLOAT t) {
     return COLOR_blend( &g->color[i], &g->color[i-1], (t-g->t[i-1])/(g->t[i]-g->t[i-1]) );
 }
 
+static void gradient_blend(COLOR *o, COLOR *a, COLOR *b, FLOAT p) {
+    o->a = a->a*p + b->a*(1-p);
+    o->r = a->r*p + b->r*(1-p);
+    o->g = a->g*p + b->g*(1-p);
+    o->b = a->b*p + b->b*(1-p);
+}
+
+/*
+ Same as COLOR_to_ARGB_PIXEL(GRADIENT_get_value(g, t)), without use of the shared color buffer,
+ so it may be called from parallel map operations.
+*/
+ARGB_PIXEL GRADIENT_get_pixval(GRADIENT *g, FLOAT t) {
+    INT i = 0;
+    FLOAT t_start = g->t[0];
+    FLOAT t_end = g->t[g->count-1];
+    COLOR c;
+
+    if (t < 0.0 || t > 1.0) {
+        return COLOR_to_ARGB_PIXEL(&g->background);
+    }
+    else if (t < t_start) {
+        gradient_blend(&c, &g->color[0], &g->background, t/t_start);
+    }
+    else if (t > t_end) {
+        gradient_blend(&c, &g->background, &g->color[g->count-1], (t-t_end) / (1.0-t_end));
+    }
+    else {
+        while (i < g->count && t >= g->t[i]) {
+            i++;
+        }
+        gradient_blend(&c, &g->color[i], &g->color[i-1], (t-g->t[i-1])/(g->t[i]-g->t[i-1]));
+    }
+    return COLOR_to_ARGB_PIXEL(&c);
+}
+
 DISCRETE_GRADIENT *DISCRETE_GRADIENT_alloc(INT length) {
     DISCRETE_GRADIENT *dg = calloc(1, sizeof(DISCRETE_GRADIENT));
     dg->pixval = calloc(length, sizeof(ARGB_PIXEL));
@@ -19,16 +19,57 @@
 #include <SDL2/SDL_image.h>
 
 #include "engine.h"
+#include "simd.h"
 
+/*
+ Allocate zeroed block of size bytes aligned to MAP_ALIGN. *storage is set to the pointer to free.
+*/
+static void *aligned_calloc(size_t size, void **storage) {
+    *storage = calloc(size + MAP_ALIGN - 1, 1);
+    if (*storage == NULL)
+        return NULL;
+    return (void*)(((uintptr_t)*storage + MAP_ALIGN - 1) & ~(uintptr_t)(MAP_ALIGN - 1));
+}
+
+/*
+ Allocate map with rows aligned to MAP_ALIGN bytes (rows are padded to MAP_STRIDE(width) pixels).
+*/
 ARGB_MAP *ARGB_MAP_alloc(INT width, INT height, INT wrap_margin) {
     ARGB_MAP *map = calloc(1, sizeof(ARGB_MAP));
-    map->data = calloc(width*height, sizeof(ARGB_PIXEL));
+    map->stride = MAP_STRIDE(width);
+    map->data = aligned_calloc((size_t)map->stride*height*sizeof(ARGB_PIXEL), &map->storage);
     map->width = width;
     map->height = height-wrap_margin;
     map->height_with_margin = height;
     return map;
 }
 
+/*
+ Map of w x h pixels at (x, y) of parent, sharing parent pixels (no copy). The rectangle is clipped to parent.
+ Writes to the view are marked dirty in the parent. The view has to be freed before its parent.
+ Not available for tiled maps.
+*/
+ARGB_MAP *ARGB_MAP_view(ARGB_MAP *parent, INT x, INT y, INT w, INT h) {
+    if (parent == NULL || parent->tiled)
+        return NULL;
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > parent->width) w = parent->width - x;
+    if (y + h > parent->height) h = parent->height - y;
+    if (w < 1 || h < 1)
+        return NULL;
+    ARGB_MAP *map = calloc(1, sizeof(ARGB_MAP));
+    map->data = MAP_ROW(parent, y) + x;
+    map->width = w;
+    map->height = map->height_with_margin = h;
+    map->stride = parent->stride;
+    map->premultiplied = parent->premultiplied;
+    map->view_of = parent;
+    map->view_x = x;
+    map->view_y = y;
+    return map;
+}
+
 BUMP_MAP *BUMP_MAP_alloc(INT width, INT height) {
     BUMP_MAP *map = calloc(1, sizeof(BUMP_MAP));
     map->data = calloc(width*height, sizeof(BUMP_PIXEL));
@@ -37,32 +78,107 @@ BUMP_MAP *BUMP_MAP_alloc(INT width, INT height) {
     return map;
 }
 
-Z_MAP *Z_MAP_alloc(INT width, INT height) {
+/*
+ Allocate Z map with 16 or 32 bit Z values (bits).
+*/
+Z_MAP *Z_MAP_alloc(INT width, INT height, INT bits) {
     Z_MAP *map = calloc(1, sizeof(Z_MAP));
-    map->data = calloc(width*height, sizeof(Z_PIXEL));
+    map->stride = MAP_STRIDE(width);
+    if (bits == 16)
+        map->data16 = aligned_calloc((size_t)map->stride*height*sizeof(Z16_PIXEL), &map->storage);
+    else
+        map->data = aligned_calloc((size_t)map->stride*height*sizeof(Z_PIXEL), &map->storage);
     map->width = width;
     map->height = height;
+    map->tile_cols = (width + Z_TILE_SIZE - 1) >> Z_TILE_SHIFT;
+    map->tile_rows = (height + Z_TILE_SIZE - 1) >> Z_TILE_SHIFT;
+    map->tile_max = calloc(map->tile_cols*map->tile_rows, sizeof(Z_PIXEL));
+    map->dirty_x0 = map->tile_cols;    map->dirty_x1 = -1;
+    map->dirty_y0 = map->tile_rows;    map->dirty_y1 = -1;
     return map;
 }
 
+static void clear_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    for (INT y = y0; y < y1; y++)
+        memset(MAP_ROW(job->out, y), 0, job->out->width*sizeof(ARGB_PIXEL));
+}
+
 void ARGB_MAP_clear(ARGB_MAP *map) {
     if (map == NULL)
         return;
-    memset(map->data, 0, map->width*map->height*sizeof(ARGB_PIXEL));
+    MAP_JOB job = {.out = map};
+    map_graph_rows(clear_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+/*
+ Change dimensions of Z map allocated with at least width x height size. Z map is cleared.
+*/
+void Z_MAP_set_size(Z_MAP *map, INT width, INT height) {
+    if (map == NULL)
+        return;
+    map->width = width;
+    map->height = height;
+    map->stride = MAP_STRIDE(width);
+    map->tile_cols = (width + Z_TILE_SIZE - 1) >> Z_TILE_SHIFT;
+    map->tile_rows = (height + Z_TILE_SIZE - 1) >> Z_TILE_SHIFT;
+    map->epoch = 0; //rows layout has changed, full clear is needed
+    Z_MAP_clear(map);
 }
 
 void Z_MAP_clear(Z_MAP *map) {
     if (map == NULL)
         return;
-    memset(map->data, 0xFF, map->width*map->height*sizeof(Z_PIXEL));
+    if (Z_MAP_clear_tiles(map))
+        Z_MAP_clear_rows(map, 0, map->height-1);
+}
+
+/*
+ First part of Z_MAP_clear(): reset coarse Z tiles and advance the frame epoch (see Z_EPOCH_BITS).
+ Returns true if Z values have to be cleared too, with Z_MAP_clear_rows().
+*/
+bool Z_MAP_clear_tiles(Z_MAP *map) {
+    map->dirty_x0 = map->tile_cols;    map->dirty_x1 = -1;
+    map->dirty_y0 = map->tile_rows;    map->dirty_y1 = -1;
+    memset(map->tile_max, 0xFF, map->tile_cols*map->tile_rows*sizeof(Z_PIXEL));
+    if (map->epoch_on && map->data != NULL && map->epoch > 0) {
+        //Start new frame epoch, Z of all pixels drawn so far becomes higher than any new Z
+        map->epoch--;
+        return false;
+    }
+    map->epoch = map->epoch_on && map->data != NULL ? Z_EPOCH_MAX : 0;
+    return true;
+}
+
+/*
+ Clear Z values of rows y0-y1 (both included).
+*/
+void Z_MAP_clear_rows(Z_MAP *map, INT y0, INT y1) {
+    //Padding at row ends is cleared too, rows are cleared with a single memset
+    if (map->data16 != NULL)
+        memset(map->data16 + y0*map->stride, 0xFF, (y1-y0+1)*map->stride*sizeof(Z16_PIXEL));
+    else
+        memset(map->data + y0*map->stride, 0xFF, (y1-y0+1)*map->stride*sizeof(Z_PIXEL));
+}
+
+static void fill_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_PIXEL pix_val = job->pixval, *row;
+    for (INT y = y0; y < y1; y++) {
+        row = MAP_ROW(job->out, y);
+        for (INT x = 0; x < job->out->width; x++)
+            row[x] = pix_val;
+    }
 }
 
 void ARGB_MAP_fill(ARGB_MAP *map, COLOR *color) {
     if (map == NULL)
         return;
-    ARGB_PIXEL pix_val = COLOR_to_ARGB_PIXEL(color);
-    for (INT offs = 0; offs < map->width*map->height; offs++)
-        map->data[offs] = pix_val;
+    MAP_JOB job = {.out = map, .pixval = COLOR_to_ARGB_PIXEL(color)};
+    map_graph_rows(fill_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void copy_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    for (INT y = y0; y < y1; y++)
+        memcpy(MAP_ROW(job->out, y), MAP_ROW(job->map0, y), job->out->width*sizeof(ARGB_PIXEL));
 }
 
 void ARGB_MAP_copy(ARGB_MAP *dst, ARGB_MAP *src) {
@@ -70,218 +186,669 @@ void ARGB_MAP_copy(ARGB_MAP *dst, ARGB_MAP *src) {
         dst->width != src->width || dst->height != src->height) {
         return;
     }
-    memcpy(dst->data, src->data, dst->width*dst->height*sizeof(ARGB_PIXEL));
+    dst->premultiplied = src->premultiplied;
+    MAP_JOB job = {.out = dst, .map0 = src};
+    map_graph_rows(copy_rows, &job, dst->height, 2*dst->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+/*
+ Transpose: y0, y1 of the band are indexes of MAP_TRANSPOSE_BLOCK pixels high block rows of out.
+ Blocks of in and out are small enough to stay in L1 cache while strided columns are accessed.
+*/
+static void transpose_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *in = job->map0;
+    const INT b = MAP_TRANSPOSE_BLOCK;
+    INT bx, by, x, y, x1, y1b, x4, y4;
+
+    for (by = y0*b; by < y1*b && by < out->height; by += b) {
+        y1b = by + b < out->height ? by + b : out->height;
+        y4 = by + ((y1b - by) & ~3);
+        for (bx = 0; bx < out->width; bx += b) {
+            x1 = bx + b < out->width ? bx + b : out->width;
+            x4 = bx + ((x1 - bx) & ~3);
+            for (x = bx; x < x4; x += 4)
+                for (y = by; y < y4; y += 4)
+                    transpose_4x4(MAP_ROW(out, y) + x, out->stride, MAP_ROW(in, x) + y, in->stride);
+            for (y = by; y < y1b; y++)
+                for (x = y < y4 ? x4 : bx; x < x1; x++)
+                    MAP_ROW(out, y)[x] = MAP_ROW(in, x)[y];
+        }
+    }
+}
+
+/*
+ Transpose in into out (out->width == in->height, out->height == in->width): out(x, y) = in(y, x).
+ Executes deferred operations first, not deferrable itself.
+*/
+void ARGB_MAP_transpose(ARGB_MAP *out, ARGB_MAP *in) {
+    if (out == NULL || in == NULL || out == in || out->width != in->height || out->height != in->width)
+        return;
+    MAP_JOB job = {.out = out, .map0 = in};
+    out->premultiplied = in->premultiplied;
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, out->height-1);
+    parallel_rows(transpose_rows, &job, (out->height + MAP_TRANSPOSE_BLOCK-1)/MAP_TRANSPOSE_BLOCK,
+                  2*MAP_TRANSPOSE_BLOCK*out->width*sizeof(ARGB_PIXEL));
+}
+
+/*
+ Dirty tiles tracking. Every write to a tracked map stamps its written MAP_DIRTY_TILE_SIZE tiles
+ with a new value of the global write counter, so users of the map can find tiles written after
+ they have seen it (display_show() uploads only these tiles to the screen texture).
+ Map operations (see map_graph_rows()), RENDER_BUFFER functions and rasterizers stamp tiles themselves,
+ code writing map pixels directly has to call ARGB_MAP_mark_dirty().
+*/
+//Stamps are 64 bit: at one stamp per rasterized polygon or span a 32 bit counter would wrap within an hour,
+//and written tiles would then look older than the last upload.
+static uint64_t dirty_stamp = 0; //last given write stamp
+
+/*
+ Switch dirty tiles tracking of the map on/off. Tracking is started with all tiles dirty.
+*/
+void ARGB_MAP_track_dirty(ARGB_MAP *map, bool on) {
+    if (map == NULL || map->view_of != NULL)
+        return;
+    if (map->dirty != NULL) {
+        free(map->dirty);
+        map->dirty = NULL;
+    }
+    map->dirty_seq = 0;
+    map->dirty_op = 0;
+    if (!on)
+        return;
+    map->dirty_cols = (map->width + MAP_DIRTY_TILE_SIZE - 1) >> MAP_DIRTY_TILE_SHIFT;
+    map->dirty_rows = (map->height + MAP_DIRTY_TILE_SIZE - 1) >> MAP_DIRTY_TILE_SHIFT;
+    map->dirty = calloc(map->dirty_cols*map->dirty_rows, sizeof(uint64_t));
+    ARGB_MAP_mark_dirty(map, 0, 0, map->width-1, map->height-1);
+}
+
+/*
+ Mark tiles covering pixels (x0, y0)-(x1, y1) of the tracked map as written.
+*/
+void ARGB_MAP_mark_dirty(ARGB_MAP *map, INT x0, INT y0, INT x1, INT y1) {
+    if (map != NULL && map->view_of != NULL) {
+        //Views are not tracked, their parents are
+        x0 = x0 < 0 ? 0 : x0;    x1 = x1 > map->width-1 ? map->width-1 : x1;
+        y0 = y0 < 0 ? 0 : y0;    y1 = y1 > map->height-1 ? map->height-1 : y1;
+        if (x0 <= x1 && y0 <= y1)
+            ARGB_MAP_mark_dirty(map->view_of, x0 + map->view_x, y0 + map->view_y, x1 + map->view_x, y1 + map->view_y);
+        return;
+    }
+    if (map == NULL || map->dirty == NULL)
+        return;
+    x0 = x0 < 0 ? 0 : x0 >> MAP_DIRTY_TILE_SHIFT;
+    y0 = y0 < 0 ? 0 : y0 >> MAP_DIRTY_TILE_SHIFT;
+    x1 = (x1 > map->width-1 ? map->width-1 : x1) >> MAP_DIRTY_TILE_SHIFT;
+    y1 = (y1 > map->height-1 ? map->height-1 : y1) >> MAP_DIRTY_TILE_SHIFT;
+    if (x0 > x1 || y0 > y1)
+        return;
+    dirty_stamp++;
+    for (INT ty = y0; ty <= y1; ty++)
+        for (INT tx = x0; tx <= x1; tx++)
+            map->dirty[ty*map->dirty_cols + tx] = dirty_stamp;
+}
+
+/*
+ Current value of the write counter: tiles written from now on will have higher stamps.
+*/
+uint64_t ARGB_MAP_dirty_stamp() {
+    return dirty_stamp;
+}
+
+//Returns true if any tile in tile rows ty0-ty1 of the map was written after stamp seq
+static bool dirty_tile_rows(ARGB_MAP *map, INT ty0, INT ty1, uint64_t seq) {
+    for (INT i = ty0*map->dirty_cols; i < (ty1 + 1)*map->dirty_cols; i++)
+        if (map->dirty[i] > seq)
+            return true;
+    return false;
+}
+
+/*
+ Rows y0..y1-1 of map operation writing all rows of job->out, which have to be executed.
+ op: hash of operation function and parameters, 0 if it can't be compared.
+ halo: number of rows below the processed row read from input maps.
+ When the same operation was the last one writing all rows of out, only rows of tiles written since then
+ (in out, or in input maps with halo rows) are returned. All rows are returned if out or any input map
+ is not tracked. Returned rows are marked dirty in out.
+*/
+void ARGB_MAP_dirty_rows(MAP_JOB *job, UINT op, INT height, INT halo, INT *y0, INT *y1) {
+    ARGB_MAP *out = job->out, *in[3] = {job->map0, job->map1, job->p};
+    INT i, ty, ty0, ty1;
+    bool full = op == 0 || op != out->dirty_op || height != out->height;
+    *y0 = 0;
+    *y1 = height;
+    if (out->dirty == NULL) {
+        ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, height-1); //marks the parent of a view
+        return;
+    }
+    for (i = 0; i < 3; i++) {
+        if (in[i] != NULL && (in[i] == out || in[i]->dirty == NULL ||
+            in[i]->width != out->width || in[i]->height != out->height)) {
+            full = true;
+        }
+    }
+    if (!full) {
+        ty0 = out->dirty_rows;
+        ty1 = -1;
+        for (ty = 0; ty < out->dirty_rows; ty++) {
+            bool written = dirty_tile_rows(out, ty, ty, out->dirty_seq);
+            for (i = 0; i < 3 && !written; i++)
+                written = in[i] != NULL && dirty_tile_rows(in[i], ty,
+                    ((ty << MAP_DIRTY_TILE_SHIFT) + MAP_DIRTY_TILE_SIZE - 1 + halo < out->height - 1 ?
+                    (ty << MAP_DIRTY_TILE_SHIFT) + MAP_DIRTY_TILE_SIZE - 1 + halo : out->height - 1) >> MAP_DIRTY_TILE_SHIFT,
+                    out->dirty_seq);
+            if (written) {
+                if (ty < ty0) ty0 = ty;
+                ty1 = ty;
+            }
+        }
+        if (ty0 > ty1) {
+            *y1 = 0;
+            return;
+        }
+        *y0 = ty0 << MAP_DIRTY_TILE_SHIFT;
+        *y1 = (ty1 + 1) << MAP_DIRTY_TILE_SHIFT < height ? (ty1 + 1) << MAP_DIRTY_TILE_SHIFT : height;
+    }
+    ARGB_MAP_mark_dirty(out, 0, *y0, out->width-1, *y1-1);
+    out->dirty_seq = dirty_stamp;
+    out->dirty_op = op;
 }
 
 void Z_MAP_copy(Z_MAP *dst, Z_MAP *src) {
-    if (dst == NULL || src == NULL || dst->data == NULL || src->data==NULL ||
+    if (dst == NULL || src == NULL || (dst->data == NULL) != (src->data == NULL) ||
         dst->width != src->width || dst->height != src->height) {
         return;
     }
-    memcpy(dst->data, src->data, dst->width*dst->height*sizeof(Z_PIXEL));
+    for (INT y = 0; y < dst->height; y++) {
+        if (src->data16 != NULL)
+            memcpy(dst->data16 + y*dst->stride, src->data16 + y*src->stride, dst->width*sizeof(Z16_PIXEL));
+        else
+            memcpy(MAP_ROW(dst, y), MAP_ROW(src, y), dst->width*sizeof(Z_PIXEL));
+    }
+    memcpy(dst->tile_max, src->tile_max, dst->tile_cols*dst->tile_rows*sizeof(Z_PIXEL));
+    dst->dirty_x0 = src->dirty_x0;    dst->dirty_x1 = src->dirty_x1;
+    dst->dirty_y0 = src->dirty_y0;    dst->dirty_y1 = src->dirty_y1;
+    dst->epoch_on = src->epoch_on;    dst->epoch = src->epoch;
+}
+
+/*
+ Recalculate maximum Z of the dirty tiles (tiles where Z values were lowered by rasterization).
+*/
+void Z_MAP_update_tiles(Z_MAP *map) {
+    if (map == NULL || map->dirty_x0 > map->dirty_x1)
+        return;
+    Z_PIXEL z_max, *row_ptr, *ptr, *end_ptr;
+    Z16_PIXEL *row16_ptr, *ptr16, *end16_ptr;
+    INT x0, x1, y0, y1;
+    for (INT ty = map->dirty_y0; ty <= map->dirty_y1; ty++) {
+        y0 = ty << Z_TILE_SHIFT;
+        y1 = y0 + Z_TILE_SIZE < map->height ? y0 + Z_TILE_SIZE : map->height;
+        for (INT tx = map->dirty_x0; tx <= map->dirty_x1; tx++) {
+            x0 = tx << Z_TILE_SHIFT;
+            x1 = x0 + Z_TILE_SIZE < map->width ? x0 + Z_TILE_SIZE : map->width;
+            z_max = 0;
+            if (map->data16 != NULL) {
+                for (row16_ptr = map->data16 + y0*map->stride; row16_ptr < map->data16 + y1*map->stride; row16_ptr += map->stride) {
+                    end16_ptr = row16_ptr + x1;
+                    for (ptr16 = row16_ptr + x0; ptr16 < end16_ptr; ptr16++)
+                        if (*ptr16 > z_max) z_max = *ptr16;
+                }
+                //Highest projected Z with 16 bit value z_max
+                z_max = z_max << Z16_SHIFT | ((1 << Z16_SHIFT) - 1);
+            }
+            else {
+                for (row_ptr = MAP_ROW(map, y0); row_ptr < MAP_ROW(map, y1); row_ptr += map->stride) {
+                    end_ptr = row_ptr + x1;
+                    for (ptr = row_ptr + x0; ptr < end_ptr; ptr++)
+                        if (*ptr > z_max) z_max = *ptr;
+                }
+            }
+            map->tile_max[ty*map->tile_cols + tx] = z_max;
+        }
+    }
+    map->dirty_x0 = map->tile_cols;    map->dirty_x1 = -1;
+    map->dirty_y0 = map->tile_rows;    map->dirty_y1 = -1;
+}
+
+static void copy_uncovered_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *dst = job->out, *src = job->map0;
+    Z_MAP *z = job->data;
+    ARGB_PIXEL *d, *s;
+    INT x;
+    for (INT y = y0; y < y1; y++) {
+        d = MAP_ROW(dst, y);
+        s = MAP_ROW(src, y);
+        if (z->data16 != NULL) {
+            Z16_PIXEL *zr = z->data16 + y*z->stride;
+            for (x = 0; x < dst->width; x++)
+                if (zr[x] == Z16_CLEAR)
+                    d[x] = s[x];
+        }
+        else if (z->epoch_on) {
+            Z_PIXEL *zr = MAP_ROW(z, y);
+            for (x = 0; x < dst->width; x++)
+                if (zr[x] >> Z_EPOCH_SHIFT != (UINT)z->epoch)
+                    d[x] = s[x];
+        }
+        else {
+            Z_PIXEL *zr = MAP_ROW(z, y);
+            for (x = 0; x < dst->width; x++)
+                if (zr[x] == (Z_PIXEL)0xFFFFFFFF)
+                    d[x] = s[x];
+        }
+    }
 }
 
+/*
+ Copy src pixels into dst pixels not covered by Z buffered geometry: Z map z works as a coverage mask,
+ pixels with cleared Z (or Z of an older frame epoch) are not covered.
+*/
+void ARGB_MAP_copy_uncovered(ARGB_MAP *dst, ARGB_MAP *src, Z_MAP *z) {
+    if (dst == NULL || src == NULL || z == NULL || dst->width != src->width || dst->height != src->height ||
+        dst->width != z->width || dst->height != z->height) {
+        return;
+    }
+    MAP_JOB job = {.out = dst, .map0 = src, .data = z};
+    map_graph_rows(copy_uncovered_rows, &job, dst->height, 3*dst->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void multiplex_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP **in = job->data;
+    ARGB_PIXEL *o, *m;
+    for (INT y = y0; y < y1; y++) {
+        o = MAP_ROW(job->out, y);
+        m = MAP_ROW(job->p, y);
+        for (INT x = 0; x < job->p->width; x++)
+            o[x] = MAP_ROW(in[m[x]], y)[x];
+    }
+}
+
+/*
+ Select out pixels from maps in[] by mask pixel values.
+ Executes deferred operations first, not deferrable itself: the table of maps belongs to the caller.
+*/
 void ARGB_MAP_multiplex(ARGB_MAP *out, ARGB_MAP **in, ARGB_MAP *mask) {
-    for (INT offs = 0; offs < mask->height * mask->width; offs++)
-        out->data[offs] = in[mask->data[offs]]->data[offs];
+    MAP_JOB job = {.out = out, .p = mask, .data = in};
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, mask->width-1, mask->height-1);
+    parallel_rows(multiplex_rows, &job, mask->height, 3*mask->width*sizeof(ARGB_PIXEL));
+}
+
+/*
+ Full map operations below are executed in row bands (see parallel_rows(), map_graph_rows()): public functions prepare
+ MAP_JOB parameters, *_rows() functions process rows y0 to y1-1.
+*/
+
+/*
+ Dithered selection between map0 (constant job->pixval when map0 is NULL) and map1: pixel of map1 is taken
+ where dither threshold (0..DITHER_MAX) is below k (p == NULL) or below k times alpha of p.
+ Thresholds are read from the blue noise map (see dither_row()), offset by job->dither_x, dither_y.
+*/
+static inline void dither_rows(MAP_JOB *job, INT y0, INT y1, ARGB_MAP *map0, ARGB_MAP *map1, ARGB_MAP *p, INT k) {
+    ARGB_MAP *out = job->out;
+    ARGB_PIXEL pixval = job->pixval;
+    INT x, i, len, thr = k;
+    ARGB_PIXEL *o, *a, *b, *pp;
+    for (INT y = y0; y < y1; y++) {
+        const INT *t_row = dither_row(y + job->dither_y);
+        for (x = 0; x < out->width; x += DITHER_SIZE) {
+            const INT *t = t_row + ((x + job->dither_x) & (DITHER_SIZE-1));
+            o = MAP_ROW(out, y) + x;
+            a = map0 ? MAP_ROW(map0, y) + x : NULL;
+            b = MAP_ROW(map1, y) + x;
+            pp = p ? MAP_ROW(p, y) + x : NULL;
+            len = out->width - x < DITHER_SIZE ? out->width - x : DITHER_SIZE;
+            i = 0;
+#ifdef SIMD_PIXELS
+            VEC vk = VEC_SET32(k), c0 = VEC_SET32(pixval), m, v0;
+            for (; i + SIMD_PIXELS <= len; i += SIMD_PIXELS) {
+                m = VEC_CMPGT32(pp ? VEC_MUL16(VEC_SRL32(VEC_LOAD(pp + i), 24), vk) : vk, VEC_LOAD(t + i));
+                v0 = a ? VEC_LOAD(a + i) : c0;
+                VEC_STORE(o + i, VEC_OR(VEC_AND(m, VEC_LOAD(b + i)), VEC_ANDNOT(m, v0)));
+            }
+#endif
+            for (; i < len; i++) {
+                if (pp)
+                    thr = k*(pp[i]>>24);
+                o[i] = t[i] < thr ? b[i] : (a ? a[i] : pixval);
+            }
+        }
+    }
+}
+
+static void fade_dither_global_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    dither_rows(job, y0, y1, NULL, job->map0, NULL, job->n[0]*257);
 }
 
 void ARGB_MAP_fade_dither_global(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
                             FLOAT p) {
     p = p < 0.0 ? 0.0 : (p > 1.0 ? 1.0 : p);
-    ARGB_PIXEL pixval = COLOR_to_ARGB_PIXEL(color);
-    INT seed = (engine_run_stats().frames%7) * 1000; //better with lower framerates
-    INT blend = p*255.99;
-    INT r = 0;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        r = LIMIT_255(PRN(seed));
-        out->data[offs] = r < blend ? map->data[offs] : (r == 255 && blend == 255 ? map->data[offs] : pixval);
-    }
+    MAP_JOB job = {.out = out, .map0 = map, .pixval = COLOR_to_ARGB_PIXEL(color),
+        .n = {p*255.99}};
+    dither_offset(&job.dither_x, &job.dither_y);
+    map_graph_rows(fade_dither_global_rows, &job, out->height, 2*out->width*sizeof(ARGB_PIXEL), 0, 0);
 }
 
-void ARGB_MAP_fade_mul_global(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
-                         FLOAT p) {
-    p = p < 0.0 ? 0.0 : (p > 1.0 ? 1.0 : p);
-    ARGB_PIXEL pixval = COLOR_to_ARGB_PIXEL(color);
+static void fade_mul_global_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *map = job->map0;
+    ARGB_PIXEL pixval = job->pixval;
     ARGB_PIXEL r0, g0, b0, r1, g1, b1;
-    INT pfa = p*255.99;
+    INT pfa = job->n[0];
     r0 = ARGB_PIXEL_RED(pixval);
     g0 = ARGB_PIXEL_GREEN(pixval);
     b0 = ARGB_PIXEL_BLUE(pixval);
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pixval = ((ARGB_PIXEL*)map->data)[offs];
-        r1 = ARGB_PIXEL_RED(pixval);
-        g1 = ARGB_PIXEL_GREEN(pixval);
-        b1 = ARGB_PIXEL_BLUE(pixval);
-        out->data[offs] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
-                          (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
-                          (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+#ifdef SIMD_PIXELS
+    VEC v0 = VEC_SET32(pixval);
+#endif
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *map_row = MAP_ROW(map, y);
+        INT x = 0;
+#ifdef SIMD_PIXELS
+        VEC w = VEC_SET16(pfa);
+        for (; x + SIMD_PIXELS <= out->width; x += SIMD_PIXELS)
+            VEC_STORE(out_row + x, vec_blend_mul(v0, VEC_LOAD(map_row + x), w, w));
+#endif
+        for (; x < out->width; x++) {
+            pixval = map_row[x];
+            r1 = ARGB_PIXEL_RED(pixval);
+            g1 = ARGB_PIXEL_GREEN(pixval);
+            b1 = ARGB_PIXEL_BLUE(pixval);
+            out_row[x] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
+                         (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
+                         (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+        }
     }
 }
 
+void ARGB_MAP_fade_mul_global(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
+                         FLOAT p) {
+    p = p < 0.0 ? 0.0 : (p > 1.0 ? 1.0 : p);
+    MAP_JOB job = {.out = out, .map0 = map, .pixval = COLOR_to_ARGB_PIXEL(color), .n = {p*255.99}};
+    map_graph_rows(fade_mul_global_rows, &job, out->height, 2*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void blend_dither_global_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    dither_rows(job, y0, y1, job->map0, job->map1, NULL, job->n[0]*257);
+}
+
 void ARGB_MAP_blend_dither_global(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1,
                              FLOAT p) {
     p = p < 0.0 ? 0.0 : (p > 1.0 ? 1.0 : p);
-    //INT seed = engine_run_stats().frames; //better at full framerate
-    INT seed = (engine_run_stats().frames%7) * 1000; //better with lower framerates
-    INT blend = p*255.99;
-    INT r = 0;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        r = LIMIT_255(PRN(seed));
-        out->data[offs] = (r < blend ? map1 : (r == 255 && blend == 255 ? map1 : map0))->data[offs];
+    MAP_JOB job = {.out = out, .map0 = map0, .map1 = map1,
+        .n = {p*255.99}};
+    dither_offset(&job.dither_x, &job.dither_y);
+    map_graph_rows(blend_dither_global_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void blend_mul_global_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *map0 = job->map0, *map1 = job->map1;
+    ARGB_PIXEL r0, g0, b0, r1, g1, b1, pixval;
+    INT pfa = job->n[0];
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *map0_row = MAP_ROW(map0, y), *map1_row = MAP_ROW(map1, y);
+        INT x = 0;
+#ifdef SIMD_PIXELS
+        VEC w = VEC_SET16(pfa);
+        for (; x + SIMD_PIXELS <= out->width; x += SIMD_PIXELS)
+            VEC_STORE(out_row + x,
+                vec_blend_mul(VEC_LOAD(map0_row + x), VEC_LOAD(map1_row + x), w, w));
+#endif
+        for (; x < out->width; x++) {
+            pixval = map0_row[x];
+            r0 = ARGB_PIXEL_RED(pixval);
+            g0 = ARGB_PIXEL_GREEN(pixval);
+            b0 = ARGB_PIXEL_BLUE(pixval);
+            pixval = map1_row[x];
+            r1 = ARGB_PIXEL_RED(pixval);
+            g1 = ARGB_PIXEL_GREEN(pixval);
+            b1 = ARGB_PIXEL_BLUE(pixval);
+            out_row[x] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
+                         (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
+                         (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+        }
     }
 }
 
 void ARGB_MAP_blend_mul_global(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1,
                           FLOAT p) {
     p = p < 0.0 ? 0.0 : (p > 1.0 ? 1.0 : p);
-    ARGB_PIXEL r0, g0, b0, r1, g1, b1, pixval;
-    INT pfa = p*255.99;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pixval = ((ARGB_PIXEL*)map0->data)[offs];
-        r0 = ARGB_PIXEL_RED(pixval);
-        g0 = ARGB_PIXEL_GREEN(pixval);
-        b0 = ARGB_PIXEL_BLUE(pixval);
-        pixval = ((ARGB_PIXEL*)map1->data)[offs];
-        r1 = ARGB_PIXEL_RED(pixval);
-        g1 = ARGB_PIXEL_GREEN(pixval);
-        b1 = ARGB_PIXEL_BLUE(pixval);
-        out->data[offs] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
-                          (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
-                          (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
-    }
+    MAP_JOB job = {.out = out, .map0 = map0, .map1 = map1, .n = {p*255.99}};
+    map_graph_rows(blend_mul_global_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void fade_dither_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    dither_rows(job, y0, y1, NULL, job->map0, job->p, 257);
 }
 
 void ARGB_MAP_fade_dither_per_pixel(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
                                 ARGB_MAP *p) {
-    ARGB_PIXEL pixval = COLOR_to_ARGB_PIXEL(color), a;
-    INT seed = (engine_run_stats().frames%7) * 1000;
-    INT r = 0;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        r = LIMIT_255(PRN(seed));
-        a = p->data[offs]>>24;
-        out->data[offs] = r < a ? map->data[offs] : (r == 255 && a == 255 ? map->data[offs] : pixval);
-    }
+    MAP_JOB job = {.out = out, .map0 = map, .p = p, .pixval = COLOR_to_ARGB_PIXEL(color)};
+    dither_offset(&job.dither_x, &job.dither_y);
+    map_graph_rows(fade_dither_per_pixel_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL), 0, 0);
 }
 
-void ARGB_MAP_fade_mul_per_pixel(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
-                             ARGB_MAP *p) {
-    ARGB_PIXEL pixval = COLOR_to_ARGB_PIXEL(color);
+static void fade_mul_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *map = job->map0, *p = job->p;
+    ARGB_PIXEL pixval = job->pixval;
     ARGB_PIXEL r0, g0, b0, r1, g1, b1, pfa;
     r0 = ARGB_PIXEL_RED(pixval);
     g0 = ARGB_PIXEL_GREEN(pixval);
     b0 = ARGB_PIXEL_BLUE(pixval);
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pfa = ARGB_PIXEL_ALPHA( ((ARGB_PIXEL*)p->data)[offs] );
-        pixval = ((ARGB_PIXEL*)map->data)[offs];
-        r1 = ARGB_PIXEL_RED(pixval);
-        g1 = ARGB_PIXEL_GREEN(pixval);
-        b1 = ARGB_PIXEL_BLUE(pixval);
-        out->data[offs] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
-                          (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
-                          (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+#ifdef SIMD_PIXELS
+    VEC v0 = VEC_SET32(pixval);
+#endif
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *map_row = MAP_ROW(map, y), *p_row = MAP_ROW(p, y);
+        INT x = 0;
+#ifdef SIMD_PIXELS
+        VEC w_lo, w_hi;
+        for (; x + SIMD_PIXELS <= out->width; x += SIMD_PIXELS) {
+            VEC_ALPHA_WEIGHTS(VEC_LOAD(p_row + x), w_lo, w_hi);
+            VEC_STORE(out_row + x, vec_blend_mul(v0, VEC_LOAD(map_row + x), w_lo, w_hi));
+        }
+#endif
+        for (; x < out->width; x++) {
+            pfa = ARGB_PIXEL_ALPHA( p_row[x] );
+            pixval = map_row[x];
+            r1 = ARGB_PIXEL_RED(pixval);
+            g1 = ARGB_PIXEL_GREEN(pixval);
+            b1 = ARGB_PIXEL_BLUE(pixval);
+            out_row[x] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
+                         (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
+                         (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+        }
     }
 }
 
+void ARGB_MAP_fade_mul_per_pixel(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
+                             ARGB_MAP *p) {
+    MAP_JOB job = {.out = out, .map0 = map, .p = p, .pixval = COLOR_to_ARGB_PIXEL(color)};
+    map_graph_rows(fade_mul_per_pixel_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void blend_dither_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    dither_rows(job, y0, y1, job->map0, job->map1, job->p, 257);
+}
+
 void ARGB_MAP_blend_dither_per_pixel(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1,
                                  ARGB_MAP *p) {
-    ARGB_PIXEL a;
-    //INT seed = engine_run_stats().frames; //better at full framerate
-    INT seed = (engine_run_stats().frames%7) * 1000; //better with lower framerates
-    INT r = 0;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        a = p->data[offs]>>24;
-        r = LIMIT_255(PRN(seed));
-        out->data[offs] = (r < a ? map1 : (r == 255 && a == 255 ? map1 : map0))->data[offs];
+    MAP_JOB job = {.out = out, .map0 = map0, .map1 = map1, .p = p};
+    dither_offset(&job.dither_x, &job.dither_y);
+    map_graph_rows(blend_dither_per_pixel_rows, &job, out->height, 4*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void blend_mul_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *map0 = job->map0, *map1 = job->map1, *p = job->p;
+    ARGB_PIXEL r0, g0, b0, r1, g1, b1, pfa, pixval;
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *map0_row = MAP_ROW(map0, y), *map1_row = MAP_ROW(map1, y), *p_row = MAP_ROW(p, y);
+        INT x = 0;
+#ifdef SIMD_PIXELS
+        VEC w_lo, w_hi;
+        for (; x + SIMD_PIXELS <= out->width; x += SIMD_PIXELS) {
+            VEC_ALPHA_WEIGHTS(VEC_LOAD(p_row + x), w_lo, w_hi);
+            VEC_STORE(out_row + x,
+                vec_blend_mul(VEC_LOAD(map0_row + x), VEC_LOAD(map1_row + x), w_lo, w_hi));
+        }
+#endif
+        for (; x < out->width; x++) {
+            pfa = ARGB_PIXEL_ALPHA( p_row[x] );
+            pixval = map0_row[x];
+            r0 = ARGB_PIXEL_RED(pixval);
+            g0 = ARGB_PIXEL_GREEN(pixval);
+            b0 = ARGB_PIXEL_BLUE(pixval);
+            pixval = map1_row[x];
+            r1 = ARGB_PIXEL_RED(pixval);
+            g1 = ARGB_PIXEL_GREEN(pixval);
+            b1 = ARGB_PIXEL_BLUE(pixval);
+            out_row[x] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
+                         (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
+                         (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+        }
     }
 }
 
 void ARGB_MAP_blend_mul_per_pixel(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1,
                               ARGB_MAP *p) {
-    ARGB_PIXEL r0, g0, b0, r1, g1, b1, pfa, pixval;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pfa = ARGB_PIXEL_ALPHA( ((ARGB_PIXEL*)p->data)[offs] );
-        pixval = ((ARGB_PIXEL*)map0->data)[offs];
-        r0 = ARGB_PIXEL_RED(pixval);
-        g0 = ARGB_PIXEL_GREEN(pixval);
-        b0 = ARGB_PIXEL_BLUE(pixval);
-        pixval = ((ARGB_PIXEL*)map1->data)[offs];
-        r1 = ARGB_PIXEL_RED(pixval);
-        g1 = ARGB_PIXEL_GREEN(pixval);
-        b1 = ARGB_PIXEL_BLUE(pixval);
-        out->data[offs] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
-                          (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
-                          (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
-    }
+    MAP_JOB job = {.out = out, .map0 = map0, .map1 = map1, .p = p};
+    map_graph_rows(blend_mul_per_pixel_rows, &job, out->height, 4*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void fade_dither_f_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    dither_rows(job, y0, y1, NULL, job->map0, job->p, job->n[0]);
 }
 
 void ARGB_MAP_fade_dither_f_per_pixel(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
                                   FLOAT f, ARGB_MAP *p) {
-    ARGB_PIXEL pixval = COLOR_to_ARGB_PIXEL(color);
-    INT ff = f*257.99; //fixed-point f
-    INT pfa = 0; //f*p[pixel]
-    INT seed = (engine_run_stats().frames%7) * 1000;
-    INT r = 0;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pfa = ff*(p->data[offs]>>24);
-        r = LIMIT_65535(PRN(seed));
-        out->data[offs] = r < pfa ? map->data[offs] : (r == 65535 && pfa == 65535 ? map->data[offs] : pixval);
-    }
+    f = f < 0.0 ? 0.0 : (f > 1.0 ? 1.0 : f);
+    MAP_JOB job = {.out = out, .map0 = map, .p = p, .pixval = COLOR_to_ARGB_PIXEL(color),
+        .n = {f*257.99}};
+    dither_offset(&job.dither_x, &job.dither_y);
+    map_graph_rows(fade_dither_f_per_pixel_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL), 0, 0);
 }
 
-void ARGB_MAP_fade_mul_f_per_pixel(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
-                               FLOAT f, ARGB_MAP *p) {
-    ARGB_PIXEL pixval = COLOR_to_ARGB_PIXEL(color);
+static void fade_mul_f_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *map = job->map0, *p = job->p;
+    ARGB_PIXEL pixval = job->pixval;
     ARGB_PIXEL r0, g0, b0, r1, g1, b1;
-    INT ff = f*257.99; //fixed-point f
+    INT ff = job->n[0]; //fixed-point f
     INT pfa = 0; //f*p[pixel]
     r0 = ARGB_PIXEL_RED(pixval);
     g0 = ARGB_PIXEL_GREEN(pixval);
     b0 = ARGB_PIXEL_BLUE(pixval);
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pfa = ff*ARGB_PIXEL_ALPHA( ((ARGB_PIXEL*)p->data)[offs] ) >> 8;
-        pixval = ((ARGB_PIXEL*)map->data)[offs];
-        r1 = ARGB_PIXEL_RED(pixval);
-        g1 = ARGB_PIXEL_GREEN(pixval);
-        b1 = ARGB_PIXEL_BLUE(pixval);
-        out->data[offs] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
-                          (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
-                          (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+#ifdef SIMD_PIXELS
+    VEC v0 = VEC_SET32(pixval);
+#endif
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *map_row = MAP_ROW(map, y), *p_row = MAP_ROW(p, y);
+        INT x = 0;
+#ifdef SIMD_PIXELS
+        // Vector path only for f in 0..1, where f*p[pixel] fits in 16 bit lanes
+        VEC vf = VEC_SET16(ff), w_lo, w_hi;
+        for (; ff >= 0 && ff <= 257 && x + SIMD_PIXELS <= out->width; x += SIMD_PIXELS) {
+            VEC_ALPHA_WEIGHTS(VEC_LOAD(p_row + x), w_lo, w_hi);
+            w_lo = VEC_SRL16(VEC_MUL16(w_lo, vf), 8);
+            w_hi = VEC_SRL16(VEC_MUL16(w_hi, vf), 8);
+            VEC_STORE(out_row + x, vec_blend_mul(v0, VEC_LOAD(map_row + x), w_lo, w_hi));
+        }
+#endif
+        for (; x < out->width; x++) {
+            pfa = ff*ARGB_PIXEL_ALPHA( p_row[x] ) >> 8;
+            pixval = map_row[x];
+            r1 = ARGB_PIXEL_RED(pixval);
+            g1 = ARGB_PIXEL_GREEN(pixval);
+            b1 = ARGB_PIXEL_BLUE(pixval);
+            out_row[x] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
+                         (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
+                         (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+        }
     }
 }
 
+void ARGB_MAP_fade_mul_f_per_pixel(ARGB_MAP *out, COLOR* color, ARGB_MAP *map,
+                               FLOAT f, ARGB_MAP *p) {
+    MAP_JOB job = {.out = out, .map0 = map, .p = p, .pixval = COLOR_to_ARGB_PIXEL(color), .n = {f*257.99}};
+    map_graph_rows(fade_mul_f_per_pixel_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void blend_dither_f_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    dither_rows(job, y0, y1, job->map0, job->map1, job->p, job->n[0]);
+}
+
 void ARGB_MAP_blend_dither_f_per_pixel(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1,
                                    FLOAT f, ARGB_MAP *p) {
-    INT ff = f*257.99; //fixed-point f
+    f = f < 0.0 ? 0.0 : (f > 1.0 ? 1.0 : f);
+    MAP_JOB job = {.out = out, .map0 = map0, .map1 = map1, .p = p,
+        .n = {f*257.99}};
+    dither_offset(&job.dither_x, &job.dither_y);
+    map_graph_rows(blend_dither_f_per_pixel_rows, &job, out->height, 4*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void blend_mul_f_per_pixel_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *map0 = job->map0, *map1 = job->map1, *p = job->p;
+    INT ff = job->n[0]; //fixed-point f
     INT pfa = 0; //f*p[pixel]
-    //INT seed = engine_run_stats().frames; //better at full framerate
-    INT seed = (engine_run_stats().frames%7) * 1000; //better with lower framerates
-    INT r = 0;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pfa = ff*(p->data[offs]>>24);
-        r = LIMIT_65535(PRN(seed));
-        out->data[offs] = (r < pfa ? map1 : (r == 65535 && pfa == 65535 ? map1 : map0))->data[offs];
+    ARGB_PIXEL r0, g0, b0, r1, g1, b1, pixval;
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *map0_row = MAP_ROW(map0, y), *map1_row = MAP_ROW(map1, y), *p_row = MAP_ROW(p, y);
+        INT x = 0;
+#ifdef SIMD_PIXELS
+        // Vector path only for f in 0..1, where f*p[pixel] fits in 16 bit lanes
+        VEC vf = VEC_SET16(ff), w_lo, w_hi;
+        for (; ff >= 0 && ff <= 257 && x + SIMD_PIXELS <= out->width; x += SIMD_PIXELS) {
+            VEC_ALPHA_WEIGHTS(VEC_LOAD(p_row + x), w_lo, w_hi);
+            w_lo = VEC_SRL16(VEC_MUL16(w_lo, vf), 8);
+            w_hi = VEC_SRL16(VEC_MUL16(w_hi, vf), 8);
+            VEC_STORE(out_row + x,
+                vec_blend_mul(VEC_LOAD(map0_row + x), VEC_LOAD(map1_row + x), w_lo, w_hi));
+        }
+#endif
+        for (; x < out->width; x++) {
+            pfa = ff*ARGB_PIXEL_ALPHA( p_row[x] ) >> 8;
+            pixval = map0_row[x];
+            r0 = ARGB_PIXEL_RED(pixval);
+            g0 = ARGB_PIXEL_GREEN(pixval);
+            b0 = ARGB_PIXEL_BLUE(pixval);
+            pixval = map1_row[x];
+            r1 = ARGB_PIXEL_RED(pixval);
+            g1 = ARGB_PIXEL_GREEN(pixval);
+            b1 = ARGB_PIXEL_BLUE(pixval);
+            out_row[x] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
+                         (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
+                         (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+        }
     }
 }
 
 void ARGB_MAP_blend_mul_f_per_pixel(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1,
                                 FLOAT f, ARGB_MAP *p) {
-    INT ff = f*257.99; //fixed-point f
-    INT pfa = 0; //f*p[pixel]
-    ARGB_PIXEL r0, g0, b0, r1, g1, b1, pixval;
-    for (INT offs = 0; offs < out->height*out->width; offs++) {
-        pfa = ff*ARGB_PIXEL_ALPHA( ((ARGB_PIXEL*)p->data)[offs] ) >> 8;
-        pixval = ((ARGB_PIXEL*)map0->data)[offs];
-        r0 = ARGB_PIXEL_RED(pixval);
-        g0 = ARGB_PIXEL_GREEN(pixval);
-        b0 = ARGB_PIXEL_BLUE(pixval);
-        pixval = ((ARGB_PIXEL*)map1->data)[offs];
-        r1 = ARGB_PIXEL_RED(pixval);
-        g1 = ARGB_PIXEL_GREEN(pixval);
-        b1 = ARGB_PIXEL_BLUE(pixval);
-        out->data[offs] = (((r1*pfa + r0*(255-pfa)) >> 8) << R_SHIFT) |
-                          (((g1*pfa + g0*(255-pfa)) >> 8) << G_SHIFT) |
-                          (((b1*pfa + b0*(255-pfa)) >> 8) << B_SHIFT);
+    MAP_JOB job = {.out = out, .map0 = map0, .map1 = map1, .p = p, .n = {f*257.99}};
+    map_graph_rows(blend_mul_f_per_pixel_rows, &job, out->height, 4*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void sat_add_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *map0 = job->map0, *map1 = job->map1;
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *map0_row = MAP_ROW(map0, y), *map1_row = MAP_ROW(map1, y);
+        INT x = 0;
+        ARGB_PIXEL sum, carry;
+#ifdef SIMD_PIXELS
+        VEC vsum, vcarry, vmask = VEC_SET32(0x00FEFEFF), vcarry_mask = VEC_SET32(0x01010100);
+        for (; x + SIMD_PIXELS <= map0->width; x += SIMD_PIXELS) {
+            vsum = VEC_ADD32(VEC_AND(VEC_LOAD(map0_row + x), vmask), VEC_AND(VEC_LOAD(map1_row + x), vmask));
+            vcarry = VEC_AND(vsum, vcarry_mask);
+            VEC_STORE(out_row + x, VEC_OR(vsum, VEC_SUB32(vcarry, VEC_SRL32(vcarry, 8))));
+        }
+#endif
+        for (; x < map0->width; x++) {
+            /** Add all components */
+            sum = (map0_row[x]&0x00FEFEFF) + (map1_row[x]&0x00FEFEFF);
+            /** Saturate sums of each component: every carry bit c above a component
+             *  turns into c*0xFF mask over that component */
+            carry = sum & 0x01010100;
+            sum |= carry - (carry >> 8);
+            out_row[x] = sum;
+        }
     }
 }
 
@@ -291,53 +858,108 @@ void ARGB_MAP_blend_mul_f_per_pixel(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map
  * Buffers have to have same dimensions.
  */
 void ARGB_MAP_sat_add(ARGB_MAP *out, ARGB_MAP *map0, ARGB_MAP *map1) {
-    INT offs; /** Offset for traversing buffers*/
-    ARGB_PIXEL sum;
     if (map0->width != map1->width || map0->height != map1->height) {
         return;
     }
-    for (offs = 0; offs < map0->width * map0->height; offs++) {
-        /** Add all components */
-        sum = (map0->data[offs]&0x00FEFEFF) + (map1->data[offs]&0x00FEFEFF);
-        /** Saturate sums of each component */
-        if (sum & 0x01000000) {
-            if (sum & 0x00010000) {
-                if (sum & 0x00000100) {
-                    sum |= 0x00FFFFFF;
-                }
-                else {
-                    sum |= 0x00FFFF00;
-                }
-            }
-            else {
-                if (sum & 0x00000100) {
-                    sum |= 0x00FF00FF;
-                }
-                else {
-                    sum |= 0x00FF0000;
-                }
-            }
+    MAP_JOB job = {.out = out, .map0 = map0, .map1 = map1};
+    map_graph_rows(sat_add_rows, &job, map0->height, 3*map0->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+/*
+ Premultiplied alpha maps: color channels are stored multiplied by alpha (c*a/255, rounded),
+ alpha is kept. Blends of premultiplied foregrounds are a single "over" operation per pixel:
+ out = fg + bg*(255-a), see blend_premultiplied() in simd.h.
+*/
+static void premultiply_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *in = job->map0;
+    ARGB_PIXEL pixval, a, t;
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *in_row = MAP_ROW(in, y);
+        INT x = 0;
+#ifdef SIMD_PIXELS
+        VEC v, w_lo, w_hi, lo, hi, r128 = VEC_SET16(128);
+        for (; x + SIMD_PIXELS <= out->width; x += SIMD_PIXELS) {
+            v = VEC_LOAD(in_row + x);
+            VEC_ALPHA_WEIGHTS(v, w_lo, w_hi);
+            //(t + (t >> 8)) >> 8 with t = c*a + 128 is c*a/255 rounded, t fits in 16 bits
+            lo = VEC_ADD16(VEC_MUL16(VEC_UNPACK_LO(v), w_lo), r128);
+            hi = VEC_ADD16(VEC_MUL16(VEC_UNPACK_HI(v), w_hi), r128);
+            lo = VEC_SRL16(VEC_ADD16(lo, VEC_SRL16(lo, 8)), 8);
+            hi = VEC_SRL16(VEC_ADD16(hi, VEC_SRL16(hi, 8)), 8);
+            VEC_STORE(out_row + x, VEC_OR(VEC_AND(VEC_PACK(lo, hi), VEC_SET32(0x00FFFFFF)),
+                                          VEC_AND(v, VEC_SET32(0xFF000000))));
         }
-        else {
-            if (sum & 0x00010000) {
-                if (sum & 0x00000100) {
-                    sum |= 0x0000FFFF;
-                }
-                else {
-                    sum |= 0x0000FF00;
-                }
-            }
-            else {
-                if (sum & 0x00000100) {
-                    sum |= B_MASK;
-                }
-                // else do nothing (no saturation at any component)
-            }
+#endif
+        for (; x < out->width; x++) {
+            pixval = in_row[x];
+            a = ARGB_PIXEL_ALPHA(pixval);
+            out_row[x] = pixval & 0xFF000000;
+            t = ARGB_PIXEL_RED(pixval)*a + 128;    out_row[x] |= ((t + (t >> 8)) >> 8) << R_SHIFT;
+            t = ARGB_PIXEL_GREEN(pixval)*a + 128;  out_row[x] |= ((t + (t >> 8)) >> 8) << G_SHIFT;
+            t = ARGB_PIXEL_BLUE(pixval)*a + 128;   out_row[x] |= ((t + (t >> 8)) >> 8) << B_SHIFT;
         }
-        ((ARGB_PIXEL*)(out->data))[offs] = sum;
     }
 }
 
+/*
+ Convert straight alpha map in to premultiplied alpha map out (may be the same map).
+*/
+void ARGB_MAP_premultiply(ARGB_MAP *out, ARGB_MAP *in) {
+    if (out->width != in->width || out->height != in->height)
+        return;
+    out->premultiplied = true;
+    MAP_JOB job = {.out = out, .map0 = in};
+    map_graph_rows(premultiply_rows, &job, out->height, 2*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
+static void unpremultiply_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *in = job->map0;
+    const UINT *inv = job->data;
+    ARGB_PIXEL pixval, a, c;
+    for (INT y = y0; y < y1; y++) {
+        ARGB_PIXEL *out_row = MAP_ROW(out, y), *in_row = MAP_ROW(in, y);
+        for (INT x = 0; x < out->width; x++) {
+            pixval = in_row[x];
+            a = ARGB_PIXEL_ALPHA(pixval);
+            out_row[x] = pixval & 0xFF000000;
+            c = (ARGB_PIXEL_RED(pixval)*inv[a] + 0x8000) >> 16;      out_row[x] |= (c > 255 ? 255 : c) << R_SHIFT;
+            c = (ARGB_PIXEL_GREEN(pixval)*inv[a] + 0x8000) >> 16;    out_row[x] |= (c > 255 ? 255 : c) << G_SHIFT;
+            c = (ARGB_PIXEL_BLUE(pixval)*inv[a] + 0x8000) >> 16;     out_row[x] |= (c > 255 ? 255 : c) << B_SHIFT;
+        }
+    }
+}
+
+/*
+ Convert premultiplied alpha map in to straight alpha map out (may be the same map).
+ Color of pixels with alpha 0 is lost (set to 0).
+*/
+void ARGB_MAP_unpremultiply(ARGB_MAP *out, ARGB_MAP *in) {
+    UINT inv[256]; //255/a in 16.16 fixed point
+    if (out->width != in->width || out->height != in->height)
+        return;
+    inv[0] = 0;
+    for (INT a = 1; a < 256; a++)
+        inv[a] = ((255 << 16) + a/2)/a;
+    out->premultiplied = false;
+    MAP_JOB job = {.out = out, .map0 = in, .data = inv};
+    map_graph_rows(unpremultiply_rows, &job, out->height, 2*out->width*sizeof(ARGB_PIXEL), 0, sizeof(inv));
+}
+
+static void blend_premultiplied_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    for (INT y = y0; y < y1; y++)
+        blend_premultiplied_row(MAP_ROW(job->out, y), MAP_ROW(job->map0, y), MAP_ROW(job->map1, y), job->out->width);
+}
+
+/*
+ Blend premultiplied alpha map fg over bg: out = fg + bg*(255 - fg alpha). Alpha channel of out is cleared.
+*/
+void ARGB_MAP_blend_premultiplied(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg) {
+    if (out->width != bg->width || out->height != bg->height || out->width != fg->width || out->height != fg->height)
+        return;
+    MAP_JOB job = {.out = out, .map0 = bg, .map1 = fg};
+    map_graph_rows(blend_premultiplied_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL), 0, 0);
+}
+
 ARGB_MAP *ARGB_MAP_read_image(const char * const map_filename, INT u_wrap_margin) {
     if (map_filename == NULL)
         return NULL;
@@ -371,7 +993,8 @@ ARGB_MAP *ARGB_MAP_read_image(const char * const map_filename, INT u_wrap_margin
     ARGB_MAP *map = ARGB_MAP_alloc(w, h, u_wrap_margin);
     for (INT y = 0; y < h; y++)
         for (INT x = 0; x < w; x++)
-            map->data[w*y + x] = ((ARGB_PIXEL*)(map_surface->pixels + pitch * (y%w)))[x];
+            MAP_ROW(map, y)[x] = ((ARGB_PIXEL*)(map_surface->pixels + pitch * (y%w)))[x];
+    ARGB_MAP_build_mipmaps(map);
 
     SDL_FreeSurface(map_surface);
     SDL_FreeSurface(image_surface);
@@ -386,8 +1009,8 @@ BUMP_MAP *BUMP_MAP_from_ARGB_MAP(ARGB_MAP* in_map, FLOAT margin) {
     bump_map->margin = margin;
     for (INT y = 0; y < h; y++) {
         for (INT x = 0; x < w; x++) {
-            dlx = (ARGB_PIXEL_to_l(in_map->data[w*y + (x+2)%w]) - ARGB_PIXEL_to_l(in_map->data[w*y + x]));
-            dly = (ARGB_PIXEL_to_l(in_map->data[w*((y+2)%h) + x]) - ARGB_PIXEL_to_l(in_map->data[w*y + x]));
+            dlx = (ARGB_PIXEL_to_l(MAP_ROW(in_map, y)[(x+2)%w]) - ARGB_PIXEL_to_l(MAP_ROW(in_map, y)[x]));
+            dly = (ARGB_PIXEL_to_l(MAP_ROW(in_map, (y+2)%h)[x]) - ARGB_PIXEL_to_l(MAP_ROW(in_map, y)[x]));
             if (dl_max < dlx) dl_max = dlx;
             if (dl_max < dly) dl_max = dly;
         }
@@ -397,8 +1020,8 @@ BUMP_MAP *BUMP_MAP_from_ARGB_MAP(ARGB_MAP* in_map, FLOAT margin) {
 
     for (INT y = 0; y < h; y++) {
         for (INT x = 0; x < w; x++) {
-            dlx = (ARGB_PIXEL_to_l(in_map->data[w*y + (x+2)%w]) - ARGB_PIXEL_to_l(in_map->data[w*y + x]));
-            dly = (ARGB_PIXEL_to_l(in_map->data[w*((y+2)%h) + x]) - ARGB_PIXEL_to_l(in_map->data[w*y + x]));
+            dlx = (ARGB_PIXEL_to_l(MAP_ROW(in_map, y)[(x+2)%w]) - ARGB_PIXEL_to_l(MAP_ROW(in_map, y)[x]));
+            dly = (ARGB_PIXEL_to_l(MAP_ROW(in_map, (y+2)%h)[x]) - ARGB_PIXEL_to_l(MAP_ROW(in_map, y)[x]));
 
             bump_map->data[w*y + x] = (((BUMP_PIXEL)(dly*dl_scale)<<16)&0xFFFF0000) | ((BUMP_PIXEL)(dlx*dl_scale)&0x0000FFFF);
         }
@@ -407,10 +1030,96 @@ BUMP_MAP *BUMP_MAP_from_ARGB_MAP(ARGB_MAP* in_map, FLOAT margin) {
 }
 
 
+/*
+ Build mipmap chain of the map. Every next level has half width and height of the previous one.
+ Level pixels are 2x2 averages of the previous level pixels. Wrap margin is halved (rounding up)
+ on every level, so map coordinates scaled down to the level always stay inside of it.
+ Needs to be called again after map contents change. Not available for tiled maps.
+*/
+void ARGB_MAP_build_mipmaps(ARGB_MAP *map) {
+    if (map == NULL || map->tiled)
+        return;
+    map_graph_flush(); //level 0 may be written by deferred operations
+    ARGB_MAP_free(map->mip);
+    map->mip = NULL;
+
+    ARGB_MAP *src = map, *dst = NULL;
+    INT margin = map->height_with_margin - map->height;
+    ARGB_PIXEL *s0, *s1, p0, p1, p2, p3;
+    while (src->width > 1 && src->height > 1) {
+        margin = (margin + 1)/2;
+        dst = ARGB_MAP_alloc(src->width/2, src->height/2 + margin, margin);
+        for (INT y = 0; y < dst->height_with_margin; y++) {
+            //Margin rows repeat the top rows of the level
+            s0 = MAP_ROW(src, 2*(y%dst->height));
+            s1 = s0 + src->stride;
+            for (INT x = 0; x < dst->width; x++) {
+                p0 = s0[2*x];    p1 = s0[2*x+1];
+                p2 = s1[2*x];    p3 = s1[2*x+1];
+                MAP_ROW(dst, y)[x] =
+                    ((ARGB_PIXEL_ALPHA(p0) + ARGB_PIXEL_ALPHA(p1) + ARGB_PIXEL_ALPHA(p2) + ARGB_PIXEL_ALPHA(p3) + 2) >> 2) << A_SHIFT |
+                    ((ARGB_PIXEL_RED(p0) + ARGB_PIXEL_RED(p1) + ARGB_PIXEL_RED(p2) + ARGB_PIXEL_RED(p3) + 2) >> 2) << R_SHIFT |
+                    ((ARGB_PIXEL_GREEN(p0) + ARGB_PIXEL_GREEN(p1) + ARGB_PIXEL_GREEN(p2) + ARGB_PIXEL_GREEN(p3) + 2) >> 2) << G_SHIFT |
+                    ((ARGB_PIXEL_BLUE(p0) + ARGB_PIXEL_BLUE(p1) + ARGB_PIXEL_BLUE(p2) + ARGB_PIXEL_BLUE(p3) + 2) >> 2) << B_SHIFT;
+            }
+        }
+        src->mip = dst;
+        src = dst;
+    }
+}
+
+/*
+ Convert map (with all its mipmap levels) to the tiled layout.
+ Tiles of MAP_TILE_SIZE x MAP_TILE_SIZE pixels are stored row by row, pixels inside
+ of the tile are stored row by row too. This way texture mapping along any direction
+ stays inside of a few cache lines.
+ Map width has to be a power of 2 and at least MAP_TILE_SIZE. Mipmap levels narrower
+ than MAP_TILE_SIZE are removed. Rows are padded to the tile size (wrapping the map).
+ Tiled maps are meant to be used only as base maps for texture mapping.
+*/
+void ARGB_MAP_tile(ARGB_MAP *map) {
+    if (map == NULL || map->tiled || map->width < MAP_TILE_SIZE || (map->width & (map->width-1)))
+        return;
+    map_graph_flush(); //map may be used by deferred operations
+
+    ARGB_MAP *level = map;
+    ARGB_PIXEL *data = NULL;
+    void *storage = NULL;
+    INT rows, row_shift, src_y;
+    while (level != NULL) {
+        rows = (level->height_with_margin + MAP_TILE_MASK) & ~MAP_TILE_MASK;
+        row_shift = 0;
+        while ((1 << row_shift) < level->width)
+            row_shift++;
+        data = aligned_calloc((size_t)level->width*rows*sizeof(ARGB_PIXEL), &storage);
+        for (INT y = 0; y < rows; y++) {
+            src_y = y < level->height_with_margin ? y : y%level->height;
+            for (INT x = 0; x < level->width; x++) {
+                data[MAP_TILED_INDEX(x, y, row_shift)] = MAP_ROW(level, src_y)[x];
+            }
+        }
+        free(level->storage);
+        level->data = data;
+        level->storage = storage;
+        level->stride = level->width;
+        level->tiled = true;
+        if (level->mip != NULL && level->mip->width < MAP_TILE_SIZE) {
+            ARGB_MAP_free(level->mip);
+            level->mip = NULL;
+        }
+        level = level->mip;
+    }
+}
+
 void ARGB_MAP_free(ARGB_MAP* map) {
     if (map != NULL) {
-        if (map->data != NULL) {
-            free(map->data);
+        map_graph_flush(); //map may be used by deferred operations
+        ARGB_MAP_free(map->mip);
+        if (map->storage != NULL) {
+            free(map->storage);
+        }
+        if (map->dirty != NULL) {
+            free(map->dirty);
         }
         free(map);
     }
@@ -427,8 +1136,12 @@ void BUMP_MAP_free(BUMP_MAP* map) {
 
 void Z_MAP_free(Z_MAP* map) {
     if (map != NULL) {
-        if (map->data != NULL) {
-            free(map->data);
+        map_graph_flush(); //map may be used by deferred operations
+        if (map->storage != NULL) {
+            free(map->storage);
+        }
+        if (map->tile_max != NULL) {
+            free(map->tile_max);
         }
         free(map);
     }
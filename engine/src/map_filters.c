@@ -15,494 +15,570 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "engine.h"
+#include "simd.h"
 
-INT *map_filter_buffer = NULL;
+//Scratch buffer size of one worker [INT elements]
+#define MAP_FILTER_BUFFER_SIZE (100000)
+//Width of column strips processed by workers in vertical filters [pixels]
+#define MAP_FILTER_STRIP_WIDTH (64)
+//Vertical blurs with narrower strips (less than a cache line per row) run as horizontal passes of transposed maps [pixels]
+#define MAP_FILTER_MIN_STRIP_WIDTH (16)
+
+INT *map_filter_buffer = NULL; //scratch buffers of all workers, see WORKER_BUFFER()
+INT *map_filter_row_buffer = NULL; //per row tables prepared before parallel execution
 DISCRETE_GRADIENT *map_filter_dg = NULL;
 
+//Scratch buffer of worker w
+#define WORKER_BUFFER(w) (map_filter_buffer + (w)*MAP_FILTER_BUFFER_SIZE)
+
 void map_filters_init() {
-    map_filter_buffer = calloc(100000, sizeof(INT));
+    map_filter_buffer = calloc(parallel_workers()*MAP_FILTER_BUFFER_SIZE, sizeof(INT));
+    map_filter_row_buffer = calloc(MAP_FILTER_BUFFER_SIZE, sizeof(INT));
     map_filter_dg = DISCRETE_GRADIENT_alloc(1024);
 }
 
 void map_filters_cleanup() {
     free(map_filter_buffer);
+    free(map_filter_row_buffer);
     DISCRETE_GRADIENT_free(map_filter_dg);
 }
 
-void ARGB_MAP_green_gradient_global_copy(ARGB_MAP *out, ARGB_MAP *in, GRADIENT *g, const INT p) {
-    INT x=0, y=0, offs=0;
+/*
+ Filters are executed in row bands (see parallel_rows()), out map must be different from input maps.
+ Bands of edge filters read halo rows below the band from the input map.
+ Vertical blurs are executed in column strips of up to MAP_FILTER_STRIP_WIDTH pixels instead,
+ so running column sums need no halo.
+ Row band filters may be deferred (see map_graph_rows()), column strip and block row filters
+ execute deferred operations first and mark the whole out map dirty.
+*/
+static void green_gradient_global_copy_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    const ARGB_PIXEL *pixval_tab = job->data;
+    ARGB_MAP *out = job->out, *in = job->map0;
+    const INT p = job->n[0];
+    INT x=0, y=0;
+    ARGB_PIXEL *in_row, *out_row;
     INT l00, l01, l10, dl;
 
-    map_filter_dg->length = 511;
-    DISCRETE_GRADIENT_from_GRADIENT(map_filter_dg, g);
-    if (out->height != in->height || out->width != in->width)
-        return;
-
-    for(y=0, offs=0; y < in->height-p; y++) {
-        for(x=0; x < in->width-p; x++, offs++) {
-            l00 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs]);
-            l10 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+p]);
-            l01 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+p*in->width]);
+    for(y=y0; y < y1 && y < in->height-p; y++) {
+        in_row = MAP_ROW(in, y);
+        out_row = MAP_ROW(out, y);
+        for(x=0; x < in->width-p; x++) {
+            l00 = ARGB_PIXEL_GREEN(in_row[x]);
+            l10 = ARGB_PIXEL_GREEN(in_row[x+p]);
+            l01 = ARGB_PIXEL_GREEN(in_row[x+p*in->stride]);
 
             dl = l10 + l01 - 2*l00;
             if (dl < 0) dl = -dl;
-            ((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[dl];
+            out_row[x] = pixval_tab[dl];
         }
-        for(; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[0];
+        for(; x < in->width; x++) {
+            out_row[x] = pixval_tab[0];
         }
     }
-    for(; y < in->height; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[0];
+    for(; y < y1; y++) {
+        out_row = MAP_ROW(out, y);
+        for(x = 0; x < in->width; x++) {
+            out_row[x] = pixval_tab[0];
         }
     }
 }
 
-void ARGB_MAP_green_gradient_global_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, GRADIENT *g, const INT p) {
-    INT x=0, y=0, offs=0;
-    INT l00, l01, l10, dl;
-    ARGB_PIXEL Ae, Rf, Gf, Bf, Rb, Gb, Bb, pixval;
-
+void ARGB_MAP_green_gradient_global_copy(ARGB_MAP *out, ARGB_MAP *in, GRADIENT *g, const INT p) {
     map_filter_dg->length = 511;
     DISCRETE_GRADIENT_from_GRADIENT(map_filter_dg, g);
-    if (out->height != bg->height || out->width != bg->width || out->height != in->height || out->width != in->width) {
+    if (out->height != in->height || out->width != in->width)
         return;
-    }
 
-    for(y=0, offs=0; y < in->height-p; y++) {
-        for(x=0; x < in->width-p; x++, offs++) {
-            l00 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs]);
-            l10 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+p]);
-            l01 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+p*in->width]);
+    MAP_JOB job = {.out = out, .map0 = in, .n = {p}, .data = map_filter_dg->pixval};
+    map_graph_rows(green_gradient_global_copy_rows, &job, in->height, 2*in->width*sizeof(ARGB_PIXEL),
+        p, map_filter_dg->length*sizeof(ARGB_PIXEL));
+}
+
+static void green_gradient_global_blend_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    const ARGB_PIXEL *pixval_tab = job->data; //premultiplied gradient
+    ARGB_MAP *out = job->out, *bg = job->map0, *in = job->map1;
+    const INT p = job->n[0];
+    INT x=0, y=0;
+    ARGB_PIXEL *in_row, *bg_row, *out_row;
+    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)WORKER_BUFFER(worker);
+    INT l00, l01, l10, dl;
+
+    for(y=y0; y < y1 && y < in->height-p; y++) {
+        in_row = MAP_ROW(in, y);
+        bg_row = MAP_ROW(bg, y);
+        out_row = MAP_ROW(out, y);
+        for(x=0; x < in->width-p; x++) {
+            l00 = ARGB_PIXEL_GREEN(in_row[x]);
+            l10 = ARGB_PIXEL_GREEN(in_row[x+p]);
+            l01 = ARGB_PIXEL_GREEN(in_row[x+p*in->stride]);
 
             dl = l10 + l01 - 2*l00; //TODO: should the discrete gradient used be 512 elements long?
             if (dl < 0) dl = -dl;
-
-            pixval = map_filter_dg->pixval[dl];
-            Ae = ARGB_PIXEL_ALPHA(pixval);
-            if (Ae > 0) {
-                Rf = (ARGB_PIXEL_RED(pixval)*Ae >> 8) << R_SHIFT;
-                Gf = (ARGB_PIXEL_GREEN(pixval)*Ae >> 8) << G_SHIFT;
-                Bf = (ARGB_PIXEL_BLUE(pixval)*Ae >> 8) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Ae) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Ae) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Ae) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-            }
+            line_buf[x] = pixval_tab[dl];
         }
-        for(; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
+        blend_premultiplied_row(out_row, bg_row, line_buf, x);
+        for(; x < in->width; x++) {
+            out_row[x] = bg_row[x];
         }
     }
-    for(; y < in->height; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
+    for(; y < y1; y++) {
+        bg_row = MAP_ROW(bg, y);
+        out_row = MAP_ROW(out, y);
+        for(x = 0; x < in->width; x++) {
+            out_row[x] = bg_row[x];
         }
     }
 }
 
-void ARGB_MAP_green_gradient_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, GRADIENT *g, ARGB_MAP *p) {
-    INT x=0, y=0, offs=0;
-    INT l00, l01, l10, dl, da;
-    INT in_buf_size = in->height*in->width;
-    INT pa;
+/*
+ Premultiply n pixels of src by their alpha (c*a >> 8, as in straight alpha blends) into dst.
+ Blend filters prepare straight alpha foregrounds with it once per line, then blend with blend_premultiplied_row().
+*/
+static void premultiply_line(ARGB_PIXEL *dst, const ARGB_PIXEL *src, INT n) {
+    ARGB_PIXEL pixval, a;
+    for (INT i = 0; i < n; i++) {
+        pixval = src[i];
+        a = ARGB_PIXEL_ALPHA(pixval);
+        dst[i] = a << A_SHIFT |
+                 (ARGB_PIXEL_RED(pixval)*a >> 8) << R_SHIFT |
+                 (ARGB_PIXEL_GREEN(pixval)*a >> 8) << G_SHIFT |
+                 (ARGB_PIXEL_BLUE(pixval)*a >> 8) << B_SHIFT;
+    }
+}
 
+void ARGB_MAP_green_gradient_global_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, GRADIENT *g, const INT p) {
+    ARGB_PIXEL pixval_tab[511];
     map_filter_dg->length = 511;
     DISCRETE_GRADIENT_from_GRADIENT(map_filter_dg, g);
-    if (out->height != in->height || out->width != in->width)
+    if (out->height != bg->height || out->width != bg->width || out->height != in->height || out->width != in->width) {
         return;
+    }
+    premultiply_line(pixval_tab, map_filter_dg->pixval, map_filter_dg->length);
 
-    for(y=0, offs=0; y < in->height-MAX_EDGE_WIDTH; y++) {
-        for(x=0; x < in->width-MAX_EDGE_WIDTH; x++, offs++) {
-            pa = ARGB_PIXEL_ALPHA(((ARGB_PIXEL*)p->data)[offs]);
+    MAP_JOB job = {.out = out, .map0 = bg, .map1 = in, .n = {p}, .data = pixval_tab};
+    map_graph_rows(green_gradient_global_blend_rows, &job, in->height, 3*in->width*sizeof(ARGB_PIXEL),
+        p, sizeof(pixval_tab));
+}
+
+static void green_gradient_per_pixel_copy_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    const ARGB_PIXEL *pixval_tab = job->data;
+    ARGB_MAP *out = job->out, *in = job->map0, *p = job->p;
+    INT x=0, y=0;
+    ARGB_PIXEL *in_row, *p_row, *out_row;
+    INT l00, l01, l10, dl, da;
+    INT pa;
+
+    for(y=y0; y < y1 && y < in->height-MAX_EDGE_WIDTH; y++) {
+        in_row = MAP_ROW(in, y);
+        p_row = MAP_ROW(p, y);
+        out_row = MAP_ROW(out, y);
+        for(x=0; x < in->width-MAX_EDGE_WIDTH; x++) {
+            pa = ARGB_PIXEL_ALPHA(p_row[x]);
             da = pa >> 4; //max edge thickness (for pa==255) is MAX_EDGE_WIDTH
-            if (offs+da*in->width < in_buf_size) {
-                l00 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs]);
-                l10 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+da]);
-                l01 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+da*in->width]);
+            if (y+da < in->height) {
+                l00 = ARGB_PIXEL_GREEN(in_row[x]);
+                l10 = ARGB_PIXEL_GREEN(in_row[x+da]);
+                l01 = ARGB_PIXEL_GREEN(in_row[x+da*in->stride]);
 
                 dl = l10 + l01 - 2*l00;
                 if (dl < 0) dl = -dl;
-                ((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[dl*pa >> 8];
+                out_row[x] = pixval_tab[dl*pa >> 8];
             }
             else {
-                ((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[0];
+                out_row[x] = pixval_tab[0];
             }
         }
-        for(; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[0];
+        for(; x < in->width; x++) {
+            out_row[x] = pixval_tab[0];
         }
     }
-    for(; y < in->height; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[0];
+    for(; y < y1; y++) {
+        out_row = MAP_ROW(out, y);
+        for(x = 0; x < in->width; x++) {
+            out_row[x] = pixval_tab[0];
         }
     }
 }
 
-void ARGB_MAP_green_gradient_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, GRADIENT *g, ARGB_MAP *p) {
-    INT x=0, y=0, offs=0;
-    INT l00, l01, l10, dl, da;
-    INT in_buf_size = in->height*in->width;
-    INT pa;
-    ARGB_PIXEL Ae, Rf, Gf, Bf, Rb, Gb, Bb, pixval;
-
+void ARGB_MAP_green_gradient_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, GRADIENT *g, ARGB_MAP *p) {
     map_filter_dg->length = 511;
     DISCRETE_GRADIENT_from_GRADIENT(map_filter_dg, g);
     if (out->height != in->height || out->width != in->width)
         return;
 
-    for(y=0, offs=0; y < in->height-MAX_EDGE_WIDTH; y++) {
-        for(x=0; x < in->width-MAX_EDGE_WIDTH; x++, offs++) {
-            pa = ARGB_PIXEL_ALPHA(((ARGB_PIXEL*)p->data)[offs]);
+    MAP_JOB job = {.out = out, .map0 = in, .p = p, .data = map_filter_dg->pixval};
+    map_graph_rows(green_gradient_per_pixel_copy_rows, &job, in->height, 3*in->width*sizeof(ARGB_PIXEL),
+        MAX_EDGE_WIDTH, map_filter_dg->length*sizeof(ARGB_PIXEL));
+}
+
+static void green_gradient_per_pixel_blend_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    const ARGB_PIXEL *pixval_tab = job->data; //premultiplied gradient
+    ARGB_MAP *out = job->out, *bg = job->map0, *in = job->map1, *p = job->p;
+    INT x=0, y=0;
+    ARGB_PIXEL *in_row, *p_row, *bg_row, *out_row;
+    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)WORKER_BUFFER(worker);
+    INT l00, l01, l10, dl, da;
+    INT pa;
+
+    for(y=y0; y < y1 && y < in->height-MAX_EDGE_WIDTH; y++) {
+        in_row = MAP_ROW(in, y);
+        p_row = MAP_ROW(p, y);
+        bg_row = MAP_ROW(bg, y);
+        out_row = MAP_ROW(out, y);
+        for(x=0; x < in->width-MAX_EDGE_WIDTH; x++) {
+            pa = ARGB_PIXEL_ALPHA(p_row[x]);
             da = pa >> 4; //max edge thickness (for pa==255) is MAX_EDGE_WIDTH
-            if (offs+da*in->width < in_buf_size) {
-                l00 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs]);
-                l10 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+da]);
-                l01 = ARGB_PIXEL_GREEN(((ARGB_PIXEL*)in->data)[offs+da*in->width]);
+            if (y+da < in->height) {
+                l00 = ARGB_PIXEL_GREEN(in_row[x]);
+                l10 = ARGB_PIXEL_GREEN(in_row[x+da]);
+                l01 = ARGB_PIXEL_GREEN(in_row[x+da*in->stride]);
 
                 dl = l10 + l01 - 2*l00;
                 if (dl < 0) dl = -dl;
-                //((ARGB_PIXEL*)out->data)[offs] = map_filter_dg->pixval[dl*pa >> 8];
-                pixval = map_filter_dg->pixval[dl*pa >> 8];
-                Ae = ARGB_PIXEL_ALPHA(pixval);
-                if (Ae > 0) {
-                    Rf = (ARGB_PIXEL_RED(pixval)*Ae >> 8) << R_SHIFT;
-                    Gf = (ARGB_PIXEL_GREEN(pixval)*Ae >> 8) << G_SHIFT;
-                    Bf = (ARGB_PIXEL_BLUE(pixval)*Ae >> 8) << B_SHIFT;
-                    pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                    Rb = (ARGB_PIXEL_RED(pixval)*(255-Ae) >> 8) << R_SHIFT;
-                    Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Ae) >> 8) << G_SHIFT;
-                    Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Ae) >> 8) << B_SHIFT;
-                    ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-                }
-                else {
-                    ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-                }
+                line_buf[x] = pixval_tab[dl*pa >> 8];
             }
             else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
+                line_buf[x] = 0; //transparent
             }
         }
-        for(; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
+        blend_premultiplied_row(out_row, bg_row, line_buf, x);
+        for(; x < in->width; x++) {
+            out_row[x] = bg_row[x];
         }
     }
-    for(; y < in->height; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
+    for(; y < y1; y++) {
+        bg_row = MAP_ROW(bg, y);
+        out_row = MAP_ROW(out, y);
+        for(x = 0; x < in->width; x++) {
+            out_row[x] = bg_row[x];
         }
     }
 }
 
-void ARGB_MAP_blur_nx1_global_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p) {
-    INT x = 0, y = 0, offs = 0;
-    ARGB_PIXEL pixval;
-    ARGB_PIXEL r, g, b, rb, gb, bb, mul_f = (1<<FRACT_SHIFT)/p;
-    const INT lp = (p-1)/2; //left half of p
-    const INT rp = p/2; //right half of p
-
-    if (p < 1 || out->height != in->height || out->width != in->width) {
-        return;
-    }
-    else if (p == 1) {
-        ARGB_MAP_copy(out, in);
+void ARGB_MAP_green_gradient_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, GRADIENT *g, ARGB_MAP *p) {
+    ARGB_PIXEL pixval_tab[511];
+    map_filter_dg->length = 511;
+    DISCRETE_GRADIENT_from_GRADIENT(map_filter_dg, g);
+    if (out->height != in->height || out->width != in->width)
         return;
+    premultiply_line(pixval_tab, map_filter_dg->pixval, map_filter_dg->length);
+
+    MAP_JOB job = {.out = out, .map0 = bg, .map1 = in, .p = p, .data = pixval_tab};
+    map_graph_rows(green_gradient_per_pixel_blend_rows, &job, in->height, 4*in->width*sizeof(ARGB_PIXEL),
+        MAX_EDGE_WIDTH, sizeof(pixval_tab));
+}
+
+/*
+ Separable blur engine. Each direction is blurred with up to MAP_BLUR_MAX_PASSES box passes, Gaussian blur
+ is approximated with MAP_BLUR_GAUSS_PASSES boxes (see gauss_boxes()). Sums of all channels of a pixel are kept
+ in a single channel vector (CVEC, see simd.h): running sums for global box sizes, prefix sums for per pixel
+ ones, so a pass costs O(1) per pixel for any box size. Boxes are clipped to the map, averages are divided
+ by the number of pixels inside.
+ Horizontal passes run in row bands (deferrable), vertical passes in column strips with intermediate passes
+ of a strip kept in the worker buffer. When both are used, horizontal result goes to a pooled temporary map.
+ Tall maps, where strips would be narrower than MAP_FILTER_MIN_STRIP_WIDTH, are transposed (ARGB_MAP_transpose())
+ and blurred vertically with horizontal passes instead.
+ Copy output writes all blurred channels. Blend output blends the blurred foreground over bg as premultiplied
+ alpha (straight alpha foregrounds are premultiplied when read), alpha channel of the result is cleared.
+*/
+typedef struct {
+    INT passes_x, passes_y; //number of box passes per direction
+    //Box sizes of passes for alpha values of the per pixel parameter map. Global blurs use [pass][255].
+    INT box_x[MAP_BLUR_MAX_PASSES][256];
+    INT box_y[MAP_BLUR_MAX_PASSES][256];
+    bool blend; //blend output, copy otherwise
+    INT inv_cnt; //number of entries of inv
+    UINT inv[]; //2^24/n for box pixel counts n (n < inv_cnt)
+} BLUR;
+
+/*
+ Box pass along n pixels of lines parallel lines. Pixel i of line c is src[i*ss + c], output goes to dst[i*ds + c].
+ Global box of box pixels: i-(box-1)/2 .. i+box/2, running sums of lines are kept in sums.
+*/
+static inline void box_pass(ARGB_PIXEL *dst, INT ds, const ARGB_PIXEL *src, INT ss, INT n, INT lines,
+                            INT box, const UINT *inv, CVEC *sums) {
+    const INT l = (box-1)/2, r = box/2;
+    INT i, c, i0, i1;
+    for (c = 0; c < lines; c++)
+        sums[c] = CVEC_ZERO();
+    for (i = 0; i < r && i < n; i++)
+        for (c = 0; c < lines; c++)
+            sums[c] = CVEC_ADD(sums[c], cvec_unpack(src[i*ss + c]));
+    for (i = 0; i < n; i++) {
+        if (i + r < n)
+            for (c = 0; c < lines; c++)
+                sums[c] = CVEC_ADD(sums[c], cvec_unpack(src[(i+r)*ss + c]));
+        i0 = i - l > 0 ? i - l : 0;
+        i1 = i + r < n-1 ? i + r : n-1;
+        for (c = 0; c < lines; c++)
+            dst[i*ds + c] = cvec_average(sums[c], inv[i1 - i0 + 1]);
+        if (i - l >= 0)
+            for (c = 0; c < lines; c++)
+                sums[c] = CVEC_SUB(sums[c], cvec_unpack(src[(i-l)*ss + c]));
     }
+}
 
-    for(y = 0, offs = 0; y < in->height; y++) {
-        r = g = b = 0;
-        for(x = 0; x < rp; x++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs+x];
-            r += ARGB_PIXEL_RED(pixval);
-            g += ARGB_PIXEL_GREEN(pixval);
-            b += ARGB_PIXEL_BLUE(pixval);
-        }
-        for(x = 0; x < lp+1; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs+rp];
-            r += ARGB_PIXEL_RED(pixval);
-            g += ARGB_PIXEL_GREEN(pixval);
-            b += ARGB_PIXEL_BLUE(pixval);
-            rb = (r*mul_f >> FRACT_SHIFT) << R_SHIFT;
-            gb = (g*mul_f >> FRACT_SHIFT) << G_SHIFT;
-            bb = (b*mul_f >> FRACT_SHIFT) << B_SHIFT;
-            ((ARGB_PIXEL*)out->data)[offs] = rb | gb | bb;
-        }
-        for(x = lp+1; x < in->width-rp; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs+rp];
-            r += ARGB_PIXEL_RED(pixval);
-            g += ARGB_PIXEL_GREEN(pixval);
-            b += ARGB_PIXEL_BLUE(pixval);
-            pixval = ((ARGB_PIXEL*)in->data)[offs-(lp+1)];
-            r -= ARGB_PIXEL_RED(pixval);
-            g -= ARGB_PIXEL_GREEN(pixval);
-            b -= ARGB_PIXEL_BLUE(pixval);
-            rb = (r*mul_f >> FRACT_SHIFT) << R_SHIFT;
-            gb = (g*mul_f >> FRACT_SHIFT) << G_SHIFT;
-            bb = (b*mul_f >> FRACT_SHIFT) << B_SHIFT;
-            ((ARGB_PIXEL*)out->data)[offs] = rb | gb | bb;
-        }
-        for(x = in->width-rp; x < in->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs-(lp+1)];
-            r -= ARGB_PIXEL_RED(pixval);
-            g -= ARGB_PIXEL_GREEN(pixval);
-            b -= ARGB_PIXEL_BLUE(pixval);
-            rb = (r*mul_f >> FRACT_SHIFT) << R_SHIFT;
-            gb = (g*mul_f >> FRACT_SHIFT) << G_SHIFT;
-            bb = (b*mul_f >> FRACT_SHIFT) << B_SHIFT;
-            ((ARGB_PIXEL*)out->data)[offs] = rb | gb | bb;
+/*
+ box_pass() with per pixel box sizes: box_tab[alpha of p[i*ps + c]]. Prefix sums of lines (n+1 per line) are kept in prefix.
+*/
+static inline void box_pass_per_pixel(ARGB_PIXEL *dst, INT ds, const ARGB_PIXEL *src, INT ss, INT n, INT lines,
+                                      const ARGB_PIXEL *p, INT ps, const INT *box_tab, const UINT *inv, CVEC *prefix) {
+    INT i, c, i0, i1, box;
+    for (c = 0; c < lines; c++)
+        prefix[c] = CVEC_ZERO();
+    for (i = 0; i < n; i++)
+        for (c = 0; c < lines; c++)
+            prefix[(i+1)*lines + c] = CVEC_ADD(prefix[i*lines + c], cvec_unpack(src[i*ss + c]));
+    for (i = 0; i < n; i++) {
+        for (c = 0; c < lines; c++) {
+            box = box_tab[ARGB_PIXEL_ALPHA(p[i*ps + c])];
+            i0 = i - (box-1)/2 > 0 ? i - (box-1)/2 : 0;
+            i1 = i + box/2 < n-1 ? i + box/2 + 1 : n;
+            dst[i*ds + c] = cvec_average(CVEC_SUB(prefix[i1*lines + c], prefix[i0*lines + c]), inv[i1 - i0]);
         }
     }
 }
 
-void ARGB_MAP_blur_nx1_global_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, const INT p) {
-    INT x = 0, y = 0, offs = 0;
-    ARGB_PIXEL pixval;
-    ARGB_PIXEL a, r, g, b, Aavg, Rf, Gf, Bf, Rb, Gb, Bb, mul_f[256];
-    ARGB_PIXEL mfa; //multiplication factor for alpha channel (inverse of blur distance)
-    ARGB_PIXEL mfrgb; //multiplication factor for rgb channels (inverse of alpha total)
-    const INT lp = (p-1)/2; //left half of p
-    const INT rp = p/2; //right half of p
-
-    if (out->height != bg->height || out->width != bg->width || out->height != fg->height || out->width != fg->width) {
-        return;
-    }
-    else if (p == 1) {
-        ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
-        return;
-    }
-    mul_f[0] = 1<<FRACT_SHIFT;
-    for (x = 1; x < 256; x++) {
-        mul_f[x] = (1<<FRACT_SHIFT)/x;
-    }
-    mfa = mul_f[p];
-
-    for(y = 0, offs = 0; y < fg->height; y++) {
-        a = r = g = b = 0;
-        for(x = 0; x < rp; x++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs+x];
-            a += ARGB_PIXEL_ALPHA(pixval);
-            r += ARGB_PIXEL_RED(pixval);
-            g += ARGB_PIXEL_GREEN(pixval);
-            b += ARGB_PIXEL_BLUE(pixval);
-        }
-        for(x = 0; x < lp+1; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs+rp];
-            a += ARGB_PIXEL_ALPHA(pixval);
-            r += ARGB_PIXEL_RED(pixval);
-            g += ARGB_PIXEL_GREEN(pixval);
-            b += ARGB_PIXEL_BLUE(pixval);
-            Aavg = a*mfa >> FRACT_SHIFT;
-            if (Aavg > 0) {
-                //inverse of total alpha along blur section
-                //This corresponds to number of "on" pixels in foreground blur sample
-                mfrgb = mul_f[(a >> 8) + 1];
-                Rf = (r*mfrgb*Aavg >> (FRACT_SHIFT+8)) << R_SHIFT;
-                Gf = (g*mfrgb*Aavg >> (FRACT_SHIFT+8)) << G_SHIFT;
-                Bf = (b*mfrgb*Aavg >> (FRACT_SHIFT+8)) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Aavg) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Aavg) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Aavg) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-            }
+/*
+ Horizontal passes, job->n[0]: blend output, job->n[1]: vertical passes of a transposed map.
+ Worker buffer: width+1 prefix sums, two line buffers.
+*/
+static void blur_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    const BLUR *blur = job->data;
+    ARGB_MAP *out = job->out, *in = job->map0, *bg = job->map1, *p = job->p;
+    const INT w = in->width;
+    const bool premultiply = blur->blend && !in->premultiplied;
+    const INT passes = job->n[1] ? blur->passes_y : blur->passes_x;
+    const INT (*box_tab)[256] = job->n[1] ? blur->box_y : blur->box_x;
+    CVEC *sums = (CVEC*)WORKER_BUFFER(worker);
+    ARGB_PIXEL *line[2] = {(ARGB_PIXEL*)(sums + w + 1), (ARGB_PIXEL*)(sums + w + 1) + w};
+    const ARGB_PIXEL *src;
+    ARGB_PIXEL *dst;
+    INT i, k;
+
+    for (INT y = y0; y < y1; y++) {
+        src = MAP_ROW(in, y);
+        k = 0;
+        if (premultiply) {
+            premultiply_line(line[k], src, w);
+            src = line[k];
+            k ^= 1;
+        }
+        for (i = 0; i < passes; i++, k ^= 1) {
+            dst = i == passes-1 && !job->n[0] ? MAP_ROW(out, y) : line[k];
+            if (p != NULL)
+                box_pass_per_pixel(dst, 1, src, 1, w, 1, MAP_ROW(p, y), 1, box_tab[i], blur->inv, sums);
+            else
+                box_pass(dst, 1, src, 1, w, 1, box_tab[i][255], blur->inv, sums);
+            src = dst;
         }
-        for(x = lp+1; x < fg->width-rp; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs+rp];
-            a += ARGB_PIXEL_ALPHA(pixval);
-            r += ARGB_PIXEL_RED(pixval);
-            g += ARGB_PIXEL_GREEN(pixval);
-            b += ARGB_PIXEL_BLUE(pixval);
-            pixval = ((ARGB_PIXEL*)fg->data)[offs-(lp+1)];
-            a -= ARGB_PIXEL_ALPHA(pixval);
-            r -= ARGB_PIXEL_RED(pixval);
-            g -= ARGB_PIXEL_GREEN(pixval);
-            b -= ARGB_PIXEL_BLUE(pixval);
-            Aavg = a*mfa >> FRACT_SHIFT;
-            if (Aavg > 0) {
-                //inverse of total alpha along blur section
-                //This corresponds to number of "on" pixels in foreground blur sample
-                mfrgb = mul_f[(a >> 8) + 1];
-                Rf = (r*mfrgb*Aavg >> (FRACT_SHIFT+8)) << R_SHIFT;
-                Gf = (g*mfrgb*Aavg >> (FRACT_SHIFT+8)) << G_SHIFT;
-                Bf = (b*mfrgb*Aavg >> (FRACT_SHIFT+8)) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Aavg) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Aavg) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Aavg) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
+        if (job->n[0])
+            blend_premultiplied_row(MAP_ROW(out, y), MAP_ROW(bg, y), src, w);
+    }
+}
+
+/*
+ Vertical passes: s0, s1 of the band are column strip indexes, job->n[0]: blend output, job->n[1]: strip width.
+ Worker buffer: running sums (prefix sums of the whole strip with per pixel box sizes), two strip buffers.
+*/
+static void blur_strips(MAP_JOB *job, INT s0, INT s1, INT worker) {
+    const BLUR *blur = job->data;
+    ARGB_MAP *out = job->out, *in = job->map0, *bg = job->map1, *p = job->p;
+    const INT h = in->height, sw = job->n[1];
+    const bool premultiply = blur->blend && !in->premultiplied;
+    CVEC *sums = (CVEC*)WORKER_BUFFER(worker);
+    ARGB_PIXEL *buf[2];
+    const ARGB_PIXEL *src;
+    ARGB_PIXEL *dst;
+    INT i, k, x0, lines, ss, ds, y;
+
+    buf[0] = (ARGB_PIXEL*)(sums + (p != NULL ? sw*(h+1) : sw));
+    buf[1] = buf[0] + sw*h;
+    for (INT s = s0; s < s1; s++) {
+        x0 = s*sw;
+        lines = x0 + sw < in->width ? sw : in->width - x0;
+        src = MAP_ROW(in, 0) + x0;
+        ss = in->stride;
+        k = 0;
+        if (premultiply) {
+            for (y = 0; y < h; y++)
+                premultiply_line(buf[k] + y*sw, src + y*ss, lines);
+            src = buf[k];
+            ss = sw;
+            k ^= 1;
+        }
+        for (i = 0; i < blur->passes_y; i++, k ^= 1) {
+            if (i == blur->passes_y-1 && !job->n[0]) {
+                dst = MAP_ROW(out, 0) + x0;
+                ds = out->stride;
             }
             else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
+                dst = buf[k];
+                ds = sw;
             }
+            if (p != NULL)
+                box_pass_per_pixel(dst, ds, src, ss, h, lines, MAP_ROW(p, 0) + x0, p->stride, blur->box_y[i], blur->inv, sums);
+            else
+                box_pass(dst, ds, src, ss, h, lines, blur->box_y[i][255], blur->inv, sums);
+            src = dst;
+            ss = ds;
         }
-        for(x = fg->width-rp; x < fg->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs-(lp+1)];
-            a -= ARGB_PIXEL_ALPHA(pixval);
-            r -= ARGB_PIXEL_RED(pixval);
-            g -= ARGB_PIXEL_GREEN(pixval);
-            b -= ARGB_PIXEL_BLUE(pixval);
-            Aavg = a*mfa >> FRACT_SHIFT;
-            if (Aavg > 0) {
-                //inverse of total alpha along blur section
-                //This corresponds to number of "on" pixels in foreground blur sample
-                mfrgb = mul_f[(a >> 8) + 1];
-                Rf = (r*mfrgb*Aavg >> (FRACT_SHIFT+8)) << R_SHIFT;
-                Gf = (g*mfrgb*Aavg >> (FRACT_SHIFT+8)) << G_SHIFT;
-                Bf = (b*mfrgb*Aavg >> (FRACT_SHIFT+8)) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Aavg) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Aavg) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Aavg) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-            }
+        if (job->n[0]) {
+            for (y = 0; y < h; y++)
+                blend_premultiplied_row(MAP_ROW(out, y) + x0, MAP_ROW(bg, y) + x0, src + y*ss, lines);
         }
     }
 }
 
-void ARGB_MAP_blur_nx1_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, ARGB_MAP *p) {
-    INT x = 0, y = 0, offs = 0, pa, lx, rx;
-    ARGB_PIXEL pixval, r, g, b, mul_f[256], mf;
+/*
+ Widest column strip (power of 2, up to MAP_FILTER_STRIP_WIDTH) fitting in the worker buffer, 0 if none does.
+*/
+static INT blur_strip_width(INT height, bool per_pixel) {
+    INT sw;
+    for (sw = MAP_FILTER_STRIP_WIDTH; sw > 0; sw /= 2) {
+        if ((size_t)sw*((per_pixel ? height+1 : 1)*sizeof(CVEC) + 2*height*sizeof(ARGB_PIXEL)) <=
+            MAP_FILTER_BUFFER_SIZE*sizeof(INT)) {
+            break;
+        }
+    }
+    return sw;
+}
 
-    UINT *r_buf = (UINT*)map_filter_buffer;
-    UINT *g_buf = (UINT*)map_filter_buffer + in->width;
-    UINT *b_buf = (UINT*)map_filter_buffer + 2*in->width;
+static BLUR *blur_alloc(INT passes_x, INT passes_y, bool blend) {
+    BLUR *blur = calloc(1, sizeof(BLUR));
+    blur->passes_x = passes_x < MAP_BLUR_MAX_PASSES ? passes_x : MAP_BLUR_MAX_PASSES;
+    blur->passes_y = passes_y < MAP_BLUR_MAX_PASSES ? passes_y : MAP_BLUR_MAX_PASSES;
+    blur->blend = blend;
+    return blur;
+}
 
-    if (out->height != in->height || out->width != in->width) {
-        return;
-    }
+/*
+ Sizes of passes odd boxes approximating Gaussian blur with standard deviation sigma.
+*/
+static void gauss_boxes(FLOAT sigma, INT passes, INT *box) {
+    FLOAT w_ideal = sqrt(12.0*sigma*sigma/passes + 1.0);
+    INT wl = (INT)w_ideal;
+    if (wl % 2 == 0)
+        wl--;
+    INT m = (INT)round((12.0*sigma*sigma - passes*wl*wl - 4.0*passes*wl - 3.0*passes)/(-4.0*wl - 4.0));
+    for (INT i = 0; i < passes; i++)
+        box[i] = i < m ? wl : wl + 2;
+}
 
-    mul_f[0] = 1<<FRACT_SHIFT;
-    for (x = 1; x < 256; x++) {
-        mul_f[x] = (1<<FRACT_SHIFT)/x;
-    }
-
-    for(y = 0, offs = 0; y < in->height; y++) {
-        pixval = ((ARGB_PIXEL*)in->data)[offs];
-        r_buf[0] = ARGB_PIXEL_RED(pixval);
-        g_buf[0] = ARGB_PIXEL_GREEN(pixval);
-        b_buf[0] = ARGB_PIXEL_BLUE(pixval);
-        for(x = 1; x < in->width; x++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs+x];
-            r_buf[x] = r_buf[x-1] + ARGB_PIXEL_RED(pixval);
-            g_buf[x] = g_buf[x-1] + ARGB_PIXEL_GREEN(pixval);
-            b_buf[x] = b_buf[x-1] + ARGB_PIXEL_BLUE(pixval);
-        }
-
-        for(x = 0; x < in->width; x++, offs++) {
-            pa = ARGB_PIXEL_ALPHA(p->data[offs]) + 1;
-            if (pa > 1) {
-                lx = x - (pa-1)/2 - 1;
-                if (lx < 0)
-                    lx = 0;
-                rx = x + pa/2;
-                if (rx > in->width-1)
-                    rx = in->width-1;
-                mf = mul_f[rx - lx];
-                r = ((r_buf[rx]-r_buf[lx])*mf >> FRACT_SHIFT) << R_SHIFT;
-                g = ((g_buf[rx]-g_buf[lx])*mf >> FRACT_SHIFT) << G_SHIFT;
-                b = ((b_buf[rx]-b_buf[lx])*mf >> FRACT_SHIFT) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = r | g | b;
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)in->data)[offs];
-            }
-        }
+/*
+ Fill box size tables of passes Gaussian passes: sigma for all alpha values, or sigma*alpha/255 if per_pixel.
+*/
+static void gauss_box_tables(INT (*box_tab)[256], INT passes, FLOAT sigma, bool per_pixel) {
+    INT box[MAP_BLUR_MAX_PASSES];
+    for (INT a = per_pixel ? 0 : 255; a < 256; a++) {
+        gauss_boxes(per_pixel ? sigma*a/255.0 : sigma, passes, box);
+        for (INT i = 0; i < passes; i++)
+            box_tab[i][a] = box[i];
     }
 }
 
-void ARGB_MAP_blur_nx1_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, ARGB_MAP *p) {
-    //function assumes that objects to be blured are rendered on the black background
-    //also alpha channel in ARGB_MAP *in is either 0x00 or 0xFF
-    INT x = 0, y = 0, offs = 0, pa, lx, rx;
-    ARGB_PIXEL pixval, mul_f[256];
-    ARGB_PIXEL Aavg; //Average alpha component
-    ARGB_PIXEL Rf, Gf, Bf; //Average foreground color components
-    ARGB_PIXEL Rb, Gb, Bb; //Average background color components
-    ARGB_PIXEL mfa; //multiplication factor for alpha channel (inverse of blur distance)
-    ARGB_PIXEL mfrgb; //multiplication factor for rgb channels (inverse of alpha total)
-
-    //Integration buffers for color components
-    UINT *a_buf = (UINT*)map_filter_buffer;
-    UINT *r_buf = (UINT*)map_filter_buffer + fg->width;
-    UINT *g_buf = (UINT*)map_filter_buffer + 2*fg->width;
-    UINT *b_buf = (UINT*)map_filter_buffer + 3*fg->width;
-
-    if (out->height != bg->height || out->width != bg->width || out->height != fg->height || out->width != fg->width) {
+/*
+ Execute and free blur. in: input (foreground) map, bg: background of blend output, p: per pixel parameter map or NULL.
+*/
+static void blur_run(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, ARGB_MAP *p, BLUR *blur) {
+    const INT w = in->width, h = in->height;
+    INT i, a, sw = 0, max_box = 1; //sw: vertical strip width
+    ARGB_MAP *tmp = NULL;
+
+    if (blur->passes_y > 0)
+        sw = blur_strip_width(h, p != NULL);
+    if (out->width != w || out->height != h || (bg != NULL && (bg->width != w || bg->height != h)) ||
+        (p != NULL && (p->width != w || p->height != h)) ||
+        (size_t)(w+1)*sizeof(CVEC) + 2*w*sizeof(ARGB_PIXEL) > MAP_FILTER_BUFFER_SIZE*sizeof(INT) ||
+        (blur->passes_y > 0 && sw < MAP_FILTER_MIN_STRIP_WIDTH &&
+         (size_t)(h+1)*sizeof(CVEC) + 2*h*sizeof(ARGB_PIXEL) > MAP_FILTER_BUFFER_SIZE*sizeof(INT))) {
+        free(blur);
         return;
     }
+    if (blur->passes_x == 0 && blur->passes_y == 0) {
+        blur->passes_x = 1; //plain copy or blend, box of 1 pixel
+        for (a = 0; a < 256; a++)
+            blur->box_x[0][a] = 1;
+    }
+    for (i = 0; i < MAP_BLUR_MAX_PASSES; i++) {
+        for (a = p != NULL ? 0 : 255; a < 256; a++) {
+            if (i < blur->passes_x && blur->box_x[i][a] > max_box)
+                max_box = blur->box_x[i][a];
+            if (i < blur->passes_y && blur->box_y[i][a] > max_box)
+                max_box = blur->box_y[i][a];
+        }
+    }
+    blur->inv_cnt = (max_box < (w > h ? w : h) ? max_box : (w > h ? w : h)) + 1;
+    blur = realloc(blur, sizeof(BLUR) + blur->inv_cnt*sizeof(UINT));
+    blur->inv[0] = 0;
+    for (i = 1; i < blur->inv_cnt; i++)
+        blur->inv[i] = ((1 << 24) + i/2)/i;
+    if (!blur->blend)
+        out->premultiplied = in->premultiplied;
+
+    if (blur->passes_x > 0) {
+        MAP_JOB job = {.out = out, .map0 = in, .map1 = bg, .p = p, .n = {blur->blend}, .data = blur};
+        if (blur->passes_y > 0) {
+            tmp = ARGB_MAP_acquire(w, h, false);
+            tmp->premultiplied = blur->blend || in->premultiplied;
+            job.out = tmp;
+            job.map1 = NULL;
+            job.n[0] = false;
+            in = tmp;
+        }
+        map_graph_rows(blur_rows, &job, h, (job.n[0] ? 3 : 2)*w*sizeof(ARGB_PIXEL), 0,
+            sizeof(BLUR) + blur->inv_cnt*sizeof(UINT));
+    }
+    if (blur->passes_y > 0 && sw < MAP_FILTER_MIN_STRIP_WIDTH) {
+        //transpose, blur rows, transpose back
+        ARGB_MAP *in_t = ARGB_MAP_acquire(h, w, false), *out_t = ARGB_MAP_acquire(h, w, false), *p_t = NULL;
+        ARGB_MAP_transpose(in_t, in);
+        if (p != NULL) {
+            p_t = ARGB_MAP_acquire(h, w, false);
+            ARGB_MAP_transpose(p_t, p);
+        }
+        MAP_JOB job = {.out = out_t, .map0 = in_t, .p = p_t, .n = {false, true}, .data = blur};
+        map_graph_rows(blur_rows, &job, w, 2*h*sizeof(ARGB_PIXEL), 0, sizeof(BLUR) + blur->inv_cnt*sizeof(UINT));
+        out_t->premultiplied = blur->blend || in_t->premultiplied;
+        if (blur->blend) {
+            if (tmp == NULL)
+                tmp = ARGB_MAP_acquire(w, h, false); //horizontal result is no longer needed
+            ARGB_MAP_transpose(tmp, out_t);
+            ARGB_MAP_blend_premultiplied(out, bg, tmp);
+        }
+        else {
+            ARGB_MAP_transpose(out, out_t);
+        }
+        ARGB_MAP_release(in_t);
+        ARGB_MAP_release(out_t);
+        ARGB_MAP_release(p_t);
+        ARGB_MAP_release(tmp);
+    }
+    else if (blur->passes_y > 0) {
+        MAP_JOB job = {.out = out, .map0 = in, .map1 = bg, .p = p, .n = {blur->blend, sw}, .data = blur};
+        map_graph_flush();
+        ARGB_MAP_mark_dirty(out, 0, 0, w-1, h-1);
+        parallel_rows(blur_strips, &job, (w + sw - 1)/sw, (blur->blend ? 3 : 2)*sw*h*sizeof(ARGB_PIXEL));
+        ARGB_MAP_release(tmp);
+    }
+    free(blur);
+}
 
-    mul_f[0] = 1<<FRACT_SHIFT;
-    for (x = 1; x < 256; x++) {
-        mul_f[x] = (1<<FRACT_SHIFT)/x;
-    }
-
-    for(y = 0, offs = 0; y < fg->height; y++) {
-        pixval = ((ARGB_PIXEL*)fg->data)[offs];
-        a_buf[0] = ARGB_PIXEL_ALPHA(pixval);
-        r_buf[0] = ARGB_PIXEL_RED(pixval);
-        g_buf[0] = ARGB_PIXEL_GREEN(pixval);
-        b_buf[0] = ARGB_PIXEL_BLUE(pixval);
-        for(x = 1; x < fg->width; x++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs+x];
-            a_buf[x] = a_buf[x-1] + ARGB_PIXEL_ALPHA(pixval);
-            r_buf[x] = r_buf[x-1] + ARGB_PIXEL_RED(pixval);
-            g_buf[x] = g_buf[x-1] + ARGB_PIXEL_GREEN(pixval);
-            b_buf[x] = b_buf[x-1] + ARGB_PIXEL_BLUE(pixval);
-        }
-
-        for(x = 0; x < fg->width; x++, offs++) {
-            //blur distance for this pixel
-            pa = ARGB_PIXEL_ALPHA(p->data[offs]) + 1;
-            lx = x - (pa-1)/2 - 1;
-            if (lx < 0)
-                lx = 0;
-            rx = x + pa/2;
-            if (rx > fg->width-1)
-                rx = fg->width-1;
-            mfa = mul_f[rx - lx]; //inverse of blur distance
-            //Component average values
-            Aavg = (a_buf[rx]-a_buf[lx])*mfa >> FRACT_SHIFT;
-            if (Aavg > 0) {
-                mfrgb = mul_f[((a_buf[rx]-a_buf[lx]) >> 8) + 1];
-                Rf = ((r_buf[rx]-r_buf[lx])*mfrgb*Aavg >> (FRACT_SHIFT+8)) << R_SHIFT;
-                Gf = ((g_buf[rx]-g_buf[lx])*mfrgb*Aavg >> (FRACT_SHIFT+8)) << G_SHIFT;
-                Bf = ((b_buf[rx]-b_buf[lx])*mfrgb*Aavg >> (FRACT_SHIFT+8)) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Aavg) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Aavg) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Aavg) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-            }
-        }
+/*
+ Box blurs: p pixels wide (nx1) or high (1xn). Per pixel box size is alpha+1 of the parameter map.
+*/
+static void box_blur(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, ARGB_MAP *p, INT size, bool vertical) {
+    BLUR *blur = blur_alloc(vertical ? 0 : 1, vertical ? 1 : 0, bg != NULL);
+    for (INT a = 0; a < 256; a++) {
+        if (vertical)
+            blur->box_y[0][a] = p != NULL ? a+1 : size;
+        else
+            blur->box_x[0][a] = p != NULL ? a+1 : size;
     }
+    blur_run(out, bg, in, p, blur);
 }
 
-void ARGB_MAP_blur_1xn_global_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p) {
-    INT x = 0, y = 0, offs = 0;
-    ARGB_PIXEL pixval;
-    INT *r = map_filter_buffer;
-    INT *g = map_filter_buffer + in->width;
-    INT *b = map_filter_buffer + 2*in->width;
-    INT rb, gb, bb, mul_f = (1<<FRACT_SHIFT)/p;
-
-    const INT tp = (p-1)/2;
-    const INT bp = p/2;
-
+void ARGB_MAP_blur_nx1_global_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p) {
     if (p < 1 || out->height != in->height || out->width != in->width) {
         return;
     }
@@ -510,196 +586,113 @@ void ARGB_MAP_blur_1xn_global_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p) {
         ARGB_MAP_copy(out, in);
         return;
     }
+    box_blur(out, NULL, in, NULL, p, false);
+}
 
-    for (x = 0; x < in->width; x++) {
-        r[x] = g[x] = b[x] = 0;
+void ARGB_MAP_blur_nx1_global_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, const INT p) {
+    if (p < 1 || out->height != bg->height || out->width != bg->width || out->height != fg->height || out->width != fg->width) {
+        return;
     }
-
-    for(y = 0, offs = 0; y < bp; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs];
-            r[x] += ARGB_PIXEL_RED(pixval);
-            g[x] += ARGB_PIXEL_GREEN(pixval);
-            b[x] += ARGB_PIXEL_BLUE(pixval);
-        }
+    else if (p == 1) {
+        if (fg->premultiplied)
+            ARGB_MAP_blend_premultiplied(out, bg, fg);
+        else
+            ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
+        return;
     }
+    box_blur(out, bg, fg, NULL, p, false);
+}
 
-    for(y = 0, offs = 0; y < tp+1; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs+bp*in->width];
-            r[x] += ARGB_PIXEL_RED(pixval);
-            g[x] += ARGB_PIXEL_GREEN(pixval);
-            b[x] += ARGB_PIXEL_BLUE(pixval);
-            rb = (r[x]*mul_f >> FRACT_SHIFT) << R_SHIFT;
-            gb = (g[x]*mul_f >> FRACT_SHIFT) << G_SHIFT;
-            bb = (b[x]*mul_f >> FRACT_SHIFT) << B_SHIFT;
-            ((ARGB_PIXEL*)out->data)[offs] = rb | gb | bb;
-        }
-    }
+void ARGB_MAP_blur_nx1_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, ARGB_MAP *p) {
+    box_blur(out, NULL, in, p, 0, false);
+}
 
-    for(y = tp+1; y < in->height-bp; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs+bp*in->width];
-            r[x] += ARGB_PIXEL_RED(pixval);
-            g[x] += ARGB_PIXEL_GREEN(pixval);
-            b[x] += ARGB_PIXEL_BLUE(pixval);
-            pixval = ((ARGB_PIXEL*)in->data)[offs-(tp+1)*in->width];
-            r[x] -= ARGB_PIXEL_RED(pixval);
-            g[x] -= ARGB_PIXEL_GREEN(pixval);
-            b[x] -= ARGB_PIXEL_BLUE(pixval);
-            rb = (r[x]*mul_f >> FRACT_SHIFT) << R_SHIFT;
-            gb = (g[x]*mul_f >> FRACT_SHIFT) << G_SHIFT;
-            bb = (b[x]*mul_f >> FRACT_SHIFT) << B_SHIFT;
-            ((ARGB_PIXEL*)out->data)[offs] = rb | gb | bb;
-        }
-    }
+void ARGB_MAP_blur_nx1_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, ARGB_MAP *p) {
+    box_blur(out, bg, fg, p, 0, false);
+}
 
-    for(y = in->height-bp; y < in->height; y++) {
-        for(x = 0; x < in->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)in->data)[offs-(tp+1)*in->width];
-            r[x] -= ARGB_PIXEL_RED(pixval);
-            g[x] -= ARGB_PIXEL_GREEN(pixval);
-            b[x] -= ARGB_PIXEL_BLUE(pixval);
-            rb = (r[x]*mul_f >> FRACT_SHIFT) << R_SHIFT;
-            gb = (g[x]*mul_f >> FRACT_SHIFT) << G_SHIFT;
-            bb = (b[x]*mul_f >> FRACT_SHIFT) << B_SHIFT;
-            ((ARGB_PIXEL*)out->data)[offs] = rb | gb | bb;
-        }
+void ARGB_MAP_blur_1xn_global_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p) {
+    if (p < 1 || out->height != in->height || out->width != in->width) {
+        return;
     }
+    else if (p == 1) {
+        ARGB_MAP_copy(out, in);
+        return;
+    }
+    box_blur(out, NULL, in, NULL, p, true);
 }
 
 void ARGB_MAP_blur_1xn_global_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, const INT p) {
-    INT x = 0, y = 0, offs = 0;
-    ARGB_PIXEL pixval;
-    ARGB_PIXEL Aavg, Rf, Gf, Bf, Rb, Gb, Bb, mul_f[256];
-    ARGB_PIXEL *a = (ARGB_PIXEL*)map_filter_buffer;
-    ARGB_PIXEL *r = (ARGB_PIXEL*)map_filter_buffer + fg->width;
-    ARGB_PIXEL *g = (ARGB_PIXEL*)map_filter_buffer + 2*fg->width;
-    ARGB_PIXEL *b = (ARGB_PIXEL*)map_filter_buffer + 3*fg->width;
-    ARGB_PIXEL mfa; //multiplication factor for alpha channel (inverse of blur distance)
-    ARGB_PIXEL mfrgb; //multiplication factor for rgb channels (inverse of alpha total)
-
-    const INT tp = (p-1)/2;
-    const INT bp = p/2;
-
-    if (out->height != bg->height || out->width != bg->width || out->height != fg->height || out->width != fg->width) {
+    if (p < 1 || out->height != bg->height || out->width != bg->width || out->height != fg->height || out->width != fg->width) {
         return;
     }
     else if (p == 1) {
-        ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
+        if (fg->premultiplied)
+            ARGB_MAP_blend_premultiplied(out, bg, fg);
+        else
+            ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
         return;
     }
-    mul_f[0] = 1<<FRACT_SHIFT;
-    for (x = 1; x < 256; x++) {
-        mul_f[x] = (1<<FRACT_SHIFT)/x;
-    }
-    mfa = mul_f[p];
-
-    for (x = 0; x < fg->width; x++) {
-        a[x] = r[x] = g[x] = b[x] = 0;
-    }
-
-    for(y = 0, offs = 0; y < bp; y++) {
-        for(x = 0; x < fg->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs];
-            a[x] += ARGB_PIXEL_ALPHA(pixval);
-            r[x] += ARGB_PIXEL_RED(pixval);
-            g[x] += ARGB_PIXEL_GREEN(pixval);
-            b[x] += ARGB_PIXEL_BLUE(pixval);
-        }
-    }
-
-    for(y = 0, offs = 0; y < tp+1; y++) {
-        for(x = 0; x < fg->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs+bp*fg->width];
-            a[x] += ARGB_PIXEL_ALPHA(pixval);
-            r[x] += ARGB_PIXEL_RED(pixval);
-            g[x] += ARGB_PIXEL_GREEN(pixval);
-            b[x] += ARGB_PIXEL_BLUE(pixval);
-            Aavg = a[x]*mfa >> FRACT_SHIFT;
-            if (Aavg > 0) {
-                //inverse of total alpha along blur section
-                //This corresponds to number of "on" pixels in foreground blur sample
-                mfrgb = mul_f[(a[x] >> 8) + 1];
-                Rf = (r[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << R_SHIFT;
-                Gf = (g[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << G_SHIFT;
-                Bf = (b[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Aavg) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Aavg) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Aavg) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-            }
-        }
-    }
+    box_blur(out, bg, fg, NULL, p, true);
+}
 
-    for(y = tp+1; y < fg->height-bp; y++) {
-        for(x = 0; x < fg->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs+bp*fg->width];
-            a[x] += ARGB_PIXEL_ALPHA(pixval);
-            r[x] += ARGB_PIXEL_RED(pixval);
-            g[x] += ARGB_PIXEL_GREEN(pixval);
-            b[x] += ARGB_PIXEL_BLUE(pixval);
-            pixval = ((ARGB_PIXEL*)fg->data)[offs-(tp+1)*fg->width];
-            a[x] -= ARGB_PIXEL_ALPHA(pixval);
-            r[x] -= ARGB_PIXEL_RED(pixval);
-            g[x] -= ARGB_PIXEL_GREEN(pixval);
-            b[x] -= ARGB_PIXEL_BLUE(pixval);
-            Aavg = a[x]*mfa >> FRACT_SHIFT;
-            if (Aavg > 0) {
-                //inverse of total alpha along blur section
-                //This corresponds to number of "on" pixels in foreground blur sample
-                mfrgb = mul_f[(a[x] >> 8) + 1];
-                Rf = (r[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << R_SHIFT;
-                Gf = (g[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << G_SHIFT;
-                Bf = (b[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Aavg) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Aavg) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Aavg) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-            }
-        }
-    }
+void ARGB_MAP_blur_1xn_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, ARGB_MAP *p) {
+    box_blur(out, NULL, in, p, 0, true);
+}
 
-    for(y = fg->height-bp; y < fg->height; y++) {
-        for(x = 0; x < fg->width; x++, offs++) {
-            pixval = ((ARGB_PIXEL*)fg->data)[offs-(tp+1)*fg->width];
-            a[x] -= ARGB_PIXEL_ALPHA(pixval);
-            r[x] -= ARGB_PIXEL_RED(pixval);
-            g[x] -= ARGB_PIXEL_GREEN(pixval);
-            b[x] -= ARGB_PIXEL_BLUE(pixval);
-            Aavg = a[x]*mfa >> FRACT_SHIFT;
-            if (Aavg > 0) {
-                //inverse of total alpha along blur section
-                //This corresponds to number of "on" pixels in foreground blur sample
-                mfrgb = mul_f[(a[x] >> 8) + 1];
-                Rf = (r[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << R_SHIFT;
-                Gf = (g[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << G_SHIFT;
-                Bf = (b[x]*mfrgb*Aavg >> (FRACT_SHIFT+8)) << B_SHIFT;
-                pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                Rb = (ARGB_PIXEL_RED(pixval)*(255-Aavg) >> 8) << R_SHIFT;
-                Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Aavg) >> 8) << G_SHIFT;
-                Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Aavg) >> 8) << B_SHIFT;
-                ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-            }
-            else {
-                ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
+void ARGB_MAP_blur_1xn_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, ARGB_MAP *p) {
+    box_blur(out, bg, fg, p, 0, true);
+}
+
+/*
+ Gaussian blurs with standard deviations sigma_x, sigma_y [pixels], 0 for no blur in that direction.
+ Per pixel variants scale both by alpha/255 of the parameter map.
+*/
+static void gaussian_blur(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *in, ARGB_MAP *p, FLOAT sigma_x, FLOAT sigma_y) {
+    BLUR *blur = blur_alloc(sigma_x > 0.0 ? MAP_BLUR_GAUSS_PASSES : 0, sigma_y > 0.0 ? MAP_BLUR_GAUSS_PASSES : 0, bg != NULL);
+    gauss_box_tables(blur->box_x, blur->passes_x, sigma_x, p != NULL);
+    gauss_box_tables(blur->box_y, blur->passes_y, sigma_y, p != NULL);
+    blur_run(out, bg, in, p, blur);
+}
+
+void ARGB_MAP_gaussian_blur_copy(ARGB_MAP *out, ARGB_MAP *in, FLOAT sigma_x, FLOAT sigma_y) {
+    gaussian_blur(out, NULL, in, NULL, sigma_x, sigma_y);
+}
+
+void ARGB_MAP_gaussian_blur_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, FLOAT sigma_x, FLOAT sigma_y) {
+    gaussian_blur(out, bg, fg, NULL, sigma_x, sigma_y);
+}
+
+void ARGB_MAP_gaussian_blur_per_pixel_copy(ARGB_MAP *out, ARGB_MAP *in, FLOAT sigma_x, FLOAT sigma_y, ARGB_MAP *p) {
+    gaussian_blur(out, NULL, in, p, sigma_x, sigma_y);
+}
+
+void ARGB_MAP_gaussian_blur_per_pixel_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, FLOAT sigma_x, FLOAT sigma_y, ARGB_MAP *p) {
+    gaussian_blur(out, bg, fg, p, sigma_x, sigma_y);
+}
+
+/*
+ Pixelization: y0, y1 of the band are indexes of p pixels high block rows.
+*/
+static void pixelize_copy_rows(MAP_JOB *job, INT b0, INT b1, INT worker) {
+    ARGB_MAP *out = job->out, *in = job->map0;
+    const INT p = job->n[0];
+    INT x = 0, y = 0, i = 0;
+    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)WORKER_BUFFER(worker);
+
+    for (y = b0*p; y < b1*p && y < in->height; y+=p) {
+        for (x = 0; x < in->width; x+=p) {
+            for (i = 0; i < p && x+i < in->width; i++) {
+                line_buf[x+i] = MAP_ROW(in, y)[x];
             }
         }
+        for (i = 0; i < p && y+i < in->height; i++) {
+            memcpy((void*)MAP_ROW(out, y+i), (void*)line_buf, in->width*sizeof(ARGB_PIXEL));
+        }
     }
 }
 
 void ARGB_MAP_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p) {
-    INT x = 0, y = 0, i = 0, offs = 0;
-    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)map_filter_buffer;
-
     if (p < 1 || out->height != in->height || out->width != in->width) {
         return;
     }
@@ -708,65 +701,110 @@ void ARGB_MAP_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in, const INT p) {
         return;
     }
 
-    for (y = 0, offs = 0; y < in->height; y+=p) {
-        for (x = 0; x < in->width; x+=p) {
-            for (i = 0; i < p && x+i < in->width; i++) {
-                line_buf[x+i] = ((ARGB_PIXEL*)in->data)[offs+x];
+    MAP_JOB job = {.out = out, .map0 = in, .n = {p}};
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, out->height-1);
+    parallel_rows(pixelize_copy_rows, &job, (in->height + p - 1)/p, 2*p*in->width*sizeof(ARGB_PIXEL));
+}
+
+static void pixelize_blend_rows(MAP_JOB *job, INT b0, INT b1, INT worker) {
+    ARGB_MAP *out = job->out, *bg = job->map0, *fg = job->map1;
+    const INT p = job->n[0];
+    INT x = 0, y = 0, i = 0;
+    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)WORKER_BUFFER(worker);
+
+    for (y = b0*p; y < b1*p && y < fg->height; y+=p) {
+        for (x = 0; x < fg->width; x+=p) {
+            for (i = 0; i < p && x+i < fg->width; i++) {
+                line_buf[x+i] = MAP_ROW(fg, y)[x];
             }
         }
-        for (i = 0; i < p; i++, offs+=in->width) {
-            memcpy((void*)(out->data+offs), (void*)line_buf, in->width*sizeof(ARGB_PIXEL));
+        if (!fg->premultiplied)
+            premultiply_line(line_buf, line_buf, fg->width);
+        for (i = 0; i < p && y+i < fg->height; i++) {
+            blend_premultiplied_row(MAP_ROW(out, y+i), MAP_ROW(bg, y+i), line_buf, fg->width);
         }
     }
 }
 
 void ARGB_MAP_pixelize_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg, const INT p) {
-    INT x = 0, y = 0, i = 0, offs = 0;
-    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)map_filter_buffer;
-    ARGB_PIXEL Af, Rf, Gf, Bf, Rb, Gb, Bb, pixval;
-
     if (p < 1 || out->height != fg->height || out->width != fg->width) {
         return;
     }
     else if (p == 1) {
-        ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
+        if (fg->premultiplied)
+            ARGB_MAP_blend_premultiplied(out, bg, fg);
+        else
+            ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
         return;
     }
 
-    for (y = 0, offs = 0; y < fg->height; y+=p) {
-        for (x = 0; x < fg->width; x+=p) {
-            for (i = 0; i < p && x+i < fg->width; i++) {
-                line_buf[x+i] = ((ARGB_PIXEL*)fg->data)[offs+x];
-            }
+    MAP_JOB job = {.out = out, .map0 = bg, .map1 = fg, .n = {p}};
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, out->height-1);
+    parallel_rows(pixelize_blend_rows, &job, (fg->height + p - 1)/p, 3*p*fg->width*sizeof(ARGB_PIXEL));
+}
+
+/*
+ Random pixelization: block rows are prepared first, with height and seed_l at the beginning of every
+ block row stored in map_filter_row_buffer: {y, seed_l} pairs, terminated with y == height.
+ Returns the number of block rows.
+*/
+static INT rand_pixelize_block_rows(INT width, INT height,
+                                    const INT l_min, const INT l_max, UINT seed_l,
+                                    const INT h_min, const INT h_max, UINT seed_h) {
+    INT x = 0, y = 0, l = 0, h = 0, rows = 0;
+    INT *row_tab = map_filter_row_buffer;
+    for (y = 0, h = 0; y < height && 2*rows+2 < MAP_FILTER_BUFFER_SIZE; y += h, rows++) {
+        row_tab[2*rows] = y;
+        row_tab[2*rows+1] = seed_l;
+        for (x = 0, l = 0; x < width && l_max != l_min; x += l) {
+            l = l_min + PRN(seed_l)%(l_max-l_min);
         }
-        for (i = 0; i < p; i++) {
-            for (x = 0; x < fg->width; x++, offs++) {
-                pixval = line_buf[x];
-                Af = ARGB_PIXEL_ALPHA(pixval);
-                if (Af > 0) {
-                    Rf = (ARGB_PIXEL_RED(pixval)*Af >> 8) << R_SHIFT;
-                    Gf = (ARGB_PIXEL_GREEN(pixval)*Af >> 8) << G_SHIFT;
-                    Bf = (ARGB_PIXEL_BLUE(pixval)*Af >> 8) << B_SHIFT;
-                    pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                    Rb = (ARGB_PIXEL_RED(pixval)*(255-Af) >> 8) << R_SHIFT;
-                    Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Af) >> 8) << G_SHIFT;
-                    Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Af) >> 8) << B_SHIFT;
-                    ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-                }
-                else {
-                    ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-                }
+        if (h_max == h_min)
+            h = h_min;
+        else
+            h = h_min + PRN(seed_h)%(h_max-h_min);
+        if (y+h > height)
+            h = height - y;
+    }
+    row_tab[2*rows] = height;
+    return rows;
+}
+
+static void rand_pixelize_copy_rows(MAP_JOB *job, INT b0, INT b1, INT worker) {
+    ARGB_MAP *out = job->out, *in = job->map0;
+    const INT l_min = job->n[0], l_max = job->n[1];
+    const INT *row_tab = job->data;
+    INT x = 0, y = 0, i = 0, l = 0, h = 0, block;
+    UINT seed_l;
+    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)WORKER_BUFFER(worker);
+
+    for (block = b0; block < b1; block++) {
+        y = row_tab[2*block];
+        h = row_tab[2*block+2] - y;
+        seed_l = row_tab[2*block+1];
+        for (x = 0, l = 0; x < in->width; x += l) {
+            if (l_max == l_min)
+                l = l_min;
+            else
+                l = l_min + PRN(seed_l)%(l_max-l_min);
+            if (x+l > in->width)
+                l = in->width - x;
+            for (i = 0; i < l; i++) {
+                line_buf[x+i] = MAP_ROW(in, y)[x];
             }
         }
+
+        for (i = 0; i < h; i++) {
+            memcpy((void*)MAP_ROW(out, y+i), (void*)line_buf, in->width*sizeof(ARGB_PIXEL));
+        }
     }
 }
 
 void ARGB_MAP_rand_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in,
                                 const INT l_min, const INT l_max, UINT seed_l,
                                 const INT h_min, const INT h_max, UINT seed_h) {
-    INT x = 0, y = 0, i = 0, offs = 0, l = 0, h = 0;
-    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)map_filter_buffer;
-
     if (l_min < 1 || l_max < l_min || h_min < 1 || h_max < h_min ||
         out->height != in->height || out->width != in->width) {
         return;
@@ -776,27 +814,41 @@ void ARGB_MAP_rand_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in,
         return;
     }
 
-    for (y = 0, h = 0, offs = 0; y < in->height; y += h) {
-        for (x = 0, l = 0; x < in->width; x += l) {
+    INT rows = rand_pixelize_block_rows(in->width, in->height, l_min, l_max, seed_l, h_min, h_max, seed_h);
+    MAP_JOB job = {.out = out, .map0 = in, .n = {l_min, l_max}, .data = map_filter_row_buffer};
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, out->height-1);
+    parallel_rows(rand_pixelize_copy_rows, &job, rows, 2*h_min*in->width*sizeof(ARGB_PIXEL));
+}
+
+static void rand_pixelize_blend_rows(MAP_JOB *job, INT b0, INT b1, INT worker) {
+    ARGB_MAP *out = job->out, *bg = job->map0, *fg = job->map1;
+    const INT l_min = job->n[0], l_max = job->n[1];
+    const INT *row_tab = job->data;
+    INT x = 0, y = 0, i = 0, l = 0, h = 0, block;
+    UINT seed_l;
+    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)WORKER_BUFFER(worker);
+
+    for (block = b0; block < b1; block++) {
+        y = row_tab[2*block];
+        h = row_tab[2*block+2] - y;
+        seed_l = row_tab[2*block+1];
+        for (x = 0, l = 0; x < fg->width; x += l) {
             if (l_max == l_min)
                 l = l_min;
             else
                 l = l_min + PRN(seed_l)%(l_max-l_min);
-            if (x+l > in->width)
-                l = in->width - x;
+            if (x+l > fg->width)
+                l = fg->width - x;
             for (i = 0; i < l; i++) {
-                line_buf[x+i] = ((ARGB_PIXEL*)in->data)[offs+x];
+                line_buf[x+i] = MAP_ROW(fg, y)[x];
             }
         }
+        if (!fg->premultiplied)
+            premultiply_line(line_buf, line_buf, fg->width);
 
-        if (h_max == h_min)
-            h = h_min;
-        else
-            h = h_min + PRN(seed_h)%(h_max-h_min);
-        if (y+h > in->height)
-            h = in->height - y;
-        for (i = 0; i < h; i++, offs+=in->width) {
-            memcpy((void*)(out->data+offs), (void*)line_buf, in->width*sizeof(ARGB_PIXEL));
+        for (i = 0; i < h; i++) {
+            blend_premultiplied_row(MAP_ROW(out, y+i), MAP_ROW(bg, y+i), line_buf, fg->width);
         }
     }
 }
@@ -804,56 +856,147 @@ void ARGB_MAP_rand_pixelize_copy(ARGB_MAP *out, ARGB_MAP *in,
 void ARGB_MAP_rand_pixelize_blend(ARGB_MAP *out, ARGB_MAP *bg, ARGB_MAP *fg,
                                   const INT l_min, const INT l_max, UINT seed_l,
                                   const INT h_min, const INT h_max, UINT seed_h) {
-    INT x = 0, y = 0, i = 0, offs = 0, l = 0, h = 0;
-    ARGB_PIXEL *line_buf = (ARGB_PIXEL*)map_filter_buffer;
-    ARGB_PIXEL Af, Rf, Gf, Bf, Rb, Gb, Bb, pixval;
-
     if (l_min < 1 || l_max < l_min || h_min < 1 || h_max < h_min ||
         out->height != fg->height || out->width != fg->width) {
         return;
     }
     else if (l_min == 1 && l_max == 1 && h_min == 1 && h_max == 1) {
-        ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
+        if (fg->premultiplied)
+            ARGB_MAP_blend_premultiplied(out, bg, fg);
+        else
+            ARGB_MAP_blend_mul_global(out, bg, fg, 1.0);
         return;
     }
 
-    for (y = 0, h = 0, offs = 0; y < fg->height; y += h) {
-        for (x = 0, l = 0; x < fg->width; x += l) {
-            if (l_max == l_min)
-                l = l_min;
-            else
-                l = l_min + PRN(seed_l)%(l_max-l_min);
-            if (x+l > fg->width)
-                l = fg->width - x;
-            for (i = 0; i < l; i++) {
-                line_buf[x+i] = ((ARGB_PIXEL*)fg->data)[offs+x];
-            }
+    INT rows = rand_pixelize_block_rows(fg->width, fg->height, l_min, l_max, seed_l, h_min, h_max, seed_h);
+    MAP_JOB job = {.out = out, .map0 = bg, .map1 = fg, .n = {l_min, l_max}, .data = map_filter_row_buffer};
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, out->height-1);
+    parallel_rows(rand_pixelize_blend_rows, &job, rows, 3*h_min*fg->width*sizeof(ARGB_PIXEL));
+}
+
+static void scale_nearest_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *in = job->map0;
+    const INT *col = job->data;
+    INT x, y, sy, prev_sy = -1;
+    ARGB_PIXEL *out_ptr, *in_row;
+
+    for (y = y0; y < y1; y++) {
+        out_ptr = MAP_ROW(out, y);
+        sy = (INT)(((int64_t)(2*y + 1)*in->height)/(2*out->height));
+        if (sy == prev_sy) {
+            memcpy(out_ptr, out_ptr - out->stride, out->width*sizeof(ARGB_PIXEL));
+            continue;
         }
+        in_row = MAP_ROW(in, sy);
+        for (x = 0; x < out->width; x++)
+            out_ptr[x] = in_row[col[x]];
+        prev_sy = sy;
+    }
+}
 
-        if (h_max == h_min)
-            h = h_min;
-        else
-            h = h_min + PRN(seed_h)%(h_max-h_min);
-        if (y+h > fg->height)
-            h = fg->height - y;
-        for (i = 0; i < h; i++) {
-            for (x = 0; x < fg->width; x++, offs++) {
-                pixval = line_buf[x];
-                Af = ARGB_PIXEL_ALPHA(pixval);
-                if (Af > 0) {
-                    Rf = (ARGB_PIXEL_RED(pixval)*Af >> 8) << R_SHIFT;
-                    Gf = (ARGB_PIXEL_GREEN(pixval)*Af >> 8) << G_SHIFT;
-                    Bf = (ARGB_PIXEL_BLUE(pixval)*Af >> 8) << B_SHIFT;
-                    pixval = ((ARGB_PIXEL*)bg->data)[offs];
-                    Rb = (ARGB_PIXEL_RED(pixval)*(255-Af) >> 8) << R_SHIFT;
-                    Gb = (ARGB_PIXEL_GREEN(pixval)*(255-Af) >> 8) << G_SHIFT;
-                    Bb = (ARGB_PIXEL_BLUE(pixval)*(255-Af) >> 8) << B_SHIFT;
-                    ((ARGB_PIXEL*)out->data)[offs] = (Rb+Rf) | (Gb+Gf) | (Bb+Bf);
-                }
-                else {
-                    ((ARGB_PIXEL*)out->data)[offs] = ((ARGB_PIXEL*)bg->data)[offs];
-                }
+/*
+ Scale in map to dimensions of out map, with nearest neighbour sampling.
+ Source column of every output column is calculated once, rows are repeated with memcpy.
+*/
+void ARGB_MAP_scale_nearest(ARGB_MAP *out, ARGB_MAP *in) {
+    INT x;
+    INT *col = map_filter_row_buffer; //source column of every output column
+
+    if (in->width < 1 || in->height < 1) {
+        return;
+    }
+    else if (out->width == in->width && out->height == in->height) {
+        ARGB_MAP_copy(out, in);
+        return;
+    }
+
+    for (x = 0; x < out->width; x++)
+        col[x] = (INT)(((int64_t)(2*x + 1)*in->width)/(2*out->width));
+    MAP_JOB job = {.out = out, .map0 = in, .data = col};
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, out->height-1);
+    parallel_rows(scale_nearest_rows, &job, out->height, 2*out->width*sizeof(ARGB_PIXEL));
+}
+
+//Source row scaled horizontally to out_row, with bilinear filtering (see ARGB_MAP_scale_bilinear())
+static void scale_bilinear_row(ARGB_PIXEL *out_row, const ARGB_PIXEL *in_row, const INT *col, const INT *fx, INT width) {
+    for (INT x = 0; x < width; x++)
+        out_row[x] = fx[x] == 0 ? in_row[col[x]] : ARGB_LERP(in_row[col[x]], in_row[col[x]+1], fx[x]);
+}
+
+static void scale_bilinear_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *out = job->out, *in = job->map0;
+    const INT *col = job->data; //left source column of every output column
+    const INT *fx = col + out->width; //weight of the right source column
+    //Source rows scaled horizontally, reused by all output rows between them
+    ARGB_PIXEL *h0 = (ARGB_PIXEL*)WORKER_BUFFER(worker), *h1 = h0 + out->width, *tmp;
+    INT y, s, sy, fy, h0_sy = -1, h1_sy = -1;
+    ARGB_PIXEL *out_ptr;
+
+    for (y = y0; y < y1; y++) {
+        s = (INT)(((int64_t)(2*y + 1)*in->height << 7)/out->height) - 128;
+        s = s < 0 ? 0 : s;
+        sy = s >> 8;
+        fy = s & 0xFF;
+        if (sy >= in->height - 1) {
+            sy = in->height - 1;
+            fy = 0;
+        }
+        if (h0_sy != sy) {
+            if (h1_sy == sy) {
+                tmp = h0;    h0 = h1;    h1 = tmp;
+                h1_sy = h0_sy;
+            }
+            else {
+                scale_bilinear_row(h0, MAP_ROW(in, sy), col, fx, out->width);
             }
+            h0_sy = sy;
+        }
+        out_ptr = MAP_ROW(out, y);
+        if (fy == 0) {
+            memcpy(out_ptr, h0, out->width*sizeof(ARGB_PIXEL));
+            continue;
+        }
+        if (h1_sy != sy + 1) {
+            scale_bilinear_row(h1, MAP_ROW(in, sy + 1), col, fx, out->width);
+            h1_sy = sy + 1;
+        }
+        lerp_row(out_ptr, h0, h1, fy, out->width);
+    }
+}
+
+/*
+ Scale in map to dimensions of out map, with bilinear filtering. Pixel centers of both maps are aligned.
+ 8 bit weights of source columns are calculated once. Source rows are interpolated horizontally once
+ per band (ARGB_LERP() of channel pairs), output rows are vector interpolated between them (lerp_row()).
+*/
+void ARGB_MAP_scale_bilinear(ARGB_MAP *out, ARGB_MAP *in) {
+    INT x, s;
+    INT *col = map_filter_row_buffer; //left source column of every output column
+    INT *fx = map_filter_row_buffer + out->width; //weight of the right source column
+
+    if (in->width < 1 || in->height < 1) {
+        return;
+    }
+    else if (out->width == in->width && out->height == in->height) {
+        ARGB_MAP_copy(out, in);
+        return;
+    }
+
+    //Source coordinate of the output pixel center, in 1/256 of pixel: (x + 0.5)*in/out - 0.5
+    for (x = 0; x < out->width; x++) {
+        s = (INT)(((int64_t)(2*x + 1)*in->width << 7)/out->width) - 128;
+        s = s < 0 ? 0 : s;
+        col[x] = s >> 8;
+        fx[x] = s & 0xFF;
+        if (col[x] >= in->width - 1) {
+            col[x] = in->width - 1;
+            fx[x] = 0;
         }
     }
+    MAP_JOB job = {.out = out, .map0 = in, .data = col};
+    map_graph_flush();
+    ARGB_MAP_mark_dirty(out, 0, 0, out->width-1, out->height-1);
+    parallel_rows(scale_bilinear_rows, &job, out->height, 3*out->width*sizeof(ARGB_PIXEL));
 }
@@ -32,6 +32,28 @@ void map_generator_cleanup() {
     DISCRETE_GRADIENT_free(map_gen_dg_256);
 }
 
+/*
+ Generators are executed in row bands (see parallel_rows(), map_graph_rows()), tables are prepared before.
+ Plasma tables: sin1, sin2_x, sin2_y and the discrete gradient, one after another in map_gen_buffer.
+*/
+static void plasma_rows(MAP_JOB *job, INT r0, INT r1, INT worker) {
+    ARGB_MAP *map = job->out;
+    const INT x0 = job->n[0], y0 = job->n[1];
+    INT *sin1 = job->data;
+    INT *sin2_x = sin1 + job->n[2];
+    INT *sin2_y = sin2_x + job->n[3];
+    ARGB_PIXEL *pixval = (ARGB_PIXEL*)(sin2_y + map->height);
+    INT x = 0, y = 0, sin2_y_b = 0;
+    ARGB_PIXEL *row;
+
+    for(y=y0+r0; y < y0+r1; y++) {
+        sin2_y_b = x0+sin2_y[y-y0];
+        row = MAP_ROW(map, y-y0);
+        for(x=0; x < map->width; x++)
+            row[x] = pixval[sin1[y+sin2_x[x]] + sin1[x+sin2_y_b]];
+    }
+}
+
 /**
  * @brief Rasterize sine plasma pattern using provided color gradient
  * Rasterize sine plasma pattern using provided color gradient
@@ -47,7 +69,7 @@ void map_generator_cleanup() {
  * @param yo Phase of Y deformation sine wave [0.0 - 1.0]
  */
 void ARGB_MAP_plasma_pattern(ARGB_MAP *map, GRADIENT *g, FLOAT scale, FLOAT s2xA, FLOAT s2xT, FLOAT xo, FLOAT s2yA, FLOAT s2yT, FLOAT yo) {
-    INT i = 0, x = 0, y = 0, x0 = 0, y0 = 0, offs = 0, sin2_y_b = 0;
+    INT i = 0, x0 = 0, y0 = 0;
     DISCRETE_GRADIENT_from_GRADIENT(map_gen_dg_1024, g);
     const INT base_length = map->height > map->width ? map->height : map->width;
     const INT sin1_length = (s2xA+yo > s2yA+xo ? s2xA+1.0+yo : s2yA+1.0+xo) * base_length;
@@ -74,59 +96,91 @@ void ARGB_MAP_plasma_pattern(ARGB_MAP *map, GRADIENT *g, FLOAT scale, FLOAT s2xA
         sin2_y[i] = s2yA*(0.5*(sin(i*TWOPI/s2yT)+1.0));
     }
 
-    for(y=y0, offs=0; y < map->height+y0; y++) {
-        sin2_y_b = x0+sin2_y[y-y0];
-        for(x=0; x < map->width; x++, offs++)
-            ((ARGB_PIXEL*)map->data)[offs] = map_gen_dg_1024->pixval[sin1[y+sin2_x[x]] + sin1[x+sin2_y_b]];
+    //Sum of two sin1 values reaches the gradient length, last color is repeated after the gradient
+    memcpy(sin2_y + sin2y_length, map_gen_dg_1024->pixval, map_gen_dg_1024->length*sizeof(ARGB_PIXEL));
+    sin2_y[sin2y_length + map_gen_dg_1024->length] = map_gen_dg_1024->pixval[map_gen_dg_1024->length-1];
+
+    MAP_JOB job = {.out = map, .n = {x0, y0, sin1_length, sin2x_length}, .data = map_gen_buffer};
+    map_graph_rows(plasma_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL),
+        0, (sin1_length + sin2x_length + sin2y_length)*sizeof(INT) + (map_gen_dg_1024->length+1)*sizeof(ARGB_PIXEL));
+}
+
+static void vertical_pattern_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *map = job->out;
+    INT x=0, y=0;
+    ARGB_PIXEL pixval;
+    for(y=y0; y < y1; y++) {
+        pixval = GRADIENT_get_pixval(job->data, (FLOAT)y/(FLOAT)(map->height-1));
+        for(x=0; x < map->width; x++) {
+            MAP_ROW(map, y)[x] = pixval;
+        }
     }
 }
 
 void ARGB_MAP_vertical_pattern(ARGB_MAP *map, GRADIENT *g) {
-    INT x=0, y=0, offs=0;
-    ARGB_PIXEL pixval;
-    for(y=0, offs=0; y < map->height; y++) {
-        pixval = COLOR_to_ARGB_PIXEL(GRADIENT_get_value(g, (FLOAT)y/(FLOAT)(map->height-1)));
-        for(x=0; x < map->width; x++, offs++) {
-            ((ARGB_PIXEL*)map->data)[offs] = pixval;
+    MAP_JOB job = {.out = map, .data = g};
+    map_graph_rows(vertical_pattern_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL), 0, sizeof(GRADIENT));
+}
+
+static void horizontal_pattern_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *map = job->out;
+    INT x=0, y=0;
+    for(y=y0; y < y1; y++) {
+        for(x=0; x < map->width; x++) {
+            MAP_ROW(map, y)[x] = GRADIENT_get_pixval(job->data, (FLOAT)x/(FLOAT)(map->width-1));
         }
     }
 }
 
 void ARGB_MAP_horizontal_pattern(ARGB_MAP *map, GRADIENT *g) {
-    INT x=0, y=0, offs=0;
-    for(y=0, offs=0; y < map->height; y++) {
-        for(x=0; x < map->width; x++, offs++) {
-            ((ARGB_PIXEL*)map->data)[offs] = COLOR_to_ARGB_PIXEL(GRADIENT_get_value(g, (FLOAT)x/(FLOAT)(map->width-1)));
+    MAP_JOB job = {.out = map, .data = g};
+    map_graph_rows(horizontal_pattern_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL), 0, sizeof(GRADIENT));
+}
+
+static void diagonal_pattern_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *map = job->out;
+    INT x = 0, y = 0, xpy = map->width+map->height-2;
+    for(y = y0; y < y1; y++) {
+        for(x=0; x < map->width; x++) {
+            MAP_ROW(map, y)[x] = GRADIENT_get_pixval(job->data, (FLOAT)(x+y)/(FLOAT)(xpy));
         }
     }
 }
 
 void ARGB_MAP_diagonal_pattern(ARGB_MAP *map, GRADIENT *g) {
-    INT x = 0, y = 0, xpy = map->width+map->height-2, offs = 0;
-    for(y = 0, offs=0; y < map->height; y++) {
-        for(x=0; x < map->width; x++, offs++) {
-            ((ARGB_PIXEL*)map->data)[offs] = COLOR_to_ARGB_PIXEL(GRADIENT_get_value(g, (FLOAT)(x+y)/(FLOAT)(xpy)));
-        }
-    }
+    MAP_JOB job = {.out = map, .data = g};
+    map_graph_rows(diagonal_pattern_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL), 0, sizeof(GRADIENT));
 }
 
-void ARGB_MAP_radial_pattern(ARGB_MAP *map, GRADIENT *g, INT x0, INT y0) {
-    INT x=0, y=0, offs=0;
+static void radial_pattern_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *map = job->out;
+    const INT xc = job->n[0], yc = job->n[1];
+    INT x=0, y=0;
     FLOAT d = 0.0, r = map->width > map->height ? map->width/2. : map->height/2.;
-    for(y=0, offs=0; y < map->height; y++) {
-        for(x=0; x < map->width; x++, offs++) {
-            d = sqrt((x-x0)*(x-x0) + (y-y0)*(y-y0))/r;
-            ((ARGB_PIXEL*)map->data)[offs] = COLOR_to_ARGB_PIXEL(GRADIENT_get_value(g, d));
+    for(y=y0; y < y1; y++) {
+        for(x=0; x < map->width; x++) {
+            d = sqrt((x-xc)*(x-xc) + (y-yc)*(y-yc))/r;
+            MAP_ROW(map, y)[x] = GRADIENT_get_pixval(job->data, d);
         }
     }
 }
 
-void ARGB_MAP_xor_pattern(ARGB_MAP *map, GRADIENT *g) {
-    INT x=0, y=0, offs=0;
-    for(y=0, offs=0; y < map->height; y++) {
-        for(x=0; x < map->width; x++, offs++) {
-            ((ARGB_PIXEL*)map->data)[offs] = COLOR_to_ARGB_PIXEL(GRADIENT_get_value(g, (FLOAT)((x^y)&255)/255.0));
+void ARGB_MAP_radial_pattern(ARGB_MAP *map, GRADIENT *g, INT x0, INT y0) {
+    MAP_JOB job = {.out = map, .n = {x0, y0}, .data = g};
+    map_graph_rows(radial_pattern_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL), 0, sizeof(GRADIENT));
+}
+
+static void xor_pattern_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    ARGB_MAP *map = job->out;
+    INT x=0, y=0;
+    for(y=y0; y < y1; y++) {
+        for(x=0; x < map->width; x++) {
+            MAP_ROW(map, y)[x] = GRADIENT_get_pixval(job->data, (FLOAT)((x^y)&255)/255.0);
         }
     }
 }
 
+void ARGB_MAP_xor_pattern(ARGB_MAP *map, GRADIENT *g) {
+    MAP_JOB job = {.out = map, .data = g};
+    map_graph_rows(xor_pattern_rows, &job, map->height, map->width*sizeof(ARGB_PIXEL), 0, sizeof(GRADIENT));
+}
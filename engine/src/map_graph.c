@@ -0,0 +1,179 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "engine.h"
+
+/*
+ Deferred compositing of map operations.
+ When deferred mode is on, row band operations (layering, generators, row filters) are not executed
+ immediately, but recorded as graph nodes. map_graph_flush() (called by display_show()) executes all
+ recorded nodes in one pass over tiles of rows sized to half of L2 cache: every node processes the tile
+ before the next tile is started, so maps written and read by consecutive nodes stay in cache.
+ Operation tables are copied when recorded, map pointers are used at flush time.
+
+ Filters reading rows below the processed row (halo) lag behind preceding nodes by their halo, so rows
+ they read are already produced. Graphs with such lag are executed by the calling thread only,
+ graphs of point-wise operations are split between parallel_rows() workers.
+ Maps written by recorded operations must not be accessed by other code before the flush.
+ Engine code writing map pixels directly (rasterizers, RENDER_BUFFER initialization) flushes first.
+*/
+typedef struct {
+    PARALLEL_ROWS_FUNC func;
+    MAP_JOB job;
+    INT y0, y1; //rows of the operation to execute
+    INT lag; //number of rows the node is behind the first node, sum of halos of this and preceding nodes
+} MAP_GRAPH_NODE;
+
+static MAP_GRAPH_NODE nodes[MAP_GRAPH_MAX_NODES];
+static INT nodes_cnt = 0;
+static INT row_bytes_sum = 0;
+static uint8_t *graph_data = NULL;
+static INT graph_data_used = 0;
+static INT tile_rows = 1;
+static bool deferred = false;
+static bool flushing = false;
+
+void map_graph_init() {
+    graph_data = malloc(MAP_GRAPH_DATA_SIZE);
+}
+
+void map_graph_cleanup() {
+    map_graph_flush();
+    free(graph_data);
+    graph_data = NULL;
+}
+
+/*
+ Switch deferred mode on/off. Operations recorded so far are executed when it is switched off.
+*/
+void map_graph_defer(bool on) {
+    if (!on)
+        map_graph_flush();
+    deferred = on;
+}
+
+bool map_graph_deferred() {
+    return deferred;
+}
+
+static void graph_rows(MAP_JOB *unused, INT y0, INT y1, INT worker) {
+    INT i, y, ye, r0, r1;
+    for (y = y0; y < y1; y = ye) {
+        ye = y + tile_rows < y1 ? y + tile_rows : y1;
+        for (i = 0; i < nodes_cnt; i++) {
+            r0 = y - nodes[i].lag;
+            r1 = ye - nodes[i].lag;
+            r0 = r0 < nodes[i].y0 ? nodes[i].y0 : r0;
+            r1 = r1 > nodes[i].y1 ? nodes[i].y1 : r1;
+            if (r0 < r1)
+                nodes[i].func(&nodes[i].job, r0, r1, worker);
+        }
+    }
+}
+
+/*
+ Execute all recorded operations.
+*/
+void map_graph_flush() {
+    INT i, height = 0;
+    if (nodes_cnt == 0 || flushing)
+        return;
+    flushing = true;
+    for (i = 0; i < nodes_cnt; i++) {
+        if (nodes[i].y1 + nodes[i].lag > height)
+            height = nodes[i].y1 + nodes[i].lag;
+    }
+    tile_rows = PARALLEL_L2_SIZE/2/(row_bytes_sum > 0 ? row_bytes_sum : 1);
+    if (tile_rows < 1)
+        tile_rows = 1;
+    if (nodes[nodes_cnt-1].lag == 0)
+        parallel_rows(graph_rows, NULL, height, row_bytes_sum);
+    else
+        graph_rows(NULL, 0, height, 0);
+    nodes_cnt = 0;
+    row_bytes_sum = 0;
+    graph_data_used = 0;
+    flushing = false;
+}
+
+//FNV-1a hash of bytes
+static UINT hash_bytes(UINT h, const void *data, INT size) {
+    const uint8_t *ptr = data;
+    for (INT i = 0; i < size; i++)
+        h = (h ^ ptr[i]) * 16777619u;
+    return h;
+}
+
+/*
+ Hash of map operation function and parameters, for dirty tiles tracking (see ARGB_MAP_dirty_rows()).
+ Returns 0 if job->data is not copied: tables it points to can change without changing the pointer.
+*/
+static UINT op_hash(PARALLEL_ROWS_FUNC func, MAP_JOB *job, INT halo, INT data_size) {
+    UINT h = 2166136261u;
+    if (job->data != NULL && data_size == 0)
+        return 0;
+    h = hash_bytes(h, &func, sizeof(func));
+    h = hash_bytes(h, &job->out, sizeof(job->out));
+    h = hash_bytes(h, &job->map0, sizeof(job->map0));
+    h = hash_bytes(h, &job->map1, sizeof(job->map1));
+    h = hash_bytes(h, &job->p, sizeof(job->p));
+    h = hash_bytes(h, &job->pixval, sizeof(job->pixval));
+    h = hash_bytes(h, job->n, sizeof(job->n));
+    h = hash_bytes(h, job->f, sizeof(job->f));
+    h = hash_bytes(h, &job->dither_x, sizeof(job->dither_x));
+    h = hash_bytes(h, &job->dither_y, sizeof(job->dither_y));
+    h = hash_bytes(h, &halo, sizeof(halo));
+    if (data_size > 0)
+        h = hash_bytes(h, job->data, data_size);
+    return h != 0 ? h : 1;
+}
+
+/*
+ Execute rows 0..height-1 of a map operation with parallel_rows(), or record it when deferred mode is on.
+ halo: number of rows below the processed row read by func from its input maps.
+ data_size: number of bytes of job->data copied when recorded, 0 if job->data pointer is kept.
+ If job->out has dirty tiles tracking on, rows not changed since the last execution of the same
+ operation are skipped (see ARGB_MAP_dirty_rows()).
+*/
+void map_graph_rows(PARALLEL_ROWS_FUNC func, MAP_JOB *job, INT height, INT row_bytes, INT halo, INT data_size) {
+    MAP_GRAPH_NODE *node;
+    INT y0, y1;
+    ARGB_MAP_dirty_rows(job, job->out->dirty != NULL ? op_hash(func, job, halo, data_size) : 0,
+        height, halo, &y0, &y1);
+    if (y0 >= y1)
+        return;
+    if (!deferred || flushing || data_size > MAP_GRAPH_DATA_SIZE) {
+        map_graph_flush();
+        parallel_rows_range(func, job, y0, y1, row_bytes);
+        return;
+    }
+    if (nodes_cnt == MAP_GRAPH_MAX_NODES || graph_data_used + data_size > MAP_GRAPH_DATA_SIZE)
+        map_graph_flush();
+
+    node = &nodes[nodes_cnt];
+    node->func = func;
+    node->job = *job;
+    node->y0 = y0;
+    node->y1 = y1;
+    node->lag = (nodes_cnt > 0 ? nodes[nodes_cnt-1].lag : 0) + halo;
+    if (data_size > 0) {
+        memcpy(graph_data + graph_data_used, job->data, data_size);
+        node->job.data = graph_data + graph_data_used;
+        graph_data_used += (data_size + 15) & ~15;
+    }
+    row_bytes_sum += row_bytes;
+    nodes_cnt++;
+}
@@ -0,0 +1,186 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "engine.h"
+
+/*
+ Pool of released maps and render buffers. ..._acquire() takes a pooled entry of the requested
+ dimensions (and Z buffer format) if there is one, and allocates a new one otherwise.
+ Reused buffers skip calloc of fresh pages, and zeroing too when the caller doesn't need it.
+ Entries acquired with ..._acquire_frame() are released by map_pool_end_frame(), called by display_show().
+*/
+static ARGB_MAP *pool_maps[MAP_POOL_MAX_ENTRIES];
+static RENDER_BUFFER *pool_bufs[MAP_POOL_MAX_ENTRIES];
+static INT pool_maps_cnt = 0, pool_bufs_cnt = 0;
+static size_t pool_bytes = 0; //pixels and Z kept in the pool
+static ARGB_MAP *frame_maps[MAP_POOL_MAX_FRAME];
+static RENDER_BUFFER *frame_bufs[MAP_POOL_MAX_FRAME];
+static INT frame_maps_cnt = 0, frame_bufs_cnt = 0;
+
+static size_t map_bytes(ARGB_MAP *map) {
+    return (size_t)map->stride*map->height_with_margin*sizeof(ARGB_PIXEL);
+}
+
+static INT z_format(RENDER_BUFFER *buf) {
+    if (buf->z == NULL)
+        return Z_BUFFER_OFF;
+    return buf->z->data16 != NULL ? Z_BUFFER_ON_16 : Z_BUFFER_ON;
+}
+
+static size_t buf_bytes(RENDER_BUFFER *buf) {
+    size_t bytes = map_bytes(buf->map);
+    if (buf->z != NULL)
+        bytes += (size_t)buf->z->stride*buf->alloc_height*(buf->z->data16 != NULL ? sizeof(Z16_PIXEL) : sizeof(Z_PIXEL));
+    return bytes;
+}
+
+void map_pool_init() {
+    pool_maps_cnt = pool_bufs_cnt = 0;
+    frame_maps_cnt = frame_bufs_cnt = 0;
+    pool_bytes = 0;
+}
+
+void map_pool_cleanup() {
+    map_pool_end_frame();
+    map_pool_trim();
+}
+
+/*
+ Free all pooled maps and render buffers (acquired ones are not affected).
+*/
+void map_pool_trim() {
+    while (pool_maps_cnt > 0)
+        ARGB_MAP_free(pool_maps[--pool_maps_cnt]);
+    while (pool_bufs_cnt > 0)
+        RENDER_BUFFER_free(pool_bufs[--pool_bufs_cnt]);
+    pool_bytes = 0;
+}
+
+/*
+ Release all maps and render buffers acquired for the current frame.
+*/
+void map_pool_end_frame() {
+    while (frame_maps_cnt > 0)
+        ARGB_MAP_release(frame_maps[--frame_maps_cnt]);
+    while (frame_bufs_cnt > 0)
+        RENDER_BUFFER_release(frame_bufs[--frame_bufs_cnt]);
+}
+
+/*
+ Map of width x height pixels (no wrap margin), taken from the pool if possible.
+ zero: if true, pixels are cleared, otherwise pixels of a reused map are undefined.
+*/
+ARGB_MAP *ARGB_MAP_acquire(INT width, INT height, bool zero) {
+    for (INT i = pool_maps_cnt-1; i >= 0; i--) {
+        ARGB_MAP *map = pool_maps[i];
+        if (map->width == width && map->height == height) {
+            pool_maps[i] = pool_maps[--pool_maps_cnt];
+            pool_bytes -= map_bytes(map);
+            if (zero)
+                ARGB_MAP_clear(map);
+            return map;
+        }
+    }
+    return ARGB_MAP_alloc(width, height, 0); //calloc, already zeroed
+}
+
+/*
+ ARGB_MAP_acquire() of a map released automatically at the end of the frame (display_show()).
+ Returns NULL if MAP_POOL_MAX_FRAME maps are already acquired for the frame.
+*/
+ARGB_MAP *ARGB_MAP_acquire_frame(INT width, INT height, bool zero) {
+    if (frame_maps_cnt >= MAP_POOL_MAX_FRAME)
+        return NULL;
+    return frame_maps[frame_maps_cnt++] = ARGB_MAP_acquire(width, height, zero);
+}
+
+/*
+ Return the map to the pool. Views, tiled maps, maps with wrap margin and maps not fitting
+ in the pool are freed.
+*/
+void ARGB_MAP_release(ARGB_MAP *map) {
+    if (map == NULL)
+        return;
+    if (map->storage == NULL || map->tiled || map->height_with_margin != map->height ||
+        pool_maps_cnt >= MAP_POOL_MAX_ENTRIES || pool_bytes + map_bytes(map) > MAP_POOL_MAX_BYTES) {
+        ARGB_MAP_free(map);
+        return;
+    }
+    map_graph_flush(); //map may be used by deferred operations
+    ARGB_MAP_free(map->mip);
+    map->mip = NULL;
+    ARGB_MAP_track_dirty(map, false);
+    map->premultiplied = false;
+    pool_maps[pool_maps_cnt++] = map;
+    pool_bytes += map_bytes(map);
+}
+
+/*
+ Render buffer of width x height pixels with Z buffer z_buf_on (as in RENDER_BUFFER_alloc()),
+ taken from the pool if possible.
+ zero: if true, color and Z buffer are cleared, otherwise contents of a reused buffer are undefined.
+*/
+RENDER_BUFFER *RENDER_BUFFER_acquire(INT width, INT height, INT z_buf_on, bool zero) {
+    if (z_buf_on != Z_BUFFER_ON && z_buf_on != Z_BUFFER_ON_16)
+        z_buf_on = Z_BUFFER_OFF;
+    for (INT i = pool_bufs_cnt-1; i >= 0; i--) {
+        RENDER_BUFFER *buf = pool_bufs[i];
+        if (buf->width == width && buf->height == height && z_format(buf) == z_buf_on) {
+            pool_bufs[i] = pool_bufs[--pool_bufs_cnt];
+            pool_bytes -= buf_bytes(buf);
+            if (zero)
+                RENDER_BUFFER_zero(buf);
+            return buf;
+        }
+    }
+    return RENDER_BUFFER_alloc(width, height, z_buf_on);
+}
+
+/*
+ RENDER_BUFFER_acquire() of a buffer released automatically at the end of the frame (display_show()).
+ Returns NULL if MAP_POOL_MAX_FRAME buffers are already acquired for the frame.
+*/
+RENDER_BUFFER *RENDER_BUFFER_acquire_frame(INT width, INT height, INT z_buf_on, bool zero) {
+    if (frame_bufs_cnt >= MAP_POOL_MAX_FRAME)
+        return NULL;
+    return frame_bufs[frame_bufs_cnt++] = RENDER_BUFFER_acquire(width, height, z_buf_on, zero);
+}
+
+/*
+ Return the render buffer to the pool, with its allocated dimensions restored.
+ Buffers not fitting in the pool are freed.
+*/
+void RENDER_BUFFER_release(RENDER_BUFFER *buf) {
+    if (buf == NULL)
+        return;
+    map_graph_flush(); //buffer may be used by deferred operations
+    RENDER_BUFFER_set_size(buf, buf->alloc_width, buf->alloc_height); //buf_bytes() counts the allocated size
+    if (pool_bufs_cnt >= MAP_POOL_MAX_ENTRIES || pool_bytes + buf_bytes(buf) > MAP_POOL_MAX_BYTES) {
+        RENDER_BUFFER_free(buf);
+        return;
+    }
+    ARGB_MAP_free(buf->map->mip);
+    buf->map->mip = NULL;
+    ARGB_MAP_track_dirty(buf->map, false);
+    buf->map->premultiplied = false;
+    buf->background = NULL;
+    if (buf->z != NULL) {
+        buf->z->epoch_on = false;
+        buf->z->epoch = 0;
+    }
+    pool_bufs[pool_bufs_cnt++] = buf;
+    pool_bytes += buf_bytes(buf);
+}
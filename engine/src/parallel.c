@@ -0,0 +1,158 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+
+#include "engine.h"
+
+/*
+ Thread pool executing full map operations in horizontal row bands.
+ Worker 0 is the calling thread, workers 1..workers_cnt-1 are pool threads waiting on start_sem.
+ Bands are taken by workers in order from the shared job_next counter until all rows are done.
+*/
+static SDL_Thread *workers[PARALLEL_MAX_WORKERS];
+static INT workers_cnt = 1;
+static INT workers_limit = 0; //workers executing bands, 0: all, see parallel_limit()
+static SDL_sem *start_sem = NULL, *done_sem = NULL;
+static bool parallel_on = true;
+static bool job_running = false;
+static bool quit = false;
+
+static PARALLEL_ROWS_FUNC job_func = NULL;
+static MAP_JOB *job_ctx = NULL;
+static INT job_end = 0, job_band = 0;
+static SDL_atomic_t job_next;
+
+static void run_bands(INT worker) {
+    INT y0;
+    while ((y0 = SDL_AtomicAdd(&job_next, job_band)) < job_end)
+        job_func(job_ctx, y0, y0 + job_band < job_end ? y0 + job_band : job_end, worker);
+}
+
+static int worker_main(void *data) {
+    INT worker = (INT)(intptr_t)data;
+    while (1) {
+        SDL_SemWait(start_sem);
+        if (quit)
+            break;
+        run_bands(worker);
+        SDL_SemPost(done_sem);
+    }
+    return 0;
+}
+
+/*
+ Start the thread pool. workers: total number of workers, 0 for the number of CPU cores.
+*/
+void parallel_init(INT workers_req) {
+    INT i;
+    if (workers_req < 1)
+        workers_req = SDL_GetCPUCount();
+    if (workers_req > PARALLEL_MAX_WORKERS)
+        workers_req = PARALLEL_MAX_WORKERS;
+    workers_cnt = 1;
+    quit = false;
+    if (workers_req < 2)
+        return;
+    start_sem = SDL_CreateSemaphore(0);
+    done_sem = SDL_CreateSemaphore(0);
+    for (i = 1; i < workers_req; i++) {
+        workers[i] = SDL_CreateThread(worker_main, "map worker", (void*)(intptr_t)i);
+        if (workers[i] == NULL)
+            break;
+        workers_cnt++;
+    }
+}
+
+void parallel_cleanup() {
+    INT i;
+    quit = true;
+    for (i = 1; i < workers_cnt; i++)
+        SDL_SemPost(start_sem);
+    for (i = 1; i < workers_cnt; i++)
+        SDL_WaitThread(workers[i], NULL);
+    if (start_sem != NULL) {
+        SDL_DestroySemaphore(start_sem);
+        SDL_DestroySemaphore(done_sem);
+    }
+    start_sem = done_sem = NULL;
+    workers_cnt = 1;
+}
+
+/*
+ Global switch: when off, all map operations are executed on the calling thread.
+*/
+void parallel_enable(bool on) {
+    parallel_on = on;
+}
+
+bool parallel_enabled() {
+    return parallel_on;
+}
+
+/*
+ Limit the number of workers executing bands to workers (calling thread included, up to the pool size),
+ 0 for all of them. Remaining pool threads stay idle. Used to measure scaling of map operations.
+*/
+void parallel_limit(INT workers) {
+    workers_limit = workers;
+}
+
+/*
+ Number of workers which may execute bands concurrently (size of per worker scratch buffers).
+*/
+INT parallel_workers() {
+    return workers_cnt;
+}
+
+/*
+ Execute func for all rows 0..height-1, split into bands of about PARALLEL_L2_SIZE/2 bytes.
+ row_bytes: bytes of all maps read or written per row.
+ Returns when all bands are done. func must not start other parallel operations: such nested call
+ would be executed serially as worker 0.
+*/
+void parallel_rows(PARALLEL_ROWS_FUNC func, MAP_JOB *job, INT height, INT row_bytes) {
+    parallel_rows_range(func, job, 0, height, row_bytes);
+}
+
+/*
+ parallel_rows() for rows y0..y1-1 only.
+*/
+void parallel_rows_range(PARALLEL_ROWS_FUNC func, MAP_JOB *job, INT y0, INT y1, INT row_bytes) {
+    INT i, band = PARALLEL_L2_SIZE/2/(row_bytes > 0 ? row_bytes : 1);
+    INT active = workers_limit > 0 && workers_limit < workers_cnt ? workers_limit : workers_cnt;
+    if (band < 1)
+        band = 1;
+    if (y0 >= y1)
+        return;
+    if (!parallel_on || job_running || active < 2 || y1 - y0 <= band) {
+        func(job, y0, y1, 0);
+        return;
+    }
+    job_running = true;
+    job_func = func;
+    job_ctx = job;
+    job_end = y1;
+    job_band = band;
+    SDL_AtomicSet(&job_next, y0);
+    for (i = 1; i < active; i++)
+        SDL_SemPost(start_sem);
+    run_bands(0);
+    for (i = 1; i < active; i++)
+        SDL_SemWait(done_sem);
+    job_running = false;
+}
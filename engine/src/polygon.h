@@ -14,13 +14,32 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
+#if USE_Z && !USE_SPAN && !defined(POLYGON_Z_FORMAT)
+//Rasterizer is instantiated for both Z buffer formats (USE_Z16 selects 16 bit Z),
+//variant matching Z buffer of the current render buffer is run.
+#define POLYGON_Z_FORMAT
+    if (vzb16 != NULL) {
+#define USE_Z16 1
+#include "polygon.h"
+#undef USE_Z16
+    }
+    else {
+#include "polygon.h"
+    }
+#undef POLYGON_Z_FORMAT
+#else
+
     typedef struct {
         INT x;
 #if USE_Z
         INT z;
 #endif
 #if USE_MAP_BASE
+    #if USE_PERSP
+        FLOAT ubw, vbw, w; //u/w, v/w, 1/w
+    #else
         INT ub, vb;
+    #endif
     #if USE_INTERP
         #if USE_DIFF
         INT rd, gd, bd;
@@ -49,23 +68,54 @@
 
     INT x, x1, dx;
     INT y, y1, dy;
+    INT yr, yr1; //first and last pixel row of the edge
+    INT ystep; //subpixel distance from the edge beginning to the center of its first row
+#if !USE_Z_ONLY
     ARGB_PIXEL pix_val; //final pixel value
+#endif
     INT bar_length;
 
 #if USE_Z
+    #if USE_Z16
+    Z16_PIXEL *zbuf_ptr = NULL;
+    #else
     Z_PIXEL *zbuf_ptr = NULL;
+    #endif
     INT z, z1, dz; //Z buffer pixel value
+    #if !USE_SPAN
+    INT zmin; //minimum Z of the polygon/bar, for coarse Z buffer tests
+    #endif
 #endif
 
 #if USE_MAP_BASE
     #if USE_MAP_BUMP
-        BUMP_PIXEL *map_bs = mbase->data;
+        const BUMP_MAP *mlevel = mbase; //bump maps have no mipmaps
+        BUMP_PIXEL *map_bs = NULL;
     #else
-        ARGB_PIXEL *map_bs = mbase->data;
+        const ARGB_MAP *mlevel = mbase; //base map mipmap level used for the polygon
+        ARGB_PIXEL *map_bs = NULL;
     #endif
+    INT mip_level = 0;
     INT ub, ub1, dub; //U texture map coordinate
     INT vb, vb1, dvb; //V texture map coordinate
     INT vb_shift;
+    #if USE_PERSP
+        FLOAT ubw, ubw1, dubw; //U texture map coordinate divided by W
+        FLOAT vbw, vbw1, dvbw; //V texture map coordinate divided by W
+        FLOAT w, w1, dw; //1/W
+        FLOAT w_r, uf, vf; //W and exact U, V at the end of the bar section
+        INT ub_max, vb_max; //Limits of U, V texture map coordinates
+        FLOAT mip_scale; //Scale of map coordinates on the selected mipmap level
+        ARGB_PIXEL *end_bar_ptr = NULL;
+        INT section_length;
+    #endif
+    #if USE_BILINEAR
+        INT us, vs; //U, V relative to texel centers
+        INT tx0, tx1, ty0, ty1; //Coordinates of 4 texels around the sample point
+        INT u_wrap, ty_last, row_shift;
+        ARGB_PIXEL fu, fv; //8 bit interpolation weights
+        ARGB_PIXEL p00, p10, p01, p11;
+    #endif
     #if USE_MAP_MUL || USE_MAP_ADD || USE_MAP_BUMP
         //ASSUMPTION: map dimensions and coordinates are the same for "mul" and "add" maps
         INT ur, ur1, dur;
@@ -125,6 +175,8 @@
 //For flat shading without texture mapping calculate single value for every polygon pixel.
 #if USE_SOLID
     pix_val = COLOR_to_ARGB_PIXEL((COLOR*)color);
+#elif USE_ID
+    pix_val = id;
 #endif
 
 
@@ -145,28 +197,76 @@
         else if ((*vp[vrt1])[1] > ymax) {
             ymax = (*vp[vrt1])[1]; ymax_v = vrt1; }
     }
+    //Vertex coordinates are in subpixels. Only pixels with centers inside of the polygon
+    //are drawn, pixel centers lying exactly on the right or bottom edge are left for adjacent polygon.
+    xmin = SUBPIXEL_CEIL(xmin);
+    xmax = SUBPIXEL_CEIL(xmax) - 1;
+    ymin = SUBPIXEL_CEIL(ymin);
+    ymax = SUBPIXEL_CEIL(ymax) - 1;
 
-    // Skip drawing this polygon if it's outside of the screen or it's single horizontal line
-    if (xmax < 0 || xmin > vrb_width-1 || ymax < 0 || ymin > vrb_height-1 || ymin == ymax) return;
+    // Skip drawing this polygon if it's outside of the screen or it doesn't cover any pixel center
+    if (xmax < 0 || xmin > vrb_width-1 || ymax < 0 || ymin > vrb_height-1 || ymin > ymax) return;
     if (ymin < 0) ymin = 0;
     if (ymax > vrb_height-1) ymax = vrb_height-1;
 
+#if USE_Z && !USE_SPAN
+    //Skip drawing this polygon if it's behind already drawn geometry
+    zmin = (*vp[0])[2];
+    for (vrt1=1; vrt1<vcnt; vrt1++) {
+        if ((*vp[vrt1])[2] < zmin)
+            zmin = (*vp[vrt1])[2]; }
+    zmin = Z_KEY(zmin);
+    #if USE_Z_EQUAL
+    //Only pixels with Z equal to Z from the pre-pass are drawn and Z buffer is not modified:
+    //tiles with maximum equal to polygon zmin can still contain visible pixels.
+    if (z_tiles_occluded(xmin, ymin, xmax, ymax, zmin - 1)) return;
+    #else
+    if (z_tiles_occluded(xmin, ymin, xmax, ymax, zmin)) return;
+    z_tiles_mark(xmin, ymin, xmax, ymax);
+    #endif
+#endif
+#if !USE_SPAN
+    ARGB_MAP_mark_dirty(vrm, xmin, ymin, xmax, ymax);
+#endif
+
 #if USE_MAP_BASE
+    #if !USE_MAP_BUMP
+        mlevel = map_mip_level(vcnt, vp, mbc, mbase, &mip_level);
+    #endif
+    map_bs = mlevel->data;
     //Calculate vb_shift: bit shift length for map v coordinate
-    //This number is derived from log_2 of texture width
+    //This number is derived from log_2 of texture row stride (bump map rows are not padded)
     vb_shift = FRACT_SHIFT;
-    INT t = mbase->width-1;
+    #if USE_MAP_BUMP
+        INT t = mlevel->width-1;
+    #else
+        INT t = mlevel->stride-1;
+    #endif
     while(t) {
         vb_shift--;
         t >>= 1; }
+    #if USE_BILINEAR
+        row_shift = FRACT_SHIFT - vb_shift;
+        u_wrap = mlevel->width - 1;
+        ty_last = mlevel->height_with_margin - 1;
+    #endif
+    #if USE_PERSP
+        mip_scale = 1./(1 << mip_level);
+        ub_max = (mlevel->width << FRACT_SHIFT) - 1;
+        #if USE_MAP_BUMP
+            vb_max = (mlevel->height << FRACT_SHIFT) - 1;
+        #else
+            vb_max = (mlevel->height_with_margin << FRACT_SHIFT) - 1;
+        #endif
+    #endif
     #if USE_MAP_MUL || USE_MAP_ADD || USE_MAP_BUMP
         vr_shift = FRACT_SHIFT;
         #if USE_MAP_MUL
-            t = mmul->width-1;
+            t = mmul->stride-1;
         #elif USE_MAP_ADD
-            t = madd->width-1;
+            t = madd->stride-1;
         #elif USE_MAP_BUMP
-            t = mref->width-1;
+            t = mref->stride-1;
         #endif
         while(t) {
             vr_shift--;
@@ -187,23 +287,39 @@
                 vrt2 -= vcnt;
             else if (vrt2 < 0)
                 vrt2 += vcnt;
-            x  = (*vp[vrt1])[0] << FRACT_SHIFT;
-            x1 = (*vp[vrt2])[0] << FRACT_SHIFT;
+            x  = (*vp[vrt1])[0] << (FRACT_SHIFT - SUBPIXEL_SHIFT);
+            x1 = (*vp[vrt2])[0] << (FRACT_SHIFT - SUBPIXEL_SHIFT);
+            dx = x1 - x;
             y  = (*vp[vrt1])[1];
             y1 = (*vp[vrt2])[1];
-            //Skip edges outside of the screen
-            if (y > vrb_height-1 || y1 < 0) continue;
+            //Rows with pixel centers between the edge ends (top-left fill convention)
+            yr  = SUBPIXEL_CEIL(y);
+            yr1 = SUBPIXEL_CEIL(y1) - 1;
+            //Skip edges outside of the screen or not crossing any pixel center
+            if (yr > yr1 || yr > vrb_height-1 || yr1 < 0) continue;
 #if USE_Z
-            z  = (*vp[vrt1])[2];    z1 = (*vp[vrt2])[2];
+            z  = Z_KEY((*vp[vrt1])[2]);    z1 = Z_KEY((*vp[vrt2])[2]);
             dz = z1 - z;
 #endif
 #if USE_MAP_BASE
-            ub  = mbc[vrt1].u << FRACT_SHIFT;
-            vb  = mbc[vrt1].v << FRACT_SHIFT;
-            ub1 = mbc[vrt2].u << FRACT_SHIFT;
-            vb1 = mbc[vrt2].v << FRACT_SHIFT;
+    #if USE_PERSP
+            //Half pixel offset is included here, in the map space
+            w    = vw[vrt1];    w1 = vw[vrt2];
+            ubw  = (mbc[vrt1].u + 0.5)*mip_scale*w;
+            vbw  = (mbc[vrt1].v + 0.5)*mip_scale*w;
+            ubw1 = (mbc[vrt2].u + 0.5)*mip_scale*w1;
+            vbw1 = (mbc[vrt2].v + 0.5)*mip_scale*w1;
+            dubw = ubw1 - ubw;
+            dvbw = vbw1 - vbw;
+            dw = w1 - w;
+    #else
+            ub  = (mbc[vrt1].u << FRACT_SHIFT) >> mip_level;
+            vb  = (mbc[vrt1].v << FRACT_SHIFT) >> mip_level;
+            ub1 = (mbc[vrt2].u << FRACT_SHIFT) >> mip_level;
+            vb1 = (mbc[vrt2].v << FRACT_SHIFT) >> mip_level;
             dub = ub1 - ub;
             dvb = vb1 - vb;
+    #endif
     #if USE_INTERP
         #if USE_DIFF
             rd  = (INT)(255.*(*vdiff[vrt1]).r) << FRACT_SHIFT;
@@ -247,44 +363,13 @@
             dr = r1 - r;
             dg = g1 - g;
             db = b1 - b;
-#endif
-            dx = x1 - x;    dy = y1 - y;
-            if (dy != 0) {
-                dx /= dy;
-#if USE_Z
-                dz /= dy;
 #endif
 #if USE_MAP_BASE
-                dub /= dy;
-                dvb /= dy;
-    #if USE_INTERP
-        #if USE_DIFF
-                drd /= dy;
-                dgd /= dy;
-                dbd /= dy;
-        #endif
-        #if USE_SPEC
-                drs /= dy;
-                dgs /= dy;
-                dbs /= dy;
-        #endif
-    #else
-        #if USE_MAP_MUL || USE_MAP_ADD || USE_MAP_BUMP
-                dur /= dy;
-                dvr /= dy;
-        #endif
+    #if !USE_PERSP
+            //Half pixel offset is scaled to the mipmap level, like map coordinates
+            ub += (1 << (FRACT_SHIFT-1)) >> mip_level;
+            vb += (1 << (FRACT_SHIFT-1)) >> mip_level;
     #endif
-#elif USE_INTERP //&& !USE_MAP_BASE
-                dr /= dy;
-                dg /= dy;
-                db /= dy;
-#endif
-            }
-
-            x += (1 << (FRACT_SHIFT-1));
-#if USE_MAP_BASE
-            ub += (1 << (FRACT_SHIFT-1));
-            vb += (1 << (FRACT_SHIFT-1));
     #if USE_INTERP
         #if USE_DIFF
             rd += (1 << (FRACT_SHIFT-1));
@@ -308,129 +393,151 @@
             b += (1 << (FRACT_SHIFT-1));
 #endif
 
-            if (y < 0) { //y1>=0 assured above by if (y > vrb_height-1 || y1 < 0)
-                x += dx*-y;
+            //Step from the edge beginning to the center of its first drawn row
+            //(clipped with the top edge of the screen), in subpixels.
+            //Deltas are the whole edge changes here.
+            if (yr < 0) yr = 0;
+            ystep = yr*SUBPIXEL_SIZE + (SUBPIXEL_SIZE >> 1) - y;
+            dy = y1 - y; //edge height in subpixels
+            x += SUBPIXEL_STEP(dx, ystep, dy);
 #if USE_Z
-                z += dz*-y;
+            z += SUBPIXEL_STEP(dz, ystep, dy);
 #endif
 #if USE_MAP_BASE
-                ub += dub*-y;
-                vb += dvb*-y;
+    #if USE_PERSP
+            ubw += dubw*ystep/dy;
+            vbw += dvbw*ystep/dy;
+            w += dw*ystep/dy;
+    #else
+            ub += SUBPIXEL_STEP(dub, ystep, dy);
+            vb += SUBPIXEL_STEP(dvb, ystep, dy);
+    #endif
     #if USE_INTERP
         #if USE_DIFF
-                rd += drd*-y;
-                gd += dgd*-y;
-                bd += dbd*-y;
+            rd += SUBPIXEL_STEP(drd, ystep, dy);
+            gd += SUBPIXEL_STEP(dgd, ystep, dy);
+            bd += SUBPIXEL_STEP(dbd, ystep, dy);
         #endif
         #if USE_SPEC
-                rs += drs*-y;
-                gs += dgs*-y;
-                bs += dbs*-y;
+            rs += SUBPIXEL_STEP(drs, ystep, dy);
+            gs += SUBPIXEL_STEP(dgs, ystep, dy);
+            bs += SUBPIXEL_STEP(dbs, ystep, dy);
         #endif
     #else
         #if USE_MAP_MUL || USE_MAP_ADD || USE_MAP_BUMP
-                ur += dur*-y;
-                vr += dvr*-y;
+            ur += SUBPIXEL_STEP(dur, ystep, dy);
+            vr += SUBPIXEL_STEP(dvr, ystep, dy);
         #endif
     #endif
 #elif USE_INTERP //&& !USE_MAP_BASE
-                r += dr*-y;
-                g += dg*-y;
-                b += db*-y;
+            r += SUBPIXEL_STEP(dr, ystep, dy);
+            g += SUBPIXEL_STEP(dg, ystep, dy);
+            b += SUBPIXEL_STEP(db, ystep, dy);
 #endif
-                y = 0;
-            }
-
-            if (y1 > vrb_height-1) { //Clip the edge with the bottom edge of the screen
-                y1 = vrb_height-1; }
 
-            edge_ptr = polygon_edge + 2*y;
-            edge_end_ptr = polygon_edge + 2*y1;
-
-            if (e == RIGHT_EDGE) { //Right edge
-                //The right edge is stored in odd cells (2*y + 1, 3, 5, 7, ...) of polygon_edge
-                edge_ptr++;
-                edge_end_ptr++; }
-
-            // If there's more than one row to draw - store the first one
-            if (dy != 0) {
-                edge_ptr->x = x >> FRACT_SHIFT;
+            //Increments per pixel row (unused if the edge crosses one row only)
+            dx = SUBPIXEL_STEP(dx, SUBPIXEL_SIZE, dy);
 #if USE_Z
-                edge_ptr->z = z;
+            dz = SUBPIXEL_STEP(dz, SUBPIXEL_SIZE, dy);
 #endif
 #if USE_MAP_BASE
-                edge_ptr->ub = ub;
-                edge_ptr->vb = vb;
+    #if USE_PERSP
+            dubw = dubw*SUBPIXEL_SIZE/dy;
+            dvbw = dvbw*SUBPIXEL_SIZE/dy;
+            dw = dw*SUBPIXEL_SIZE/dy;
+    #else
+            dub = SUBPIXEL_STEP(dub, SUBPIXEL_SIZE, dy);
+            dvb = SUBPIXEL_STEP(dvb, SUBPIXEL_SIZE, dy);
+    #endif
     #if USE_INTERP
         #if USE_DIFF
-                edge_ptr->rd = rd;
-                edge_ptr->gd = gd;
-                edge_ptr->bd = bd;
+            drd = SUBPIXEL_STEP(drd, SUBPIXEL_SIZE, dy);
+            dgd = SUBPIXEL_STEP(dgd, SUBPIXEL_SIZE, dy);
+            dbd = SUBPIXEL_STEP(dbd, SUBPIXEL_SIZE, dy);
         #endif
         #if USE_SPEC
-                edge_ptr->rs = rs;
-                edge_ptr->gs = gs;
-                edge_ptr->bs = bs;
+            drs = SUBPIXEL_STEP(drs, SUBPIXEL_SIZE, dy);
+            dgs = SUBPIXEL_STEP(dgs, SUBPIXEL_SIZE, dy);
+            dbs = SUBPIXEL_STEP(dbs, SUBPIXEL_SIZE, dy);
         #endif
     #else
         #if USE_MAP_MUL || USE_MAP_ADD || USE_MAP_BUMP
-                edge_ptr->ur = ur;
-                edge_ptr->vr = vr;
+            dur = SUBPIXEL_STEP(dur, SUBPIXEL_SIZE, dy);
+            dvr = SUBPIXEL_STEP(dvr, SUBPIXEL_SIZE, dy);
         #endif
     #endif
 #elif USE_INTERP //&& !USE_MAP_BASE
-                edge_ptr->r = r;
-                edge_ptr->g = g;
-                edge_ptr->b = b;
+            dr = SUBPIXEL_STEP(dr, SUBPIXEL_SIZE, dy);
+            dg = SUBPIXEL_STEP(dg, SUBPIXEL_SIZE, dy);
+            db = SUBPIXEL_STEP(db, SUBPIXEL_SIZE, dy);
 #endif
-                edge_ptr += 2;
-            }
+
+            if (yr1 > vrb_height-1) { //Clip the edge with the bottom edge of the screen
+                yr1 = vrb_height-1; }
+
+            edge_ptr = polygon_edge + 2*yr;
+            edge_end_ptr = polygon_edge + 2*yr1;
+
+            if (e == RIGHT_EDGE) { //Right edge
+                //The right edge is stored in odd cells (2*y + 1, 3, 5, 7, ...) of polygon_edge
+                edge_ptr++;
+                edge_end_ptr++; }
 
             //Calculate whole edge between vrt1 and vrt2
             while (edge_ptr <= edge_end_ptr) {
+                //First pixel with center not less than edge X
+                edge_ptr->x = (x + (1 << (FRACT_SHIFT-1)) - 1) >> FRACT_SHIFT;
                 x += dx;
-                edge_ptr->x = x >> FRACT_SHIFT;
 #if USE_Z
-                z += dz;
                 edge_ptr->z = z;
+                z += dz;
 #endif
 #if USE_MAP_BASE
-                ub += dub;
-                vb += dvb;
+    #if USE_PERSP
+                edge_ptr->ubw = ubw;
+                edge_ptr->vbw = vbw;
+                edge_ptr->w = w;
+                ubw += dubw;
+                vbw += dvbw;
+                w += dw;
+    #else
                 edge_ptr->ub = ub;
                 edge_ptr->vb = vb;
+                ub += dub;
+                vb += dvb;
+    #endif
     #if USE_INTERP
         #if USE_DIFF
-                rd += drd;
-                gd += dgd;
-                bd += dbd;
                 edge_ptr->rd = rd;
                 edge_ptr->gd = gd;
                 edge_ptr->bd = bd;
+                rd += drd;
+                gd += dgd;
+                bd += dbd;
         #endif
         #if USE_SPEC
-                rs += drs;
-                gs += dgs;
-                bs += dbs;
                 edge_ptr->rs = rs;
                 edge_ptr->gs = gs;
                 edge_ptr->bs = bs;
+                rs += drs;
+                gs += dgs;
+                bs += dbs;
         #endif
     #else
         #if USE_MAP_MUL || USE_MAP_ADD || USE_MAP_BUMP
-                ur += dur;
-                vr += dvr;
                 edge_ptr->ur = ur;
                 edge_ptr->vr = vr;
+                ur += dur;
+                vr += dvr;
         #endif
     #endif
 #elif USE_INTERP //&& !USE_MAP_BASE
-                r += dr;
-                g += dg;
-                b += db;
                 edge_ptr->r = r;
                 edge_ptr->g = g;
                 edge_ptr->b = b;
+                r += dr;
+                g += dg;
+                b += db;
 #endif
                 edge_ptr += 2; }
         }
@@ -442,30 +549,39 @@
     //starting from the top(ymin), to the bottom one(ymax).
     edge_ptr = polygon_edge + 2*ymin;
     edge_end_ptr = polygon_edge + 2*ymax;
-    row_offset = ymin*vrb_width;
+    row_offset = ymin*vrb_stride;
     while (edge_ptr <= edge_end_ptr) {
+        //Right edge cell holds the first pixel right of the polygon
         x = edge_ptr[0].x;
-        x1 = edge_ptr[1].x;
+        x1 = edge_ptr[1].x - 1;
 
-        if (x1 >= 0 && x <= vrb_width -1) {
+        //Bars without pixel centers inside of the polygon are skipped
+        if (x1 >= x && x1 >= 0 && x <= vrb_width -1) {
             bar_length = x1 - x + 1;
-            if (bar_length < 1) {
-                //Apparently polygon is not fully planar. Skip drawing it.
-                //This might be also caused by coordinates roundoff inconsistencies.
-                return;
-            }
 #if USE_Z
             z  = edge_ptr[0].z;
             z1 = edge_ptr[1].z;
             dz = (z1 - z)/bar_length;
 #endif
 #if USE_MAP_BASE
+    #if USE_PERSP
+            ubw  = edge_ptr[0].ubw;
+            vbw  = edge_ptr[0].vbw;
+            w    = edge_ptr[0].w;
+            ubw1 = edge_ptr[1].ubw;
+            vbw1 = edge_ptr[1].vbw;
+            w1   = edge_ptr[1].w;
+            dubw = (ubw1 - ubw)/bar_length;
+            dvbw = (vbw1 - vbw)/bar_length;
+            dw = (w1 - w)/bar_length;
+    #else
             ub  = edge_ptr[0].ub;
             vb  = edge_ptr[0].vb;
             ub1 = edge_ptr[1].ub;
             vb1 = edge_ptr[1].vb;
             dub = (ub1 - ub)/bar_length;
             dvb = (vb1 - vb)/bar_length;
+    #endif
     #if USE_INTERP
         #if USE_DIFF
             rd  = edge_ptr[0].rd;
@@ -518,8 +634,14 @@
                 z += dz*-x;
 #endif
 #if USE_MAP_BASE
+    #if USE_PERSP
+                ubw += dubw*-x;
+                vbw += dvbw*-x;
+                w += dw*-x;
+    #else
                 ub += dub*-x;
                 vb += dvb*-x;
+    #endif
     #if USE_INTERP
         #if USE_DIFF
                 rd += drd*-x;
@@ -548,16 +670,79 @@
             if (x1 > vrb_width - 1) {
                 bar_length = vrb_width - x; //Adjust polygon bar length after clipping
             }
+#if USE_Z
+            y = (edge_ptr - polygon_edge) >> 1;
+    #if USE_SPAN
+            //Bar is only inserted into the span buffer, visible spans are drawn by SPAN_BUFFER_emit()
+            if (bar_length > 0)
+                SPAN_BUFFER_insert(vsb, y, x, x + bar_length - 1, z, dz, pix_val);
+            bar_length = 0;
+    #else
+            //Skip drawing the bar if it's behind already drawn geometry
+            zmin = dz < 0 ? z + dz*(bar_length-1) : z;
+        #if USE_Z_EQUAL
+            zmin--;
+        #endif
+            if (z_tiles_occluded(x, y, x + bar_length - 1, y, zmin)) {
+                bar_length = 0;
+            }
+    #endif
+#endif
 
             draw_ptr = vrb + row_offset + x;
 #if USE_Z
+    #if USE_Z16
+            zbuf_ptr = vzb16 + row_offset + x;
+    #else
             zbuf_ptr = vzb + row_offset + x;
+    #endif
 #endif
+#if USE_PERSP
+            //Exact U, V at the beginning of the bar
+            w_r = 1./w;
+            uf = ubw*w_r*(1 << FRACT_SHIFT);
+            vf = vbw*w_r*(1 << FRACT_SHIFT);
+            ub1 = PERSP_COORD(uf, ub_max);
+            vb1 = PERSP_COORD(vf, vb_max);
+            //Draw the bar in sections of PERSP_SPAN pixels. Exact U, V are calculated
+            //at the end of each section and interpolated linearly inside of it.
+            end_bar_ptr = draw_ptr + bar_length;
+            while (draw_ptr < end_bar_ptr) {
+            section_length = end_bar_ptr - draw_ptr;
+            if (section_length > PERSP_SPAN)
+                section_length = PERSP_SPAN;
+            ubw += dubw*section_length;
+            vbw += dvbw*section_length;
+            w += dw*section_length;
+            w_r = 1./w;
+            uf = ubw*w_r*(1 << FRACT_SHIFT);
+            vf = vbw*w_r*(1 << FRACT_SHIFT);
+            ub = ub1;
+            vb = vb1;
+            ub1 = PERSP_COORD(uf, ub_max);
+            vb1 = PERSP_COORD(vf, vb_max);
+            dub = (ub1 - ub)/section_length;
+            dvb = (vb1 - vb)/section_length;
+            end_draw_ptr = draw_ptr + section_length;
+#else
             end_draw_ptr = draw_ptr + bar_length;
+#endif
             while(draw_ptr < end_draw_ptr) {
 #if USE_Z
+    #if USE_Z16 && USE_Z_EQUAL
+                if (*zbuf_ptr == Z_TO_Z16(z)) {
+    #elif USE_Z16
+                if (*zbuf_ptr > Z_TO_Z16(z)) {
+                    *zbuf_ptr = Z_TO_Z16(z);
+    #elif USE_Z_EQUAL
+                if (*zbuf_ptr == (Z_PIXEL)z) {
+    #else
                 if (*zbuf_ptr > z) {
                     *zbuf_ptr = z;
+    #endif
+    #if defined(RENDER_STATS) && !USE_Z_ONLY && !USE_ID
+                    vr_overdraw.shaded++;
+    #endif
 #endif
 
 #if USE_MAP_BASE
@@ -572,6 +757,31 @@
                     vrc = vr+bv;
                     urc = ur+bu;
                     pix_val = map_r[(vrc&~FRACT_MASK)>>vr_shift | urc>>FRACT_SHIFT];
+    #elif USE_BILINEAR
+                    //Bilinear filtering. Texels wrap horizontally and are clamped vertically.
+                    us = ub - (1 << (FRACT_SHIFT-1));
+                    vs = vb - (1 << (FRACT_SHIFT-1));
+                    if (vs < 0) vs = 0;
+                    tx0 = (us >> FRACT_SHIFT) & u_wrap;
+                    tx1 = (tx0 + 1) & u_wrap;
+                    ty0 = vs >> FRACT_SHIFT;
+                    ty1 = ty0 < ty_last ? ty0 + 1 : ty0;
+                    fu = (us & FRACT_MASK) >> 8;
+                    fv = (vs & FRACT_MASK) >> 8;
+        #if USE_MAP_TILED
+                    p00 = map_bs[MAP_TILED_INDEX(tx0, ty0, row_shift)];
+                    p10 = map_bs[MAP_TILED_INDEX(tx1, ty0, row_shift)];
+                    p01 = map_bs[MAP_TILED_INDEX(tx0, ty1, row_shift)];
+                    p11 = map_bs[MAP_TILED_INDEX(tx1, ty1, row_shift)];
+        #else
+                    p00 = map_bs[ty0 << row_shift | tx0];
+                    p10 = map_bs[ty0 << row_shift | tx1];
+                    p01 = map_bs[ty1 << row_shift | tx0];
+                    p11 = map_bs[ty1 << row_shift | tx1];
+        #endif
+                    pix_val = ARGB_LERP(ARGB_LERP(p00, p10, fu), ARGB_LERP(p01, p11, fu), fv);
+    #elif USE_MAP_TILED
+                    pix_val = map_bs[TILED_TEXEL(ub, vb, vb_shift)];
     #else
                     pix_val = map_bs[(vb&~FRACT_MASK)>>vb_shift | ub>>FRACT_SHIFT];
     #endif
@@ -701,7 +911,9 @@
                               ((b >> FRACT_SHIFT) << B_SHIFT);
 #endif
 
+#if !USE_Z_ONLY
                     *draw_ptr = pix_val;
+#endif
 #if USE_Z
                 }
                 z += dz;
@@ -726,7 +938,11 @@
 #endif
                 draw_ptr++;
             }
+#if USE_PERSP
+            }
+#endif
         }
         edge_ptr += 2;
-        row_offset += vrb_width;
-    }
\ No newline at end of file
+        row_offset += vrb_stride;
+    }
+#endif
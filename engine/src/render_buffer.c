@@ -19,17 +19,53 @@
 RENDER_BUFFER *RENDER_BUFFER_alloc(INT width, INT height, INT z_buf_on) {
     RENDER_BUFFER *buf = calloc(1, sizeof(RENDER_BUFFER));
     buf->map = ARGB_MAP_alloc(width, height, 0);
-    if (z_buf_on == Z_BUFFER_ON) {
-        buf->z = Z_MAP_alloc(width, height);
-    }
-    else {
-        buf->z = NULL;
-    }
     buf->width = width;
     buf->height = height;
+    buf->alloc_width = width;
+    buf->alloc_height = height;
+    RENDER_BUFFER_set_z_buffer(buf, z_buf_on);
     return buf;
 }
 
+/*
+ Change dimensions of the render buffer without reallocation. Width and height can't exceed
+ the allocated ones. Row stride follows the width, so pixels (and Z) are undefined after resizing.
+*/
+void RENDER_BUFFER_set_size(RENDER_BUFFER *buf, INT width, INT height) {
+    if (width < 1 || height < 1 || width > buf->alloc_width || height > buf->alloc_height ||
+        (width == buf->width && height == buf->height)) {
+        return;
+    }
+    buf->width = width;
+    buf->height = height;
+    buf->map->width = width;
+    buf->map->stride = MAP_STRIDE(width);
+    buf->map->height = height;
+    buf->map->height_with_margin = height;
+    Z_MAP_set_size(buf->z, width, height);
+    buf->background = NULL;
+    if (buf->map->dirty != NULL)
+        ARGB_MAP_track_dirty(buf->map, true); //tiles layout has changed
+}
+
+/*
+ Replace Z buffer of the render buffer: Z_BUFFER_ON (32 bit Z), Z_BUFFER_ON_16 (16 bit Z)
+ or Z_BUFFER_OFF (no Z buffer). New Z buffer is cleared, frame epoch Z mode is kept.
+*/
+void RENDER_BUFFER_set_z_buffer(RENDER_BUFFER *buf, INT z_buf_on) {
+    bool epoch_on = false;
+    if (buf->z != NULL) {
+        epoch_on = buf->z->epoch_on;
+        Z_MAP_free(buf->z);
+        buf->z = NULL;
+    }
+    if (z_buf_on == Z_BUFFER_ON || z_buf_on == Z_BUFFER_ON_16) {
+        buf->z = Z_MAP_alloc(buf->alloc_width, buf->alloc_height, z_buf_on == Z_BUFFER_ON_16 ? 16 : 32);
+        buf->z->epoch_on = epoch_on;
+        Z_MAP_set_size(buf->z, buf->width, buf->height);
+    }
+}
+
 void RENDER_BUFFER_free(RENDER_BUFFER *buf) {
     if (buf->map != NULL) {
         ARGB_MAP_free(buf->map);
@@ -42,22 +78,73 @@ void RENDER_BUFFER_free(RENDER_BUFFER *buf) {
     free(buf);
 }
 
+/*
+ Initialize color and Z buffer of the render buffer in a single pass: every color row is written
+ right before its Z row. Color rows are filled with pix_val, or copied from src if it's not NULL.
+*/
+static void render_buffer_init(RENDER_BUFFER *buf, ARGB_PIXEL pix_val, ARGB_MAP *src) {
+    ARGB_PIXEL *ptr, *end_ptr;
+    bool z_rows, color_rows;
+
+    map_graph_flush(); //src, buf->map and buf->z (its epoch) may be used by deferred operations
+    z_rows = buf->z != NULL && Z_MAP_clear_tiles(buf->z);
+    color_rows = src == NULL || (src->data != NULL && src->width == buf->width && src->height == buf->height);
+    buf->background = NULL;
+    for (INT y = 0; y < buf->height; y++) {
+        ptr = MAP_ROW(buf->map, y);
+        if (color_rows && src != NULL) {
+            memcpy(ptr, MAP_ROW(src, y), buf->width*sizeof(ARGB_PIXEL));
+        }
+        else if (color_rows) {
+            for (end_ptr = ptr + buf->width; ptr < end_ptr; ptr++)
+                *ptr = pix_val;
+        }
+        if (z_rows)
+            Z_MAP_clear_rows(buf->z, y, y);
+    }
+    if (color_rows)
+        ARGB_MAP_mark_dirty(buf->map, 0, 0, buf->width-1, buf->height-1);
+}
+
 void RENDER_BUFFER_zero(RENDER_BUFFER *buf) {
-    ARGB_MAP_clear(buf->map);
-    Z_MAP_clear(buf->z);
+    render_buffer_init(buf, 0, NULL);
 }
 
 void RENDER_BUFFER_fill(RENDER_BUFFER *buf, COLOR *color) {
-    ARGB_MAP_fill(buf->map, color);
-    Z_MAP_clear(buf->z);
+    render_buffer_init(buf, COLOR_to_ARGB_PIXEL(color), NULL);
 }
 
 void RENDER_BUFFER_copy(RENDER_BUFFER *dst, RENDER_BUFFER *src) {
     ARGB_MAP_copy(dst->map, src->map);
     Z_MAP_copy(dst->z, src->z);
+    dst->background = src->background;
 }
 
 void RENDER_BUFFER_ARGB_MAP_copy(RENDER_BUFFER *dst, ARGB_MAP *src) {
-    ARGB_MAP_copy(dst->map, src);
-    Z_MAP_clear(dst->z);
+    render_buffer_init(dst, 0, src);
+}
+
+/*
+ Lazy variant of RENDER_BUFFER_ARGB_MAP_copy(): only Z buffer is cleared now. Pixels not covered by
+ the geometry are filled from the background afterwards, by RENDER_BUFFER_resolve_background()
+ (called by scene_3d_render() and display_show()), saving a full frame write.
+ Render buffer has to have a Z buffer, otherwise background is copied at once.
+*/
+void RENDER_BUFFER_background(RENDER_BUFFER *buf, ARGB_MAP *background) {
+    if (buf->z == NULL) {
+        RENDER_BUFFER_ARGB_MAP_copy(buf, background);
+        return;
+    }
+    Z_MAP_clear(buf->z);
+    buf->background = background;
+}
+
+/*
+ Fill pixels not covered by the geometry from the pending lazy background, see RENDER_BUFFER_background().
+*/
+void RENDER_BUFFER_resolve_background(RENDER_BUFFER *buf) {
+    if (buf->background == NULL)
+        return;
+    ARGB_MAP_copy_uncovered(buf->map, buf->background, buf->z);
+    buf->background = NULL;
 }
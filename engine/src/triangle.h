@@ -0,0 +1,403 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+/*
+ Half-space (edge function) rasterizer. Polygon is split into a triangle fan and every triangle
+ (with vertex X, Y in subpixels) is traversed in TRI_BLOCK_SIZE x TRI_BLOCK_SIZE pixel blocks. Each block is tested against
+ three edge functions at its corners: blocks outside of the triangle are rejected with one test,
+ fully covered blocks are drawn without per pixel edge tests, partially covered blocks
+ draw pixels selected by per row coverage masks (evaluated with edge_row_mask() vectors).
+ Pixel centers lying exactly on an edge are drawn only for top and left edges, so pixels on edges
+ shared by adjacent triangles are drawn once.
+ Supported variants: USE_Z with USE_SOLID, USE_INTERP or USE_MAP_BASE (affine, optionally USE_MAP_TILED)
+ with USE_FLAT or USE_INTERP and USE_DIFF/USE_SPEC, with 32 or 16 bit (USE_Z16) Z buffer.
+*/
+#if USE_Z && !defined(TRIANGLE_Z_FORMAT)
+//Rasterizer is instantiated for both Z buffer formats (USE_Z16 selects 16 bit Z),
+//variant matching Z buffer of the current render buffer is run.
+#define TRIANGLE_Z_FORMAT
+    if (vzb16 != NULL) {
+#define USE_Z16 1
+#include "triangle.h"
+#undef USE_Z16
+    }
+    else {
+#include "triangle.h"
+    }
+#undef TRIANGLE_Z_FORMAT
+#else
+    INT t, i, k;
+    INT vi[3]; //indices of current triangle vertices in vp
+    int64_t vx[3], vy[3]; //vertex coordinates in subpixels
+    int64_t area, tmp;
+    //Edge functions E(x, y) = ea*x + eb*y + ec of subpixel coordinates, E >= 0 inside of the triangle
+    int64_t ea[3], eb[3], ec[3];
+    int64_t ea_pix[3], eb_pix[3]; //edge function increments for one pixel along x and y
+    int64_t ea_blk[3], eb_blk[3]; //edge function increments across the block (to its last pixel)
+    int64_t e_blk[3], e_row[3]; //edge functions at the block origin and at the row beginning
+    int64_t emin, emax;
+    bool full; //if true: block is fully covered by the triangle
+    bool e_in[3]; //if true: block is on the inner side of the edge
+    //Vector row masks: edge functions of block rows fit in 32 bits (see TRI_EDGE_INSIDE)
+    bool simd_mask;
+    INT e32[3], e_step[3][TRI_BLOCK_SIZE]; //edge functions at the row beginning, their increments along the row
+    UINT mask; //row coverage mask, bit k is pixel x0 + k
+    INT xmin, xmax, ymin, ymax; //triangle bounding box, clipped to the render buffer
+    INT bx, by, x0, x1, y0, y1, y;
+    FLOAT dx1, dy1, dx2, dy2, det_r; //triangle edges from vertex 0 in pixels, inverted determinant
+    FLOAT fx0, fy0; //vertex 0 in pixels
+    ARGB_PIXEL *draw_ptr = NULL;
+    ARGB_PIXEL pix_val; //final pixel value
+#if USE_Z
+    #if USE_Z16
+    Z16_PIXEL *zbuf_ptr = NULL;
+    #else
+    Z_PIXEL *zbuf_ptr = NULL;
+    #endif
+    FLOAT zf[3], zdx, zdy; //Z at vertices and Z gradient
+    FLOAT zblk; //minimum Z of the block
+    INT z, dz, zmin;
+    int64_t z_row;
+#endif
+#if USE_MAP_BASE
+    const ARGB_MAP *mlevel; //base map mipmap level used for the polygon
+    ARGB_PIXEL *map_bs;
+    INT mip_level, vb_shift;
+    FLOAT uf[3], vf[3], udx, udy, vdx, vdy; //map coordinates at vertices (in texels) and their gradients
+    INT ub, vb, dub, dvb;
+    #if USE_INTERP
+        #if USE_DIFF
+    FLOAT rdf[3], gdf[3], bdf[3], rddx, rddy, gddx, gddy, bddx, bddy; //diffuse components at vertices and their gradients
+    INT rd, gd, bd, drd, dgd, dbd;
+        #endif
+        #if USE_SPEC
+    FLOAT rsf[3], gsf[3], bsf[3], rsdx, rsdy, gsdx, gsdy, bsdx, bsdy; //specular components at vertices and their gradients
+    INT rs, gs, bs, drs, dgs, dbs;
+        #endif
+    #elif USE_FLAT
+        #if USE_DIFF
+    ARGB_PIXEL diff_val = COLOR_to_ARGB_PIXEL((COLOR*)diff); //diffuse component value
+    ARGB_PIXEL diff_r = ARGB_PIXEL_RED(diff_val);
+    ARGB_PIXEL diff_g = ARGB_PIXEL_GREEN(diff_val);
+    ARGB_PIXEL diff_b = ARGB_PIXEL_BLUE(diff_val);
+        #endif
+        #if USE_SPEC
+    ARGB_PIXEL spec_val = COLOR_to_ARGB_PIXEL((COLOR*)spec); //specular component value
+        #endif
+    #endif
+#elif USE_INTERP //&& !USE_MAP_BASE
+    FLOAT rf[3], gf[3], bf[3], rdx, rdy, gdx, gdy, bdx, bdy; //color components at vertices and their gradients
+    INT r, g, b, dr, dg, db;
+#endif
+
+//Gradients of value f with f0, f1, f2 at triangle vertices
+#define TRI_GRADIENT(f, fdx, fdy) \
+    fdx = ((f[1] - f[0])*dy2 - (f[2] - f[0])*dy1)*det_r; \
+    fdy = ((f[2] - f[0])*dx1 - (f[1] - f[0])*dx2)*det_r;
+//Value f at pixel (x, y)
+#define TRI_VALUE(f, fdx, fdy, x, y) (f[0] + fdx*((x) - fx0) + fdy*((y) - fy0))
+//Fixed point value f at pixel (x, y), rounded
+#define TRI_FIXED(f, fdx, fdy, x, y) ((INT)(TRI_VALUE(f, fdx, fdy, x, y)*(1 << FRACT_SHIFT)) + (1 << (FRACT_SHIFT-1)))
+//Components of COLOR c at triangle vertices, scaled to [0, 255]
+#define TRI_COLORS(rf, gf, bf, c) \
+    for (i = 0; i < 3; i++) { \
+        rf[i] = (INT)(255.*(*c[vi[i]]).r); \
+        gf[i] = (INT)(255.*(*c[vi[i]]).g); \
+        bf[i] = (INT)(255.*(*c[vi[i]]).b); \
+    }
+//Saturated addition of RGB channels of ARGB_PIXEL s to p
+#define TRI_SAT_ADD(p, s) \
+    p = (p&0xFEFEFEFF) + ((s)&0x00FEFEFF); \
+    if (p & R_OVFL) p |= R_MASK; \
+    if (p & G_OVFL) p |= G_MASK; \
+    if (p & B_OVFL) p |= B_MASK;
+
+#if USE_SOLID
+    pix_val = COLOR_to_ARGB_PIXEL((COLOR*)color);
+#endif
+#if USE_MAP_BASE
+    //Mipmap level is selected for the whole polygon, as in polygon.h
+    mlevel = map_mip_level(vcnt, vp, mbc, mbase, &mip_level);
+    map_bs = mlevel->data;
+    //Bit shift of fixed point V giving offset of the map row (log_2 of the map row stride)
+    vb_shift = FRACT_SHIFT;
+    for (t = mlevel->stride-1; t; t >>= 1)
+        vb_shift--;
+#endif
+
+    for (t = 1; t < vcnt - 1; t++) {
+        vi[0] = 0;    vi[1] = t;    vi[2] = t + 1;
+        for (i = 0; i < 3; i++) {
+            vx[i] = (*vp[vi[i]])[0];
+            vy[i] = (*vp[vi[i]])[1];
+        }
+        area = (vx[1] - vx[0])*(vy[2] - vy[0]) - (vy[1] - vy[0])*(vx[2] - vx[0]);
+        if (area == 0)
+            continue;
+        if (area < 0) { //Make vertex order the same for all triangles
+            swap_int(&vi[1], &vi[2]);
+            tmp = vx[1];    vx[1] = vx[2];    vx[2] = tmp;
+            tmp = vy[1];    vy[1] = vy[2];    vy[2] = tmp;
+        }
+
+        //Bounding box of pixels with sample points inside of the triangle
+        xmin = xmax = vx[0];
+        ymin = ymax = vy[0];
+        for (i = 1; i < 3; i++) {
+            if (vx[i] < xmin) xmin = vx[i];
+            if (vx[i] > xmax) xmax = vx[i];
+            if (vy[i] < ymin) ymin = vy[i];
+            if (vy[i] > ymax) ymax = vy[i];
+        }
+        xmin = SUBPIXEL_CEIL(xmin);    xmax = SUBPIXEL_CEIL(xmax) - 1;
+        ymin = SUBPIXEL_CEIL(ymin);    ymax = SUBPIXEL_CEIL(ymax) - 1;
+        if (xmin < 0) xmin = 0;
+        if (ymin < 0) ymin = 0;
+        if (xmax > vrb_width-1) xmax = vrb_width-1;
+        if (ymax > vrb_height-1) ymax = vrb_height-1;
+        if (xmin > xmax || ymin > ymax)
+            continue;
+
+        //Edge functions of edges v0->v1, v1->v2, v2->v0
+        simd_mask = true;
+        for (i = 0; i < 3; i++) {
+            k = i < 2 ? i + 1 : 0;
+            ea[i] = vy[i] - vy[k];
+            eb[i] = vx[k] - vx[i];
+            ec[i] = -(ea[i]*vx[i] + eb[i]*vy[i]);
+            //Top-left fill convention: pixels exactly on other edges are outside
+            if (!(ea[i] > 0 || (ea[i] == 0 && eb[i] > 0)))
+                ec[i]--;
+            ea_pix[i] = ea[i]*SUBPIXEL_SIZE;
+            eb_pix[i] = eb[i]*SUBPIXEL_SIZE;
+            ea_blk[i] = ea_pix[i]*(TRI_BLOCK_SIZE-1);
+            eb_blk[i] = eb_pix[i]*(TRI_BLOCK_SIZE-1);
+            //Edges crossing a block have values within the block span there
+            if ((ea_blk[i] < 0 ? -ea_blk[i] : ea_blk[i]) + (eb_blk[i] < 0 ? -eb_blk[i] : eb_blk[i]) >= TRI_EDGE_INSIDE/2)
+                simd_mask = false;
+        }
+        if (simd_mask) {
+            for (i = 0; i < 3; i++)
+                for (k = 0; k < TRI_BLOCK_SIZE; k++)
+                    e_step[i][k] = ea_pix[i]*k;
+        }
+
+        //Gradients of interpolated values. Vertex 0 is moved by half pixel, so values
+        //are calculated for pixel centers at integer pixel coordinates.
+        fx0 = (FLOAT)vx[0]/SUBPIXEL_SIZE - 0.5;    fy0 = (FLOAT)vy[0]/SUBPIXEL_SIZE - 0.5;
+        dx1 = (FLOAT)(vx[1] - vx[0])/SUBPIXEL_SIZE;    dy1 = (FLOAT)(vy[1] - vy[0])/SUBPIXEL_SIZE;
+        dx2 = (FLOAT)(vx[2] - vx[0])/SUBPIXEL_SIZE;    dy2 = (FLOAT)(vy[2] - vy[0])/SUBPIXEL_SIZE;
+        det_r = 1./(dx1*dy2 - dx2*dy1);
+#if USE_Z
+        zmin = Z_KEY((*vp[vi[0]])[2]);
+        for (i = 0; i < 3; i++) {
+            zf[i] = Z_KEY((*vp[vi[i]])[2]);
+            if (zf[i] < zmin)
+                zmin = zf[i];
+        }
+        //Skip drawing this triangle if it's behind already drawn geometry
+        if (z_tiles_occluded(xmin, ymin, xmax, ymax, zmin))
+            continue;
+        z_tiles_mark(xmin, ymin, xmax, ymax);
+        TRI_GRADIENT(zf, zdx, zdy);
+        dz = zdx;
+#endif
+        ARGB_MAP_mark_dirty(vrm, xmin, ymin, xmax, ymax);
+#if USE_MAP_BASE
+        //Map coordinates of texel centers on the selected mipmap level
+        for (i = 0; i < 3; i++) {
+            uf[i] = (mbc[vi[i]].u + 0.5)/(1 << mip_level);
+            vf[i] = (mbc[vi[i]].v + 0.5)/(1 << mip_level);
+        }
+        TRI_GRADIENT(uf, udx, udy);
+        TRI_GRADIENT(vf, vdx, vdy);
+        dub = udx*(1 << FRACT_SHIFT);
+        dvb = vdx*(1 << FRACT_SHIFT);
+    #if USE_INTERP
+        #if USE_DIFF
+        TRI_COLORS(rdf, gdf, bdf, vdiff);
+        TRI_GRADIENT(rdf, rddx, rddy);
+        TRI_GRADIENT(gdf, gddx, gddy);
+        TRI_GRADIENT(bdf, bddx, bddy);
+        drd = rddx*(1 << FRACT_SHIFT);
+        dgd = gddx*(1 << FRACT_SHIFT);
+        dbd = bddx*(1 << FRACT_SHIFT);
+        #endif
+        #if USE_SPEC
+        TRI_COLORS(rsf, gsf, bsf, vspec);
+        TRI_GRADIENT(rsf, rsdx, rsdy);
+        TRI_GRADIENT(gsf, gsdx, gsdy);
+        TRI_GRADIENT(bsf, bsdx, bsdy);
+        drs = rsdx*(1 << FRACT_SHIFT);
+        dgs = gsdx*(1 << FRACT_SHIFT);
+        dbs = bsdx*(1 << FRACT_SHIFT);
+        #endif
+    #endif
+#elif USE_INTERP //&& !USE_MAP_BASE
+        TRI_COLORS(rf, gf, bf, vcolor);
+        TRI_GRADIENT(rf, rdx, rdy);
+        TRI_GRADIENT(gf, gdx, gdy);
+        TRI_GRADIENT(bf, bdx, bdy);
+        dr = rdx*(1 << FRACT_SHIFT);
+        dg = gdx*(1 << FRACT_SHIFT);
+        db = bdx*(1 << FRACT_SHIFT);
+#endif
+
+        for (by = ymin & ~TRI_BLOCK_MASK; by <= ymax; by += TRI_BLOCK_SIZE) {
+            y0 = by < ymin ? ymin : by;
+            y1 = by + TRI_BLOCK_SIZE-1 > ymax ? ymax : by + TRI_BLOCK_SIZE-1;
+            for (bx = xmin & ~TRI_BLOCK_MASK; bx <= xmax; bx += TRI_BLOCK_SIZE) {
+                //Edge functions are linear, so their minimum and maximum in the block are in its corners
+                full = true;
+                for (i = 0; i < 3; i++) {
+                    e_blk[i] = ea[i]*((int64_t)bx*SUBPIXEL_SIZE + (SUBPIXEL_SIZE >> 1)) +
+                        eb[i]*((int64_t)by*SUBPIXEL_SIZE + (SUBPIXEL_SIZE >> 1)) + ec[i];
+                    emin = e_blk[i] + (ea_blk[i] < 0 ? ea_blk[i] : 0) + (eb_blk[i] < 0 ? eb_blk[i] : 0);
+                    emax = e_blk[i] + (ea_blk[i] > 0 ? ea_blk[i] : 0) + (eb_blk[i] > 0 ? eb_blk[i] : 0);
+                    if (emax < 0)
+                        break;
+                    e_in[i] = emin >= 0;
+                    if (!e_in[i])
+                        full = false;
+                }
+                if (i < 3)
+                    continue; //Block is outside of the triangle
+                x0 = bx < xmin ? xmin : bx;
+                x1 = bx + TRI_BLOCK_SIZE-1 > xmax ? xmax : bx + TRI_BLOCK_SIZE-1;
+#if USE_Z
+                //Skip the block if it's behind already drawn geometry.
+                //Block Z minimum is lowered by the maximum roundoff of Z stepping.
+                zblk = TRI_VALUE(zf, zdx, zdy, bx, by) - TRI_BLOCK_SIZE +
+                    (zdx < 0. ? zdx*(TRI_BLOCK_SIZE-1) : 0.) + (zdy < 0. ? zdy*(TRI_BLOCK_SIZE-1) : 0.);
+                if (zblk < Z_BUFFER_MAX && z_tiles_occluded(x0, y0, x1, y1, (INT)zblk))
+                    continue;
+#endif
+                for (y = y0; y <= y1; y++) {
+                    mask = (1 << (x1 - x0 + 1)) - 1;
+                    if (!full) {
+                        //Coverage mask of the block row, shifted to its first drawn pixel x0
+                        for (i = 0; i < 3; i++)
+                            e_row[i] = e_blk[i] + eb_pix[i]*(y - by);
+                        if (simd_mask) {
+                            for (i = 0; i < 3; i++)
+                                e32[i] = e_in[i] ? TRI_EDGE_INSIDE : (INT)e_row[i];
+                            mask &= edge_row_mask(e32, e_step) >> (x0 - bx);
+                        }
+                        else {
+                            //Sign bit of OR-ed edge functions is set if any of them is negative
+                            mask = 0;
+                            for (k = 0; k < TRI_BLOCK_SIZE; k++)
+                                mask |= (UINT)(((e_row[0] + ea_pix[0]*k) | (e_row[1] + ea_pix[1]*k) | (e_row[2] + ea_pix[2]*k)) >= 0) << k;
+                            mask = (mask >> (x0 - bx)) & ((1 << (x1 - x0 + 1)) - 1);
+                        }
+                        if (mask == 0)
+                            continue;
+                    }
+                    draw_ptr = vrb + y*vrb_stride + x0;
+#if USE_Z
+    #if USE_Z16
+                    zbuf_ptr = vzb16 + y*vrb_stride + x0;
+    #else
+                    zbuf_ptr = vzb + y*vrb_stride + x0;
+    #endif
+                    z_row = TRI_VALUE(zf, zdx, zdy, x0, y);
+#endif
+#if USE_MAP_BASE
+                    ub = TRI_VALUE(uf, udx, udy, x0, y)*(1 << FRACT_SHIFT);
+                    vb = TRI_VALUE(vf, vdx, vdy, x0, y)*(1 << FRACT_SHIFT);
+    #if USE_INTERP
+        #if USE_DIFF
+                    rd = TRI_FIXED(rdf, rddx, rddy, x0, y);
+                    gd = TRI_FIXED(gdf, gddx, gddy, x0, y);
+                    bd = TRI_FIXED(bdf, bddx, bddy, x0, y);
+        #endif
+        #if USE_SPEC
+                    rs = TRI_FIXED(rsf, rsdx, rsdy, x0, y);
+                    gs = TRI_FIXED(gsf, gsdx, gsdy, x0, y);
+                    bs = TRI_FIXED(bsf, bsdx, bsdy, x0, y);
+        #endif
+    #endif
+#elif USE_INTERP //&& !USE_MAP_BASE
+                    r = TRI_FIXED(rf, rdx, rdy, x0, y);
+                    g = TRI_FIXED(gf, gdx, gdy, x0, y);
+                    b = TRI_FIXED(bf, bdx, bdy, x0, y);
+#endif
+                    for (k = 0; mask; k++, mask >>= 1) {
+                        if (!(mask & 1))
+                            continue;
+#if USE_Z
+                        z = z_row + (int64_t)dz*k;
+    #if USE_Z16
+                        if (zbuf_ptr[k] > Z_TO_Z16(z)) {
+                            zbuf_ptr[k] = Z_TO_Z16(z);
+    #else
+                        if (zbuf_ptr[k] > z) {
+                            zbuf_ptr[k] = z;
+    #endif
+    #ifdef RENDER_STATS
+                            vr_overdraw.shaded++;
+    #endif
+#endif
+#if USE_MAP_BASE
+    #if USE_MAP_TILED
+                            pix_val = map_bs[TILED_TEXEL(ub + dub*k, vb + dvb*k, vb_shift)];
+    #else
+                            pix_val = map_bs[((vb + dvb*k)&~FRACT_MASK)>>vb_shift | (ub + dub*k)>>FRACT_SHIFT];
+    #endif
+    #if USE_FLAT
+        #if USE_DIFF
+                            pix_val = A_MASK |
+                                (diff_r*ARGB_PIXEL_RED(pix_val) >> 8) << R_SHIFT |
+                                (diff_g*ARGB_PIXEL_GREEN(pix_val) >> 8) << G_SHIFT |
+                                (diff_b*ARGB_PIXEL_BLUE(pix_val) >> 8) << B_SHIFT;
+        #endif
+        #if USE_SPEC
+                            TRI_SAT_ADD(pix_val, spec_val);
+        #endif
+    #elif USE_INTERP
+        #if USE_DIFF
+                            pix_val = A_MASK |
+                                (((rd + drd*k)>>FRACT_SHIFT)*ARGB_PIXEL_RED(pix_val) >> 8) << R_SHIFT |
+                                (((gd + dgd*k)>>FRACT_SHIFT)*ARGB_PIXEL_GREEN(pix_val) >> 8) << G_SHIFT |
+                                (((bd + dbd*k)>>FRACT_SHIFT)*ARGB_PIXEL_BLUE(pix_val) >> 8) << B_SHIFT;
+        #endif
+        #if USE_SPEC
+                            TRI_SAT_ADD(pix_val,
+                                (((rs + drs*k) & 0x0FF0000) | (((gs + dgs*k) & 0x0FF0000)>>8) | ((bs + dbs*k)>>16)));
+        #endif
+    #endif
+#elif USE_INTERP //&& !USE_MAP_BASE
+                            pix_val = A_MASK |
+                                      (((r + dr*k) >> FRACT_SHIFT) << R_SHIFT) |
+                                      (((g + dg*k) >> FRACT_SHIFT) << G_SHIFT) |
+                                      (((b + db*k) >> FRACT_SHIFT) << B_SHIFT);
+#endif
+                            draw_ptr[k] = pix_val;
+#if USE_Z
+                        }
+#endif
+                    }
+                }
+            }
+        }
+    }
+
+#undef TRI_SAT_ADD
+#undef TRI_COLORS
+#undef TRI_FIXED
+#undef TRI_VALUE
+#undef TRI_GRADIENT
+#endif
@@ -0,0 +1,388 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "engine.h"
+
+/*
+ Deferred shading with visibility buffer.
+ Faces of deferred objects are split into triangle fans and rasterized with Z test
+ into visibility buffer, which holds only IDs of visible triangles (see VIS_ID).
+ In the second pass each visible pixel is shaded exactly once: barycentric coordinates
+ of the pixel are reconstructed from the projected triangle vertices and used
+ for interpolation of map coordinates and colors.
+ Screen is shaded in independent tiles, deferred_shade_tile only reads the scene
+ and writes pixels of its own tile, so rows of tiles are shaded in parallel.
+*/
+
+//Color channel value interpolated from barycentric coordinates, clamped to [0, 255]
+#define DEFERRED_CHANNEL(l, c) deferred_channel((l)[0]*(c)[0] + (l)[1]*(c)[1] + (l)[2]*(c)[2])
+
+//Shading setup of single visibility buffer triangle
+typedef struct {
+    UINT id;
+    OBJ_3D_TYPE type;
+    bool perspective;
+    //Affine barycentric coordinates of vertices 1 and 2: l = a*x + b*y + c
+    FLOAT a1, b1, c1;
+    FLOAT a2, b2, c2;
+    FLOAT w[3]; //1/W of vertices
+    FLOAT u[3], v[3]; //Map coordinates of vertices on the selected mipmap level
+    FLOAT r[3], g[3], b[3]; //Diffuse (or unshaded) vertex colors [0, 255]
+    FLOAT rs[3], gs[3], bs[3]; //Specular vertex colors [0, 255]
+    ARGB_PIXEL diff_val, spec_val; //Flat diffuse and specular colors
+    const ARGB_MAP *map; //Base map mipmap level
+    INT row_shift; //log_2 of map width (for tiled maps)
+} DEFERRED_TRIANGLE;
+
+bool deferred_type(OBJ_3D_TYPE type) {
+    switch (type) {
+        case INTERP_UNSHADED:
+        case INTERP_DIFF:
+        case INTERP_SPEC:
+        case INTERP_DIFF_SPEC:
+        case TX_MAP_BASE:
+        case SOLID_DIFF_TEXTURED:
+        case SOLID_SPEC_TEXTURED:
+        case SOLID_DIFF_SPEC_TEXTURED:
+        case INTERP_DIFF_TEXTURED:
+        case INTERP_SPEC_TEXTURED:
+        case INTERP_DIFF_SPEC_TEXTURED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool deferred_textured(OBJ_3D_TYPE type) {
+    return type == TX_MAP_BASE || type == SOLID_DIFF_TEXTURED || type == SOLID_SPEC_TEXTURED ||
+        type == SOLID_DIFF_SPEC_TEXTURED || type == INTERP_DIFF_TEXTURED ||
+        type == INTERP_SPEC_TEXTURED || type == INTERP_DIFF_SPEC_TEXTURED;
+}
+
+//Returns true if object at queue_index of the scene render queue can be rendered deferred.
+//Bilinear filtered objects are not: deferred shading samples textures with the nearest texel.
+bool deferred_object(SCENE_3D *scene, INT queue_index) {
+    OBJ_3D *obj = scene->queue[queue_index]->obj;
+    return queue_index < VIS_MAX_OBJECTS && obj->fcnt <= VIS_MAX_FACES && deferred_type(obj->type) &&
+        !obj->bilinear_on;
+}
+
+//Rasterize IDs of all deferred objects front faces into visibility buffer, with Z test
+void deferred_rasterize(SCENE_3D *scene) {
+    RENDER_BUFFER *rb = scene->render_buf;
+    PROJECTION_COORD *vp[3]; //vertices of currently drawn triangle
+    OBJ_3D *obj;
+    FACE *face;
+    INT i, j, k;
+
+    if (scene->vis != NULL && (scene->vis->width != rb->width || scene->vis->height != rb->height)) {
+        ARGB_MAP_free(scene->vis);
+        free(scene->vis_tiles);
+        scene->vis = NULL;
+        scene->vis_tiles = NULL;
+    }
+    if (scene->vis == NULL) {
+        scene->vis = ARGB_MAP_alloc(rb->width, rb->height, 0);
+        scene->vis_tiles = calloc(DEFERRED_TILE_COLS(rb->width)*DEFERRED_TILE_ROWS(rb->height), sizeof(INT));
+    }
+    memset(scene->vis->data, 0xFF, scene->vis->stride*rb->height*sizeof(ARGB_PIXEL)); //VIS_EMPTY
+
+    //Visibility buffer takes place of the color map, Z buffer is shared with forward rendered objects
+    vr_set_render_buffer(&(RENDER_BUFFER){.map = scene->vis, .z = rb->z, .width = rb->width, .height = rb->height});
+    for (i = 0; i < scene->queue_cnt; i++) {
+        if (!deferred_object(scene, i))
+            continue;
+        obj = scene->queue[i]->obj;
+        for (j = 0; j < obj->front_fcnt; j++) {
+            face = obj->front_faces[j];
+            vp[0] = (PROJECTION_COORD*)obj->vertices[face->vi[0]].projection;
+            for (k = 0; k < face->vcnt-2; k++) {
+                vp[1] = (PROJECTION_COORD*)obj->vertices[face->vi[k+1]].projection;
+                vp[2] = (PROJECTION_COORD*)obj->vertices[face->vi[k+2]].projection;
+                polygon_id_z(3, vp, VIS_ID(i, face - obj->faces, k));
+            }
+        }
+        Z_MAP_update_tiles(rb->z);
+    }
+    vr_set_render_buffer(rb);
+}
+
+void deferred_triangle_setup(SCENE_3D *scene, UINT id, DEFERRED_TRIANGLE *t) {
+    OBJ_3D *obj = scene->queue[VIS_ID_OBJ(id)]->obj;
+    FACE *face = obj->faces + VIS_ID_FACE(id);
+    PROJECTION_COORD *vp[MAX_FACE_VERTICES];
+    INT fi[3] = {0, VIS_ID_TRI(id) + 1, VIS_ID_TRI(id) + 2}; //face vertices of the triangle
+    VERTEX *v[3];
+    FLOAT x[3], y[3], d, scale;
+    INT i, level;
+
+    t->id = id;
+    t->type = obj->type;
+    t->perspective = obj->perspective_on;
+    for (i = 0; i < 3; i++) {
+        v[i] = obj->vertices + face->vi[fi[i]];
+        //Integer pixel coordinates are pixel centers
+        x[i] = (FLOAT)v[i]->projection[0]/SUBPIXEL_SIZE - 0.5;
+        y[i] = (FLOAT)v[i]->projection[1]/SUBPIXEL_SIZE - 0.5;
+        t->w[i] = v[i]->projection_w_inv;
+    }
+    //Barycentric coordinates as linear functions of screen coordinates
+    d = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+    if (d == 0.) {
+        t->a1 = t->b1 = t->c1 = 0.;
+        t->a2 = t->b2 = t->c2 = 0.;
+    }
+    else {
+        t->a1 = (y[2]-y[0])/d;    t->b1 = -(x[2]-x[0])/d;
+        t->c1 = -(t->a1*x[0] + t->b1*y[0]);
+        t->a2 = -(y[1]-y[0])/d;    t->b2 = (x[1]-x[0])/d;
+        t->c2 = -(t->a2*x[0] + t->b2*y[0]);
+    }
+
+    if (deferred_textured(obj->type)) {
+        //Mipmap level is selected for whole face, as in forward rendering
+        for (i = 0; i < face->vcnt; i++)
+            vp[i] = (PROJECTION_COORD*)obj->vertices[face->vi[i]].projection;
+        t->map = map_mip_level(face->vcnt, vp, face->bc, obj->base_map, &level);
+        scale = 1./(1 << level);
+        for (i = 0; i < 3; i++) {
+            t->u[i] = (face->bc[fi[i]].u + 0.5)*scale;
+            t->v[i] = (face->bc[fi[i]].v + 0.5)*scale;
+        }
+        t->row_shift = 0;
+        while ((1 << t->row_shift) < t->map->width)
+            t->row_shift++;
+    }
+    switch (obj->type) {
+        case INTERP_UNSHADED:
+            for (i = 0; i < 3; i++) {
+                t->r[i] = 255.*v[i]->color_surf.r;
+                t->g[i] = 255.*v[i]->color_surf.g;
+                t->b[i] = 255.*v[i]->color_surf.b;
+            }
+            break;
+        case INTERP_DIFF:
+        case INTERP_SPEC:
+        case INTERP_DIFF_SPEC:
+        case INTERP_DIFF_TEXTURED:
+        case INTERP_DIFF_SPEC_TEXTURED:
+            for (i = 0; i < 3; i++) {
+                t->r[i] = 255.*v[i]->color_diff.r;
+                t->g[i] = 255.*v[i]->color_diff.g;
+                t->b[i] = 255.*v[i]->color_diff.b;
+            }
+            break;
+        case SOLID_DIFF_TEXTURED:
+        case SOLID_DIFF_SPEC_TEXTURED:
+            t->diff_val = COLOR_to_ARGB_PIXEL(&face->color_diff);
+            break;
+        default:
+            break;
+    }
+    switch (obj->type) {
+        case INTERP_SPEC_TEXTURED:
+        case INTERP_DIFF_SPEC_TEXTURED:
+            for (i = 0; i < 3; i++) {
+                t->rs[i] = 255.*v[i]->color_spec.r;
+                t->gs[i] = 255.*v[i]->color_spec.g;
+                t->bs[i] = 255.*v[i]->color_spec.b;
+            }
+            break;
+        case SOLID_SPEC_TEXTURED:
+        case SOLID_DIFF_SPEC_TEXTURED:
+            t->spec_val = COLOR_to_ARGB_PIXEL(&face->color_spec);
+            break;
+        default:
+            break;
+    }
+}
+
+ARGB_PIXEL deferred_channel(FLOAT c) {
+    return c < 0. ? 0 : (c > 255. ? 255 : (ARGB_PIXEL)c);
+}
+
+//Saturated addition of RGB channels
+ARGB_PIXEL deferred_sat_add(ARGB_PIXEL a, ARGB_PIXEL b) {
+    ARGB_PIXEL p = (a&0xFEFEFEFF) + (b&0x00FEFEFF);
+    if (p & R_OVFL) p |= R_MASK;
+    if (p & G_OVFL) p |= G_MASK;
+    if (p & B_OVFL) p |= B_MASK;
+    return p;
+}
+
+//Shade pixel with barycentric coordinates l1, l2 of triangle vertices 1 and 2
+ARGB_PIXEL deferred_shade_pixel(const DEFERRED_TRIANGLE *t, FLOAT l1, FLOAT l2) {
+    FLOAT l[3] = {1. - l1 - l2, l1, l2}, lp[3], s; //affine and perspective corrected barycentric coordinates
+    FLOAT uf, vf;
+    INT u, v, i;
+    ARGB_PIXEL pix_val = 0, r, g, b;
+
+    if (deferred_textured(t->type)) {
+        if (t->perspective) {
+            s = 0.;
+            for (i = 0; i < 3; i++) {
+                lp[i] = l[i]*t->w[i];
+                s += lp[i];
+            }
+            for (i = 0; i < 3; i++)
+                lp[i] /= s;
+        }
+        else {
+            lp[0] = l[0];    lp[1] = l[1];    lp[2] = l[2];
+        }
+        uf = lp[0]*t->u[0] + lp[1]*t->u[1] + lp[2]*t->u[2];
+        vf = lp[0]*t->v[0] + lp[1]*t->v[1] + lp[2]*t->v[2];
+        //Reconstructed coordinates of pixels on polygon edges can slightly exceed the map
+        u = uf < 0. ? 0 : (uf >= t->map->width ? t->map->width-1 : (INT)uf);
+        v = vf < 0. ? 0 : (vf >= t->map->height_with_margin ? t->map->height_with_margin-1 : (INT)vf);
+        if (t->map->tiled)
+            pix_val = t->map->data[MAP_TILED_INDEX(u, v, t->row_shift)];
+        else
+            pix_val = MAP_ROW(t->map, v)[u];
+    }
+
+    switch (t->type) {
+        case INTERP_UNSHADED:
+        case INTERP_DIFF:
+        case INTERP_SPEC:
+        case INTERP_DIFF_SPEC:
+            r = DEFERRED_CHANNEL(l, t->r);
+            g = DEFERRED_CHANNEL(l, t->g);
+            b = DEFERRED_CHANNEL(l, t->b);
+            pix_val = A_MASK | r << R_SHIFT | g << G_SHIFT | b << B_SHIFT;
+            break;
+        case SOLID_DIFF_TEXTURED:
+        case SOLID_DIFF_SPEC_TEXTURED:
+            pix_val = A_MASK |
+                (ARGB_PIXEL_RED(t->diff_val)*ARGB_PIXEL_RED(pix_val) >> 8) << R_SHIFT |
+                (ARGB_PIXEL_GREEN(t->diff_val)*ARGB_PIXEL_GREEN(pix_val) >> 8) << G_SHIFT |
+                (ARGB_PIXEL_BLUE(t->diff_val)*ARGB_PIXEL_BLUE(pix_val) >> 8) << B_SHIFT;
+            break;
+        case INTERP_DIFF_TEXTURED:
+        case INTERP_DIFF_SPEC_TEXTURED:
+            r = DEFERRED_CHANNEL(l, t->r);
+            g = DEFERRED_CHANNEL(l, t->g);
+            b = DEFERRED_CHANNEL(l, t->b);
+            pix_val = A_MASK |
+                (r*ARGB_PIXEL_RED(pix_val) >> 8) << R_SHIFT |
+                (g*ARGB_PIXEL_GREEN(pix_val) >> 8) << G_SHIFT |
+                (b*ARGB_PIXEL_BLUE(pix_val) >> 8) << B_SHIFT;
+            break;
+        default:
+            break;
+    }
+
+    switch (t->type) {
+        case SOLID_SPEC_TEXTURED:
+        case SOLID_DIFF_SPEC_TEXTURED:
+            pix_val = deferred_sat_add(pix_val, t->spec_val);
+            break;
+        case INTERP_SPEC_TEXTURED:
+        case INTERP_DIFF_SPEC_TEXTURED:
+            r = DEFERRED_CHANNEL(l, t->rs);
+            g = DEFERRED_CHANNEL(l, t->gs);
+            b = DEFERRED_CHANNEL(l, t->bs);
+            pix_val = deferred_sat_add(pix_val, r << R_SHIFT | g << G_SHIFT | b << B_SHIFT);
+            break;
+        default:
+            break;
+    }
+    return pix_val;
+}
+
+/*
+ Shade visible pixels of the screen tile (x0, y0)-(x1, y1), bounds included.
+ Returns count of shaded pixels.
+*/
+INT deferred_shade_tile(SCENE_3D *scene, INT x0, INT y0, INT x1, INT y1) {
+    RENDER_BUFFER *rb = scene->render_buf;
+    DEFERRED_TRIANGLE t = {.id = VIS_EMPTY};
+    ARGB_PIXEL *vis_ptr, *draw_ptr;
+    UINT id, prev_id;
+    FLOAT l1 = 0., l2 = 0.;
+    INT x, y, cnt = 0;
+
+    for (y = y0; y <= y1; y++) {
+        vis_ptr = MAP_ROW(scene->vis, y) + x0;
+        draw_ptr = MAP_ROW(rb->map, y) + x0;
+        prev_id = VIS_EMPTY;
+        for (x = x0; x <= x1; x++, vis_ptr++, draw_ptr++) {
+            id = *vis_ptr;
+            if (id == VIS_EMPTY) {
+                prev_id = id;
+                continue;
+            }
+            //Neighbouring pixels mostly belong to the same triangle: its setup is reused
+            //and barycentric coordinates are stepped along the row
+            if (id == prev_id) {
+                l1 += t.a1;
+                l2 += t.a2;
+            }
+            else {
+                if (id != t.id)
+                    deferred_triangle_setup(scene, id, &t);
+                l1 = t.a1*x + t.b1*y + t.c1;
+                l2 = t.a2*x + t.b2*y + t.c2;
+                prev_id = id;
+            }
+            *draw_ptr = deferred_shade_pixel(&t, l1, l2);
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+static INT deferred_worker_cnt[PARALLEL_MAX_WORKERS]; //shaded pixels of each worker
+
+//Shade tile rows y0..y1-1 (parallel_rows() function), job->data: the scene
+static void deferred_shade_rows(MAP_JOB *job, INT y0, INT y1, INT worker) {
+    SCENE_3D *scene = job->data;
+    RENDER_BUFFER *rb = scene->render_buf;
+    INT *tile_cnt, x, y, x1, y1_tile, cnt = 0;
+
+    for (y = y0*DEFERRED_TILE_SIZE; y < y1*DEFERRED_TILE_SIZE && y < rb->height; y += DEFERRED_TILE_SIZE) {
+        tile_cnt = scene->vis_tiles + (y/DEFERRED_TILE_SIZE)*DEFERRED_TILE_COLS(rb->width);
+        y1_tile = y + DEFERRED_TILE_SIZE > rb->height ? rb->height-1 : y + DEFERRED_TILE_SIZE-1;
+        for (x = 0; x < rb->width; x += DEFERRED_TILE_SIZE, tile_cnt++) {
+            x1 = x + DEFERRED_TILE_SIZE > rb->width ? rb->width-1 : x + DEFERRED_TILE_SIZE-1;
+            *tile_cnt = deferred_shade_tile(scene, x, y, x1, y1_tile);
+            cnt += *tile_cnt;
+        }
+    }
+    deferred_worker_cnt[worker] += cnt;
+}
+
+/*
+ Shade all visible pixels of the visibility buffer. Tile rows are shaded in parallel,
+ dirty tiles and overdraw statistics are updated by the calling thread afterwards.
+*/
+void deferred_shade(SCENE_3D *scene) {
+    RENDER_BUFFER *rb = scene->render_buf;
+    MAP_JOB job = {.data = scene};
+    INT *tile_cnt = scene->vis_tiles, x, y, i, cnt = 0;
+
+    for (i = 0; i < parallel_workers(); i++)
+        deferred_worker_cnt[i] = 0;
+    parallel_rows(deferred_shade_rows, &job, DEFERRED_TILE_ROWS(rb->height),
+                  2*DEFERRED_TILE_SIZE*rb->width*sizeof(ARGB_PIXEL));
+    for (y = 0; y < rb->height; y += DEFERRED_TILE_SIZE)
+        for (x = 0; x < rb->width; x += DEFERRED_TILE_SIZE, tile_cnt++)
+            if (*tile_cnt > 0)
+                ARGB_MAP_mark_dirty(rb->map, x, y, x + DEFERRED_TILE_SIZE-1, y + DEFERRED_TILE_SIZE-1);
+    for (i = 0; i < parallel_workers(); i++)
+        cnt += deferred_worker_cnt[i];
+    vr_overdraw_add_shaded(cnt);
+}
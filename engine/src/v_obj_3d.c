@@ -24,6 +24,9 @@ OBJ_3D *obj_3d(INT vcnt, INT fcnt) {
 
     *obj = (OBJ_3D){
         .wireframe_on = false,
+        .perspective_on = false,
+        .bilinear_on = false,
+        .halfspace_on = false,
         .fcnt = fcnt,
         .faces = calloc(fcnt, sizeof(FACE)),
         .front_fcnt = 0,
@@ -81,7 +84,7 @@ void obj_3d_set_surface_color(OBJ_3D *obj, COLOR *color) {
 
 /*
 members needed in props:
-color, wireframe_color, type, wireframe_on, specular_power, base_map, reflection_map
+color, wireframe_color, type, wireframe_on, perspective_on, bilinear_on, halfspace_on, specular_power, base_map, reflection_map
 */
 void obj_3d_set_properties(OBJ_3D *obj, OBJ_3D *props) {
     INT i = 0, j = 0;
@@ -99,6 +102,9 @@ void obj_3d_set_properties(OBJ_3D *obj, OBJ_3D *props) {
         obj->wireframe_on = false;
     else
         obj->wireframe_on = props->wireframe_on;
+    obj->perspective_on = props->perspective_on;
+    obj->bilinear_on = props->bilinear_on;
+    obj->halfspace_on = props->halfspace_on;
     obj->specular_power = props->specular_power;
 
     //If user didn't specified base_map or reflection_map in props,
@@ -194,6 +200,25 @@ void obj_3d_init_geometry(OBJ_3D *obj) {
     obj_3d_calc_vertex_normals(obj);
 }
 
+static int face_zmin_compare(const void *a, const void *b) {
+    const FACE *fa = *(FACE * const *)a, *fb = *(FACE * const *)b;
+    if (fa->zmin != fb->zmin)
+        return fa->zmin < fb->zmin ? -1 : 1;
+    return fa < fb ? -1 : (fa > fb); //keep original order of faces on equal depth
+}
+
+void obj_3d_sort_front_faces(OBJ_3D *obj) {
+    FACE *face;
+    for (INT i = 0; i < obj->front_fcnt; i++) {
+        face = obj->front_faces[i];
+        face->zmin = obj->vertices[face->vi[0]].projection[2];
+        for (INT j = 1; j < face->vcnt; j++)
+            if (obj->vertices[face->vi[j]].projection[2] < face->zmin)
+                face->zmin = obj->vertices[face->vi[j]].projection[2];
+    }
+    qsort(obj->front_faces, obj->front_fcnt, sizeof(FACE*), face_zmin_compare);
+}
+
 void obj_3d_draw_wireframe(OBJ_3D *obj) {
     INT i = 0, j = 0;
     VERTEX *v1, *v2;
@@ -231,6 +256,34 @@ void obj_3d_draw_wireframe(OBJ_3D *obj) {
     }
 }
 
+//Z pre-pass: write Z of all front faces, without shading
+void obj_3d_draw_z_only(OBJ_3D *obj) {
+    PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FACE *face;
+    INT i, j;
+
+    for (i = 0; i < obj->front_fcnt; i++) {
+        face = obj->front_faces[i];
+        for (j = 0; j < face->vcnt; j++)
+            vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+        polygon_z_only(face->vcnt, vp);
+    }
+}
+
+//Insert front faces of SOLID_* object into the current span buffer
+void obj_3d_draw_solid_span(OBJ_3D *obj) {
+    PROJECTION_COORD *v[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FACE *face;
+    INT i, j;
+
+    for (i = 0; i < obj->front_fcnt; i++) {
+        face = obj->front_faces[i];
+        for (j = 0; j < face->vcnt; j++)
+            v[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+        polygon_solid_span(face->vcnt, v, obj->type == SOLID_UNSHADED ? &face->color_surf : &face->color_diff);
+    }
+}
+
 void obj_3d_draw_solid_unshaded(OBJ_3D *obj) {
     PROJECTION_COORD *v[MAX_FACE_VERTICES]; //vertices of currently drawn face
     FACE *face;
@@ -240,7 +293,10 @@ void obj_3d_draw_solid_unshaded(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j=0; j<face->vcnt; j++)
             v[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
-        polygon_solid_z(face->vcnt, v, &face->color_surf);
+        if (obj->halfspace_on)
+            triangle_solid_z(face->vcnt, v, &face->color_surf);
+        else
+            polygon_solid_z(face->vcnt, v, &face->color_surf);
     }
 }
 
@@ -253,7 +309,10 @@ void obj_3d_draw_solid_shaded(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++)
             v[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
-        polygon_solid_z(face->vcnt, v, &face->color_diff);
+        if (obj->halfspace_on)
+            triangle_solid_z(face->vcnt, v, &face->color_diff);
+        else
+            polygon_solid_z(face->vcnt, v, &face->color_diff);
     }
 }
 
@@ -270,7 +329,10 @@ void obj_3d_draw_interp_unshaded(OBJ_3D *obj) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
             vc[j] = &obj->vertices[face->vi[j]].color_surf;
         }
-        polygon_interp_z(face->vcnt, vp, vc);
+        if (obj->halfspace_on)
+            triangle_interp_z(face->vcnt, vp, vc);
+        else
+            polygon_interp_z(face->vcnt, vp, vc);
     }
 }
 
@@ -287,12 +349,16 @@ void obj_3d_draw_interp_shaded(OBJ_3D *obj) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
             vc[j] = &obj->vertices[face->vi[j]].color_diff;
         }
-        polygon_interp_z(face->vcnt, vp, vc);
+        if (obj->halfspace_on)
+            triangle_interp_z(face->vcnt, vp, vc);
+        else
+            polygon_interp_z(face->vcnt, vp, vc);
     }
 }
 
 void obj_3d_draw_textured_base(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
 
@@ -300,13 +366,26 @@ void obj_3d_draw_textured_base(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
+        }
+        if (obj->bilinear_on) {
+            if (obj->perspective_on)
+                polygon_texture_base_bilinear_persp_z(face->vcnt, vp, vw, face->bc, obj->base_map);
+            else
+                polygon_texture_base_bilinear_z(face->vcnt, vp, face->bc, obj->base_map);
         }
-        polygon_texture_base_z(face->vcnt, vp, face->bc, obj->base_map);
+        else if (obj->perspective_on)
+            polygon_texture_base_persp_z(face->vcnt, vp, vw, face->bc, obj->base_map);
+        else if (obj->halfspace_on)
+            triangle_texture_base_z(face->vcnt, vp, face->bc, obj->base_map);
+        else
+            polygon_texture_base_z(face->vcnt, vp, face->bc, obj->base_map);
     }
 }
 
 void obj_3d_draw_textured_base_mul(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
 
@@ -314,15 +393,20 @@ void obj_3d_draw_textured_base_mul(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
             face->rc[j].u = (obj->vertices[face->vi[j]].normal_camera[0] - 1.0) * -(obj->mul_map->width-1)/2.0;
             face->rc[j].v = (obj->vertices[face->vi[j]].normal_camera[1] - 1.0) * -(obj->mul_map->height-1)/2.0;
         }
-        polygon_texture_base_mul_z(face->vcnt, vp, face->bc, obj->base_map, face->rc, obj->mul_map);
+        if (obj->perspective_on)
+            polygon_texture_base_mul_persp_z(face->vcnt, vp, vw, face->bc, obj->base_map, face->rc, obj->mul_map);
+        else
+            polygon_texture_base_mul_z(face->vcnt, vp, face->bc, obj->base_map, face->rc, obj->mul_map);
     }
 }
 
 void obj_3d_draw_textured_base_add(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
 
@@ -330,15 +414,20 @@ void obj_3d_draw_textured_base_add(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
             face->rc[j].u = (obj->vertices[face->vi[j]].normal_camera[0] - 1.0) * -(obj->add_map->width-1)/2.0;
             face->rc[j].v = (obj->vertices[face->vi[j]].normal_camera[1] - 1.0) * -(obj->add_map->height-1)/2.0;
         }
-        polygon_texture_base_add_z(face->vcnt, vp, face->bc, obj->base_map, face->rc, obj->add_map);
+        if (obj->perspective_on)
+            polygon_texture_base_add_persp_z(face->vcnt, vp, vw, face->bc, obj->base_map, face->rc, obj->add_map);
+        else
+            polygon_texture_base_add_z(face->vcnt, vp, face->bc, obj->base_map, face->rc, obj->add_map);
     }
 }
 
 void obj_3d_draw_textured_base_mul_add(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
     //Mul map and add map shall always have same dimensions. Dont draw otherwise.
@@ -349,10 +438,14 @@ void obj_3d_draw_textured_base_mul_add(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
             face->rc[j].u = (obj->vertices[face->vi[j]].normal_camera[0] - 1.0) * -(obj->mul_map->width-1)/2.0;
             face->rc[j].v = (obj->vertices[face->vi[j]].normal_camera[1] - 1.0) * -(obj->mul_map->height-1)/2.0;
         }
-        polygon_texture_base_mul_add_z(face->vcnt, vp, face->bc, obj->base_map, face->rc, obj->mul_map, obj->add_map);
+        if (obj->perspective_on)
+            polygon_texture_base_mul_add_persp_z(face->vcnt, vp, vw, face->bc, obj->base_map, face->rc, obj->mul_map, obj->add_map);
+        else
+            polygon_texture_base_mul_add_z(face->vcnt, vp, face->bc, obj->base_map, face->rc, obj->mul_map, obj->add_map);
     }
 }
 
@@ -370,12 +463,16 @@ void obj_3d_draw_fake_reflection(OBJ_3D *obj) {
             face->rc[j].u = (obj->vertices[face->vi[j]].normal_camera[0] - 1.0) * -(obj->reflection_map->width-1)/2.0;
             face->rc[j].v = (obj->vertices[face->vi[j]].normal_camera[1] - 1.0) * -(obj->reflection_map->height-1)/2.0;
         }
-        polygon_texture_base_z(face->vcnt, vp, face->rc, obj->reflection_map);
+        if (obj->halfspace_on)
+            triangle_texture_base_z(face->vcnt, vp, face->rc, obj->reflection_map);
+        else
+            polygon_texture_base_z(face->vcnt, vp, face->rc, obj->reflection_map);
     }
 }
 
 void obj_3d_draw_bump_fake_reflection(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
 
@@ -384,16 +481,27 @@ void obj_3d_draw_bump_fake_reflection(OBJ_3D *obj) {
         for (j = 0; j < face->vcnt; j++) {
             //Fetch vertex projection coordinates
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
             //Find reflection surface map coordinates
             face->rc[j].u = (obj->vertices[face->vi[j]].normal_camera[0] * (0.5-obj->bump_map->margin) + 0.5) * obj->reflection_map->width;
             face->rc[j].v = (obj->vertices[face->vi[j]].normal_camera[1] * (0.5-obj->bump_map->margin) + 0.5) * obj->reflection_map->height;
         }
-        polygon_texture_bump_z(face->vcnt, vp, face->bc, obj->bump_map, face->rc, obj->reflection_map);
+        if (obj->z_equal) {
+            if (obj->perspective_on)
+                polygon_texture_bump_persp_zeq(face->vcnt, vp, vw, face->bc, obj->bump_map, face->rc, obj->reflection_map);
+            else
+                polygon_texture_bump_zeq(face->vcnt, vp, face->bc, obj->bump_map, face->rc, obj->reflection_map);
+        }
+        else if (obj->perspective_on)
+            polygon_texture_bump_persp_z(face->vcnt, vp, vw, face->bc, obj->bump_map, face->rc, obj->reflection_map);
+        else
+            polygon_texture_bump_z(face->vcnt, vp, face->bc, obj->bump_map, face->rc, obj->reflection_map);
     }
 }
 
 void obj_3d_draw_solid_diff_textured(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
 
@@ -401,13 +509,26 @@ void obj_3d_draw_solid_diff_textured(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
+        }
+        if (obj->bilinear_on) {
+            if (obj->perspective_on)
+                polygon_solid_diff_texture_bilinear_persp_z(face->vcnt, vp, vw, &face->color_diff, face->bc, obj->base_map);
+            else
+                polygon_solid_diff_texture_bilinear_z(face->vcnt, vp, &face->color_diff, face->bc, obj->base_map);
         }
-        polygon_solid_diff_texture_z(face->vcnt, vp, &face->color_diff, face->bc, obj->base_map);
+        else if (obj->perspective_on)
+            polygon_solid_diff_texture_persp_z(face->vcnt, vp, vw, &face->color_diff, face->bc, obj->base_map);
+        else if (obj->halfspace_on)
+            triangle_solid_diff_texture_z(face->vcnt, vp, &face->color_diff, face->bc, obj->base_map);
+        else
+            polygon_solid_diff_texture_z(face->vcnt, vp, &face->color_diff, face->bc, obj->base_map);
     }
 }
 
 void obj_3d_draw_solid_spec_textured(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
 
@@ -415,13 +536,26 @@ void obj_3d_draw_solid_spec_textured(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
+        }
+        if (obj->bilinear_on) {
+            if (obj->perspective_on)
+                polygon_solid_spec_texture_bilinear_persp_z(face->vcnt, vp, vw, &face->color_spec, face->bc, obj->base_map);
+            else
+                polygon_solid_spec_texture_bilinear_z(face->vcnt, vp, &face->color_spec, face->bc, obj->base_map);
         }
-        polygon_solid_spec_texture_z(face->vcnt, vp, &face->color_spec, face->bc, obj->base_map);
+        else if (obj->perspective_on)
+            polygon_solid_spec_texture_persp_z(face->vcnt, vp, vw, &face->color_spec, face->bc, obj->base_map);
+        else if (obj->halfspace_on)
+            triangle_solid_spec_texture_z(face->vcnt, vp, &face->color_spec, face->bc, obj->base_map);
+        else
+            polygon_solid_spec_texture_z(face->vcnt, vp, &face->color_spec, face->bc, obj->base_map);
     }
 }
 
 void obj_3d_draw_solid_diff_spec_textured(OBJ_3D *obj) {
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     FACE *face;
     INT i, j;
 
@@ -429,14 +563,27 @@ void obj_3d_draw_solid_diff_spec_textured(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
         }
-        polygon_solid_diff_spec_texture_z(face->vcnt, vp, &face->color_diff, &face->color_spec, face->bc, obj->base_map);
+        if (obj->bilinear_on) {
+            if (obj->perspective_on)
+                polygon_solid_diff_spec_texture_bilinear_persp_z(face->vcnt, vp, vw, &face->color_diff, &face->color_spec, face->bc, obj->base_map);
+            else
+                polygon_solid_diff_spec_texture_bilinear_z(face->vcnt, vp, &face->color_diff, &face->color_spec, face->bc, obj->base_map);
+        }
+        else if (obj->perspective_on)
+            polygon_solid_diff_spec_texture_persp_z(face->vcnt, vp, vw, &face->color_diff, &face->color_spec, face->bc, obj->base_map);
+        else if (obj->halfspace_on)
+            triangle_solid_diff_spec_texture_z(face->vcnt, vp, &face->color_diff, &face->color_spec, face->bc, obj->base_map);
+        else
+            polygon_solid_diff_spec_texture_z(face->vcnt, vp, &face->color_diff, &face->color_spec, face->bc, obj->base_map);
     }
 }
 
 void obj_3d_draw_interp_diff_textured(OBJ_3D *obj) {
     FACE *face;
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     COLOR *vdiff[MAX_FACE_VERTICES];
     INT i, j;
 
@@ -445,15 +592,28 @@ void obj_3d_draw_interp_diff_textured(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
             vdiff[j] = &obj->vertices[face->vi[j]].color_diff;
         }
-        polygon_interp_diff_texture_z(face->vcnt, vp, vdiff, face->bc, obj->base_map);
+        if (obj->bilinear_on) {
+            if (obj->perspective_on)
+                polygon_interp_diff_texture_bilinear_persp_z(face->vcnt, vp, vw, vdiff, face->bc, obj->base_map);
+            else
+                polygon_interp_diff_texture_bilinear_z(face->vcnt, vp, vdiff, face->bc, obj->base_map);
+        }
+        else if (obj->perspective_on)
+            polygon_interp_diff_texture_persp_z(face->vcnt, vp, vw, vdiff, face->bc, obj->base_map);
+        else if (obj->halfspace_on)
+            triangle_interp_diff_texture_z(face->vcnt, vp, vdiff, face->bc, obj->base_map);
+        else
+            polygon_interp_diff_texture_z(face->vcnt, vp, vdiff, face->bc, obj->base_map);
     }
 }
 
 void obj_3d_draw_interp_spec_textured(OBJ_3D *obj) {
     FACE *face;
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     COLOR *vspec[MAX_FACE_VERTICES];
     INT i, j;
 
@@ -462,15 +622,28 @@ void obj_3d_draw_interp_spec_textured(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
             vspec[j] = &obj->vertices[face->vi[j]].color_spec;
         }
-        polygon_interp_spec_texture_z(face->vcnt, vp, vspec, face->bc, obj->base_map);
+        if (obj->bilinear_on) {
+            if (obj->perspective_on)
+                polygon_interp_spec_texture_bilinear_persp_z(face->vcnt, vp, vw, vspec, face->bc, obj->base_map);
+            else
+                polygon_interp_spec_texture_bilinear_z(face->vcnt, vp, vspec, face->bc, obj->base_map);
+        }
+        else if (obj->perspective_on)
+            polygon_interp_spec_texture_persp_z(face->vcnt, vp, vw, vspec, face->bc, obj->base_map);
+        else if (obj->halfspace_on)
+            triangle_interp_spec_texture_z(face->vcnt, vp, vspec, face->bc, obj->base_map);
+        else
+            polygon_interp_spec_texture_z(face->vcnt, vp, vspec, face->bc, obj->base_map);
     }
 }
 
 void obj_3d_draw_interp_diff_spec_textured(OBJ_3D *obj) {
     FACE *face;
     PROJECTION_COORD *vp[MAX_FACE_VERTICES]; //vertices of currently drawn face
+    FLOAT vw[MAX_FACE_VERTICES]; //1/W of currently drawn face vertices
     COLOR *vdiff[MAX_FACE_VERTICES];
     COLOR *vspec[MAX_FACE_VERTICES];
     INT i, j;
@@ -480,10 +653,34 @@ void obj_3d_draw_interp_diff_spec_textured(OBJ_3D *obj) {
         face = obj->front_faces[i];
         for (j = 0; j < face->vcnt; j++) {
             vp[j] = (PROJECTION_COORD*)obj->vertices[face->vi[j]].projection;
+            vw[j] = obj->vertices[face->vi[j]].projection_w_inv;
             vdiff[j] = &obj->vertices[face->vi[j]].color_diff;
             vspec[j] = &obj->vertices[face->vi[j]].color_spec;
         }
-        polygon_interp_diff_spec_texture_z(face->vcnt, vp, vdiff, vspec, face->bc, obj->base_map);
+        if (obj->z_equal) {
+            if (obj->bilinear_on) {
+                if (obj->perspective_on)
+                    polygon_interp_diff_spec_texture_bilinear_persp_zeq(face->vcnt, vp, vw, vdiff, vspec, face->bc, obj->base_map);
+                else
+                    polygon_interp_diff_spec_texture_bilinear_zeq(face->vcnt, vp, vdiff, vspec, face->bc, obj->base_map);
+            }
+            else if (obj->perspective_on)
+                polygon_interp_diff_spec_texture_persp_zeq(face->vcnt, vp, vw, vdiff, vspec, face->bc, obj->base_map);
+            else
+                polygon_interp_diff_spec_texture_zeq(face->vcnt, vp, vdiff, vspec, face->bc, obj->base_map);
+        }
+        else if (obj->bilinear_on) {
+            if (obj->perspective_on)
+                polygon_interp_diff_spec_texture_bilinear_persp_z(face->vcnt, vp, vw, vdiff, vspec, face->bc, obj->base_map);
+            else
+                polygon_interp_diff_spec_texture_bilinear_z(face->vcnt, vp, vdiff, vspec, face->bc, obj->base_map);
+        }
+        else if (obj->perspective_on)
+            polygon_interp_diff_spec_texture_persp_z(face->vcnt, vp, vw, vdiff, vspec, face->bc, obj->base_map);
+        else if (obj->halfspace_on)
+            triangle_interp_diff_spec_texture_z(face->vcnt, vp, vdiff, vspec, face->bc, obj->base_map);
+        else
+            polygon_interp_diff_spec_texture_z(face->vcnt, vp, vdiff, vspec, face->bc, obj->base_map);
     }
 }
 
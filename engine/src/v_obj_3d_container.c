@@ -151,6 +151,7 @@ void obj_3d_container_transform_geometry(OBJ_3D_CONTAINER *cont, MAT_4_4 *camera
 
     //Vertex transform to camera space and perspective projection
     VEC_4 *c;
+    obj->zmin = Z_BUFFER_MAX;
     for(INT i = 0; i < obj->vcnt; i++) {
         if (obj->vertices[i].front) {
             if (rotate_vertex_normals) {
@@ -158,13 +159,17 @@ void obj_3d_container_transform_geometry(OBJ_3D_CONTAINER *cont, MAT_4_4 *camera
                     sub_vv(mul_mv(&camera_normals_transform, &obj->vertices[i].normal_root), &obj->zero_camera));
             }
             c = mul_mv(&projection_transform, &obj->vertices[i].root);
-            //X perspective division
-            obj->vertices[i].projection[0] = (*c)[0]/(*c)[3] + scr_w/2.0;
-            //Y perspective division, inverse back Y axis
-            obj->vertices[i].projection[1] = (*c)[1]/(*c)[3] + scr_h/2.0;
+            //X perspective division, in subpixels
+            obj->vertices[i].projection[0] = ((*c)[0]/(*c)[3] + scr_w/2.0)*SUBPIXEL_SIZE;
+            //Y perspective division, inverse back Y axis, in subpixels
+            obj->vertices[i].projection[1] = ((*c)[1]/(*c)[3] + scr_h/2.0)*SUBPIXEL_SIZE;
             //TODO frustum Z occlusion should go here?
             //rescale frustum Z value to Z-buffer space [0, zbuf_max]
             obj->vertices[i].projection[2] = (FLOAT)Z_BUFFER_MAX * (*c)[2];
+            if (obj->vertices[i].projection[2] < obj->zmin)
+                obj->zmin = obj->vertices[i].projection[2];
+            //W reciprocal is interpolated linearly in screen space by perspective correct rasterizers
+            obj->vertices[i].projection_w_inv = 1.0/(*c)[3];
         }
     }
 }
@@ -15,17 +15,45 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "engine.h"
+#include "simd.h"
 
 #define RIGHT_EDGE (1)
 #define LEFT_EDGE (0)
 
+//Length of polygon bar section, where perspective correct texture coordinates are interpolated linearly.
+//Exact perspective division is done only at the ends of each section.
+#define PERSP_SPAN (16)
+//Convert texture coordinate from floating point (already scaled to fixed point) to INT, limited to [0, max]
+#define PERSP_COORD(f, max) ((f) > 0. ? ((f) < (FLOAT)(max) ? (INT)(f) : (max)) : 0)
+//Index of the tiled map pixel from fixed point U, V map coordinates:
+//tile row | tile column | row inside of the tile | column inside of the tile
+#define TILED_TEXEL(u, v, v_shift) \
+    (((v) & ~(FRACT_MASK | (MAP_TILE_MASK << FRACT_SHIFT))) >> (v_shift) | \
+    (((u) >> (FRACT_SHIFT - MAP_TILE_SHIFT)) & ~(MAP_TILE_SIZE*MAP_TILE_SIZE - 1)) | \
+    (((v) >> (FRACT_SHIFT - MAP_TILE_SHIFT)) & (MAP_TILE_MASK << MAP_TILE_SHIFT)) | \
+    (((u) >> FRACT_SHIFT) & MAP_TILE_MASK))
+
+//Z buffer value of projected Z z. With frame epoch Z (Z_MAP.epoch_on) it is shifted down
+//by Z_EPOCH_BITS and offset by the current epoch, otherwise it's z itself.
+#define Z_KEY(z) (vz_epoch_base + ((z) >> vz_epoch_shift))
+//Line pixel with Z buffer offset offs and projected Z z is not behind Z buffer contents (always visible without Z buffer)
+#define LINE_Z_VISIBLE(offs, z) \
+    (vzb16 != NULL ? Z_TO_Z16(z) <= vzb16[offs] : vzb == NULL || (Z_PIXEL)(z) <= vzb[offs])
+
 ARGB_PIXEL *vhbb = NULL; //vector horizontal bar buffer
 void *polygon_edge_poll = NULL;
 
 ARGB_PIXEL *vrb = NULL; //vector renderer render buffer
 Z_PIXEL *vzb = NULL; //vector renderer z buffer
+Z16_PIXEL *vzb16 = NULL; //vector renderer 16 bit z buffer, used instead of vzb if not NULL
+INT vz_epoch_base = 0, vz_epoch_shift = 0; //frame epoch of the z buffer, see Z_KEY()
+Z_MAP *vzm = NULL; //vector renderer z map (for coarse Z buffer tiles)
+ARGB_MAP *vrm = NULL; //vector renderer map (for dirty tiles)
+SPAN_BUFFER *vsb = NULL; //span buffer for polygon_solid_span()
 INT vrb_width = 0;
 INT vrb_height = 0;
+INT vrb_stride = 0; //distance between rows of render buffer pixels and Z values
+OVERDRAW_STATS vr_overdraw = {0}; //overdraw counters, updated only with RENDER_STATS defined
 
 INT get_abs(const INT x) {
     return x<0 ? -x : x;
@@ -45,11 +73,71 @@ void vr_init() {
     vr_geometry_init();
 }
 
+/*
+ Set the render buffer of rasterizers. Without Z buffer (rb->z == NULL) only span buffer
+ emission and lines can be drawn into it. Rasterizers write pixels directly, so pending
+ deferred map operations are executed first.
+*/
 void vr_set_render_buffer(const RENDER_BUFFER* rb) {
+    map_graph_flush();
     vrb = rb->map->data;
-    vzb = rb->z->data;
+    vzb = rb->z != NULL ? rb->z->data : NULL;
+    vzb16 = rb->z != NULL ? rb->z->data16 : NULL;
+    vz_epoch_base = 0;
+    vz_epoch_shift = 0;
+    if (rb->z != NULL && rb->z->epoch_on && rb->z->data != NULL) {
+        vz_epoch_base = rb->z->epoch << Z_EPOCH_SHIFT;
+        vz_epoch_shift = Z_EPOCH_BITS;
+    }
+    vzm = rb->z;
+    vrm = rb->map;
     vrb_width = rb->width;
     vrb_height = rb->height;
+    vrb_stride = rb->map->stride; //Z map of the same width has the same stride
+}
+
+void vr_set_span_buffer(SPAN_BUFFER* sb) {
+    vsb = sb;
+}
+
+OVERDRAW_STATS vr_overdraw_stats() {
+    return vr_overdraw;
+}
+
+void vr_overdraw_stats_reset() {
+    vr_overdraw.shaded = 0;
+    vr_overdraw.covered = 0;
+}
+
+//Add pixels shaded outside of polygon rasterizers (deferred shading) to the stats
+void vr_overdraw_add_shaded(INT cnt) {
+#ifdef RENDER_STATS
+    vr_overdraw.shaded += cnt;
+#endif
+}
+
+//Add pixels of current render buffer covered by the geometry (Z written) to the stats
+void vr_overdraw_count_coverage() {
+    INT x, y;
+    if (vzb16 != NULL) {
+        for (y = 0; y < vrb_height; y++)
+            for (x = y*vrb_stride; x < y*vrb_stride + vrb_width; x++)
+                if (vzb16[x] != Z16_CLEAR)
+                    vr_overdraw.covered++;
+        return;
+    }
+    if (vz_epoch_shift != 0) {
+        //Pixels of older frame epochs are cleared ones
+        for (y = 0; y < vrb_height; y++)
+            for (x = y*vrb_stride; x < y*vrb_stride + vrb_width; x++)
+                if (vzb[x] >> Z_EPOCH_SHIFT == (UINT)vz_epoch_base >> Z_EPOCH_SHIFT)
+                    vr_overdraw.covered++;
+        return;
+    }
+    for (y = 0; y < vrb_height; y++)
+        for (x = y*vrb_stride; x < y*vrb_stride + vrb_width; x++)
+            if (vzb[x] != (Z_PIXEL)0xFFFFFFFF)
+                vr_overdraw.covered++;
 }
 
 void vr_cleanup() {
@@ -81,7 +169,7 @@ void line_flat_draw_h_bar(ARGB_PIXEL* ptr, const INT offset, const ARGB_PIXEL v)
 void line_flat_draw_v_bar(ARGB_PIXEL* ptr, const INT offset, const ARGB_PIXEL v)
 {
     ARGB_PIXEL* curr_ptr = ptr;
-    ARGB_PIXEL* end_ptr = ptr + offset*vrb_width;
+    ARGB_PIXEL* end_ptr = ptr + offset*vrb_stride;
     if (offset == 0) {
         *curr_ptr = v;
     }
@@ -90,9 +178,9 @@ void line_flat_draw_v_bar(ARGB_PIXEL* ptr, const INT offset, const ARGB_PIXEL v)
         {
             *curr_ptr = v;
             if (offset > 0)
-                curr_ptr+=vrb_width;
+                curr_ptr+=vrb_stride;
             else
-                curr_ptr-=vrb_width;
+                curr_ptr-=vrb_stride;
         }
     }
 }
@@ -126,6 +214,7 @@ void line_flat(INT x0, INT y0, INT x1, INT y1, COLOR *color)
         xmax = x1;
     /* If line is outside of the render buffer then skip drawing it altogether */
     if (xmax < 0 || xmin > vrb_width-1 || y1 < 0 || y0 > vrb_height-1) return;
+    ARGB_MAP_mark_dirty(vrm, xmin, y0, xmax, y1);
 
     bool intersect = false; //flag indicating that at least one intersection was found
 
@@ -211,9 +300,9 @@ void line_flat(INT x0, INT y0, INT x1, INT y1, COLOR *color)
     dy = y1c - y0c;
 
     if (get_abs(dx) >= get_abs(dy)) {
-        py = y0c*vrb_width;
-        py1 = y1c*vrb_width;
-        pdy = get_sign(dy)*vrb_width;
+        py = y0c*vrb_stride;
+        py1 = y1c*vrb_stride;
+        pdy = get_sign(dy)*vrb_stride;
 
         px = (x0c << FRACT_SHIFT)+(1 << (FRACT_SHIFT-1));
         dx += get_sign(dx);
@@ -240,11 +329,11 @@ void line_flat(INT x0, INT y0, INT x1, INT y1, COLOR *color)
         while (px != px1) {
             py_prev = py;
             py += pdy;
-            line_flat_draw_v_bar(vrb+(py_prev >> FRACT_SHIFT)*vrb_width+px, (py >> FRACT_SHIFT)-(py_prev >> FRACT_SHIFT), pix_val);
+            line_flat_draw_v_bar(vrb+(py_prev >> FRACT_SHIFT)*vrb_stride+px, (py >> FRACT_SHIFT)-(py_prev >> FRACT_SHIFT), pix_val);
             px += pdx;
         }
         bar_length = y1c-(py >> FRACT_SHIFT);
-        line_flat_draw_v_bar(vrb+(py >> FRACT_SHIFT)*vrb_width+px, bar_length + get_sign(bar_length), pix_val);
+        line_flat_draw_v_bar(vrb+(py >> FRACT_SHIFT)*vrb_stride+px, bar_length + get_sign(bar_length), pix_val);
     }
 }
 
@@ -258,12 +347,12 @@ void line_flat_z(PROJECTION_COORD** v, COLOR *color)
     INT xmin=0, xmax=0;
     ARGB_PIXEL pix_val = COLOR_to_ARGB_PIXEL(color);
 
-    x0 = (*v[0])[0];
-    x1 = (*v[1])[0];
-    y0 = (*v[0])[1];
-    y1 = (*v[1])[1];
-    z0 = (*v[0])[2];
-    z1 = (*v[1])[2];
+    x0 = (*v[0])[0] >> SUBPIXEL_SHIFT;
+    x1 = (*v[1])[0] >> SUBPIXEL_SHIFT;
+    y0 = (*v[0])[1] >> SUBPIXEL_SHIFT;
+    y1 = (*v[1])[1] >> SUBPIXEL_SHIFT;
+    z0 = Z_KEY((*v[0])[2]);
+    z1 = Z_KEY((*v[1])[2]);
 
     /* Make sure that original point 0 is higher than original point 1 */
     if (y1 < y0) {
@@ -284,6 +373,7 @@ void line_flat_z(PROJECTION_COORD** v, COLOR *color)
 
     /* If line is outside of render buffer then skip drawing line altogether */
     if (xmax < 0 || xmin > vrb_width-1 || y1 < 0 || y0 > vrb_height-1) return;
+    ARGB_MAP_mark_dirty(vrm, xmin, y0, xmax, y1);
 
     bool intersect = false; //flag indicating that at least one intersection was found
 
@@ -387,12 +477,12 @@ void line_flat_z(PROJECTION_COORD** v, COLOR *color)
     INT z=0, pdz=0; //current z, pixel delta z
     INT fc = 0, fp = 0; //floor of current x/y, floor of previous x/y
     ARGB_PIXEL* pix_ptr = NULL, *final_pix_ptr = NULL;
-    Z_PIXEL *zbuf_ptr = NULL;
+    INT zbuf_offs = 0;
     INT ptr_delta_switch = 0, ptr_delta_no_switch = 0;
 
-    pix_ptr = vrb + y0c*vrb_width + x0c; //initial drawing pixel
-    zbuf_ptr = vzb + y0c*vrb_width + x0c; //initial Z buffer pixel
-    final_pix_ptr = vrb + y1c*vrb_width + x1c; //final drawing pixel
+    pix_ptr = vrb + y0c*vrb_stride + x0c; //initial drawing pixel
+    zbuf_offs = y0c*vrb_stride + x0c; //initial Z buffer pixel offset
+    final_pix_ptr = vrb + y1c*vrb_stride + x1c; //final drawing pixel
     xi = dx >= 0 ? 1 : -1; //x increment
     z = z0;
 
@@ -400,20 +490,20 @@ void line_flat_z(PROJECTION_COORD** v, COLOR *color)
         c = (y0c << FRACT_SHIFT) + (1 << (FRACT_SHIFT-1)); //y coordinate (fixed point), later updated after each drawn pixel
         pdc = dx!=0 ? (dy<<FRACT_SHIFT)/get_abs(dx) : 0; //y coordinate delta (fixed point), for each line pixel
         pdz = dx!=0 ? dz/get_abs(dx) : 0; //y coordinate delta (fixed point), for each line pixel
-        ptr_delta_switch = vrb_width+xi; //offset between adjacent pixels on the line. With y coordinate increment
+        ptr_delta_switch = vrb_stride+xi; //offset between adjacent pixels on the line. With y coordinate increment
         ptr_delta_no_switch = xi; //offset between adjacent pixels on the line. No y coordinate increment
     }
     else { //line is longer vertically than horizontally
         c = (x0c << FRACT_SHIFT) + (1 << (FRACT_SHIFT-1));
         pdc = dy!=0 ? (dx<<FRACT_SHIFT)/dy : 0;
         pdz = dy!=0 ? dz/dy : 0;
-        ptr_delta_switch = vrb_width+xi;
-        ptr_delta_no_switch = vrb_width;
+        ptr_delta_switch = vrb_stride+xi;
+        ptr_delta_no_switch = vrb_stride;
     }
     fc = c >> FRACT_SHIFT; //first pixel integer coordinate
 
     while(pix_ptr != final_pix_ptr) {
-        if (z <= *zbuf_ptr)
+        if (LINE_Z_VISIBLE(zbuf_offs, z))
             *pix_ptr = pix_val; //draw current pixel
         fp = fc;
         c += pdc; //calculate next pixel coordinate (fixed point)
@@ -421,20 +511,89 @@ void line_flat_z(PROJECTION_COORD** v, COLOR *color)
         fc = c >> FRACT_SHIFT; //get integer for next pixel coordinate
         if (fc != fp) { //switch to next pixel depending where it is located
             pix_ptr += ptr_delta_switch;
-            zbuf_ptr += ptr_delta_switch;
+            zbuf_offs += ptr_delta_switch;
         }
         else {
             pix_ptr += ptr_delta_no_switch;
-            zbuf_ptr += ptr_delta_no_switch;
+            zbuf_offs += ptr_delta_no_switch;
         }
     }
-    if (z <= *zbuf_ptr)
+    if (LINE_Z_VISIBLE(zbuf_offs, z))
         *pix_ptr = pix_val;
 }
 
 //////////////////////////////////////////////
 // POLYGONS
 //////////////////////////////////////////////
+/*
+ Returns true if all Z buffer tiles covering pixels (x0, y0)-(x1, y1) have maximum Z not greater than z.
+ Nothing at depth z (or further) can be visible there.
+*/
+bool z_tiles_occluded(INT x0, INT y0, INT x1, INT y1, INT z)
+{
+    Z_PIXEL *tile_ptr, *end_ptr;
+    INT ty;
+    if (z < 0 || vzm == NULL)
+        return false;
+    x0 = x0 < 0 ? 0 : x0 >> Z_TILE_SHIFT;
+    y0 = y0 < 0 ? 0 : y0 >> Z_TILE_SHIFT;
+    x1 = (x1 > vrb_width-1 ? vrb_width-1 : x1) >> Z_TILE_SHIFT;
+    y1 = (y1 > vrb_height-1 ? vrb_height-1 : y1) >> Z_TILE_SHIFT;
+    for (ty = y0; ty <= y1; ty++) {
+        tile_ptr = vzm->tile_max + ty*vzm->tile_cols + x0;
+        end_ptr = tile_ptr + (x1 - x0);
+        for (; tile_ptr <= end_ptr; tile_ptr++)
+            if (*tile_ptr > (Z_PIXEL)z)
+                return false;
+    }
+    return true;
+}
+
+/*
+ Add Z buffer tiles covering pixels (x0, y0)-(x1, y1) to the dirty tiles range.
+*/
+void z_tiles_mark(INT x0, INT y0, INT x1, INT y1)
+{
+    if (vzm == NULL)
+        return;
+    x0 = x0 < 0 ? 0 : x0 >> Z_TILE_SHIFT;
+    y0 = y0 < 0 ? 0 : y0 >> Z_TILE_SHIFT;
+    x1 = (x1 > vrb_width-1 ? vrb_width-1 : x1) >> Z_TILE_SHIFT;
+    y1 = (y1 > vrb_height-1 ? vrb_height-1 : y1) >> Z_TILE_SHIFT;
+    if (x0 < vzm->dirty_x0) vzm->dirty_x0 = x0;
+    if (y0 < vzm->dirty_y0) vzm->dirty_y0 = y0;
+    if (x1 > vzm->dirty_x1) vzm->dirty_x1 = x1;
+    if (y1 > vzm->dirty_y1) vzm->dirty_y1 = y1;
+}
+
+/*
+ Select mipmap level of the map for the polygon. Every level reduces texel area 4 times.
+ The first level with polygon texel area less than 4 times its screen area is used.
+ Returns selected level map, level number is stored in *level.
+ mc are the map coordinates of polygon vertices (on the level 0).
+*/
+const ARGB_MAP *map_mip_level(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mc, const ARGB_MAP *map, INT *level)
+{
+    FLOAT area_s = 0., area_t = 0.; //doubled screen and texel area of the polygon
+    INT i, j;
+    *level = 0;
+    if (map->mip == NULL)
+        return map;
+    for (i = 0, j = vcnt-1; i < vcnt; j = i++) {
+        area_s += (FLOAT)((*vp[j])[0] + (*vp[i])[0]) * (FLOAT)((*vp[j])[1] - (*vp[i])[1]);
+        area_t += (FLOAT)(mc[j].u + mc[i].u) * (FLOAT)(mc[j].v - mc[i].v);
+    }
+    area_s /= SUBPIXEL_SIZE*SUBPIXEL_SIZE;
+    if (area_s < 0.) area_s = -area_s;
+    if (area_t < 0.) area_t = -area_t;
+    while (map->mip != NULL && area_t >= 4.*area_s) {
+        map = map->mip;
+        area_t *= 0.25;
+        (*level)++;
+    }
+    return map;
+}
+
 void polygon_solid(INT vcnt, PROJECTION_COORD** vp, COLOR *color)
 {
 #define USE_SOLID 1
@@ -451,6 +610,34 @@ void polygon_solid_z(INT vcnt, PROJECTION_COORD** vp, COLOR *color)
 #undef USE_Z
 }
 
+//////////////////////////////////////////////
+//Polygon filled with solid color inserted into the span buffer
+//set by vr_set_span_buffer(), instead of being drawn.
+//////////////////////////////////////////////
+void polygon_solid_span(INT vcnt, PROJECTION_COORD** vp, COLOR *color)
+{
+#define USE_Z 1
+#define USE_SOLID 1
+#define USE_SPAN 1
+#include "polygon.h"
+#undef USE_SPAN
+#undef USE_SOLID
+#undef USE_Z
+}
+
+//////////////////////////////////////////////
+//Polygon with z test filled with constant 32 bit value.
+//Used for rasterization of visibility buffer IDs.
+//////////////////////////////////////////////
+void polygon_id_z(INT vcnt, PROJECTION_COORD** vp, UINT id)
+{
+#define USE_Z 1
+#define USE_ID 1
+#include "polygon.h"
+#undef USE_ID
+#undef USE_Z
+}
+
 //////////////////////////////////////////////
 //Gouraud shaded polygon with z test
 //////////////////////////////////////////////
@@ -463,6 +650,171 @@ void polygon_interp_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vcolor)
 #undef USE_Z
 }
 
+//////////////////////////////////////////////
+//Half-space rasterized variants of polygon_solid_z and polygon_interp_z,
+//polygons are drawn as triangle fans
+//////////////////////////////////////////////
+void triangle_solid_z(INT vcnt, PROJECTION_COORD** vp, COLOR *color)
+{
+#define USE_Z 1
+#define USE_SOLID 1
+#include "triangle.h"
+#undef USE_SOLID
+#undef USE_Z
+}
+
+void triangle_interp_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vcolor)
+{
+#define USE_Z 1
+#define USE_INTERP 1
+#include "triangle.h"
+#undef USE_INTERP
+#undef USE_Z
+}
+
+//////////////////////////////////////////////
+//Affine textured half-space triangles with z test
+//////////////////////////////////////////////
+void triangle_texture_base_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "triangle.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "triangle.h"
+    }
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void triangle_solid_diff_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "triangle.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "triangle.h"
+    }
+#undef USE_MAP_BASE
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void triangle_solid_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "triangle.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "triangle.h"
+    }
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void triangle_solid_diff_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "triangle.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "triangle.h"
+    }
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void triangle_interp_diff_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "triangle.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "triangle.h"
+    }
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void triangle_interp_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_SPEC 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "triangle.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "triangle.h"
+    }
+#undef USE_SPEC
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void triangle_interp_diff_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "triangle.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "triangle.h"
+    }
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
 //////////////////////////////////////////////
 //Affine textured polygon with z test
 //////////////////////////////////////////////
@@ -470,7 +822,14 @@ void polygon_texture_base_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, con
 {
 #define USE_Z 1
 #define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_MAP_BASE
 #undef USE_Z
 }
@@ -497,7 +856,14 @@ void polygon_texture_base_mul_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc,
 #define USE_Z 1
 #define USE_MAP_BASE 1
 #define USE_MAP_MUL 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_MAP_MUL
 #undef USE_MAP_BASE
 #undef USE_Z
@@ -508,7 +874,14 @@ void polygon_texture_base_add_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc,
 #define USE_Z 1
 #define USE_MAP_BASE 1
 #define USE_MAP_ADD 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_MAP_ADD
 #undef USE_MAP_BASE
 #undef USE_Z
@@ -520,7 +893,14 @@ void polygon_texture_base_mul_add_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *
 #define USE_MAP_BASE 1
 #define USE_MAP_MUL 1
 #define USE_MAP_ADD 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_MAP_ADD
 #undef USE_MAP_MUL
 #undef USE_MAP_BASE
@@ -533,7 +913,14 @@ void polygon_solid_diff_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff,
 #define USE_FLAT 1
 #define USE_DIFF 1
 #define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_MAP_BASE
 #undef USE_DIFF
 #undef USE_FLAT
@@ -546,7 +933,14 @@ void polygon_solid_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *spec,
 #define USE_FLAT 1
 #define USE_SPEC 1
 #define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_MAP_BASE
 #undef USE_SPEC
 #undef USE_FLAT
@@ -560,7 +954,14 @@ void polygon_solid_diff_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *d
 #define USE_DIFF 1
 #define USE_SPEC 1
 #define USE_MAP_BASE 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_MAP_BASE
 #undef USE_SPEC
 #undef USE_DIFF
@@ -574,7 +975,14 @@ void polygon_interp_diff_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdif
 #define USE_MAP_BASE 1
 #define USE_INTERP 1
 #define USE_DIFF 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_DIFF
 #undef USE_INTERP
 #undef USE_MAP_BASE
@@ -587,7 +995,14 @@ void polygon_interp_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vspe
 #define USE_MAP_BASE 1
 #define USE_INTERP 1
 #define USE_SPEC 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
 #include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
 #undef USE_SPEC
 #undef USE_INTERP
 #undef USE_MAP_BASE
@@ -601,10 +1016,725 @@ void polygon_interp_diff_spec_texture_z(INT vcnt, PROJECTION_COORD** vp, COLOR *
 #define USE_INTERP 1
 #define USE_DIFF 1
 #define USE_SPEC 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+//////////////////////////////////////////////
+//Perspective correct textured polygons with z test.
+//Base map coordinates are interpolated as u/w, v/w and 1/w,
+//vw contains 1/w for every polygon vertex.
+//Remaining maps and colors are interpolated affine.
+//////////////////////////////////////////////
+void polygon_texture_base_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_texture_bump_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const BUMP_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mref)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_MAP_BUMP 1
+#define USE_PERSP 1
+#include "polygon.h"
+#undef USE_PERSP
+#undef USE_MAP_BUMP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_texture_base_mul_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mmul)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_MAP_MUL 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_MAP_MUL
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_texture_base_add_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const madd)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_MAP_ADD 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
 #include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_MAP_ADD
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_texture_base_mul_add_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mmul, const ARGB_MAP * const madd)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_MAP_MUL 1
+#define USE_MAP_ADD 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_MAP_ADD
+#undef USE_MAP_MUL
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_solid_diff_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_solid_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_solid_diff_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_interp_diff_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_interp_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_SPEC 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_SPEC
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_interp_diff_spec_texture_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+//////////////////////////////////////////////
+//Bilinear filtered textured polygons with z test.
+//Affine and perspective correct variants.
+//////////////////////////////////////////////
+void polygon_texture_base_bilinear_z(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_solid_diff_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_MAP_BASE 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_MAP_BASE
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_solid_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_solid_diff_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_interp_diff_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_interp_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_SPEC 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_SPEC
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_interp_diff_spec_texture_bilinear_z(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_texture_base_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_solid_diff_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_solid_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_solid_diff_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR *diff, COLOR *spec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_FLAT 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_MAP_BASE 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
+#undef USE_MAP_BASE
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_FLAT
+#undef USE_Z
+}
+
+void polygon_interp_diff_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_interp_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_SPEC 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
+#undef USE_SPEC
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+void polygon_interp_diff_spec_texture_bilinear_persp_z(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z
+}
+
+//////////////////////////////////////////////
+//Z pre-pass.
+//polygon_z_only writes only polygon Z into Z buffer.
+//_zeq variants of expensive polygons shade only pixels with Z equal to
+//Z buffer value (written in the pre-pass) and don't modify Z buffer.
+//////////////////////////////////////////////
+void polygon_z_only(INT vcnt, PROJECTION_COORD** vp)
+{
+#define USE_Z 1
+#define USE_Z_ONLY 1
+#include "polygon.h"
+#undef USE_Z_ONLY
+#undef USE_Z
+}
+
+void polygon_texture_bump_zeq(INT vcnt, PROJECTION_COORD** vp, MAP_COORD *mbc, const BUMP_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mref)
+{
+#define USE_Z 1
+#define USE_Z_EQUAL 1
+#define USE_MAP_BASE 1
+#define USE_MAP_BUMP 1
+#include "polygon.h"
+#undef USE_MAP_BUMP
+#undef USE_MAP_BASE
+#undef USE_Z_EQUAL
+#undef USE_Z
+}
+
+void polygon_texture_bump_persp_zeq(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, MAP_COORD *mbc, const BUMP_MAP * const mbase, MAP_COORD *mrc, const ARGB_MAP * const mref)
+{
+#define USE_Z 1
+#define USE_Z_EQUAL 1
+#define USE_MAP_BASE 1
+#define USE_MAP_BUMP 1
+#define USE_PERSP 1
+#include "polygon.h"
+#undef USE_PERSP
+#undef USE_MAP_BUMP
+#undef USE_MAP_BASE
+#undef USE_Z_EQUAL
+#undef USE_Z
+}
+
+void polygon_interp_diff_spec_texture_zeq(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_Z_EQUAL 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z_EQUAL
+#undef USE_Z
+}
+
+void polygon_interp_diff_spec_texture_persp_zeq(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_Z_EQUAL 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_PERSP 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_PERSP
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z_EQUAL
+#undef USE_Z
+}
+
+void polygon_interp_diff_spec_texture_bilinear_zeq(INT vcnt, PROJECTION_COORD** vp, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_Z_EQUAL 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_SPEC
+#undef USE_DIFF
+#undef USE_INTERP
+#undef USE_MAP_BASE
+#undef USE_Z_EQUAL
+#undef USE_Z
+}
+
+void polygon_interp_diff_spec_texture_bilinear_persp_zeq(INT vcnt, PROJECTION_COORD** vp, FLOAT *vw, COLOR **vdiff, COLOR **vspec, MAP_COORD *mbc, const ARGB_MAP * const mbase)
+{
+#define USE_Z 1
+#define USE_Z_EQUAL 1
+#define USE_MAP_BASE 1
+#define USE_INTERP 1
+#define USE_DIFF 1
+#define USE_SPEC 1
+#define USE_PERSP 1
+#define USE_BILINEAR 1
+    if (mbase->tiled) {
+#define USE_MAP_TILED 1
+#include "polygon.h"
+#undef USE_MAP_TILED
+    }
+    else {
+#include "polygon.h"
+    }
+#undef USE_BILINEAR
+#undef USE_PERSP
 #undef USE_SPEC
 #undef USE_DIFF
 #undef USE_INTERP
 #undef USE_MAP_BASE
+#undef USE_Z_EQUAL
 #undef USE_Z
 }
@@ -25,6 +25,16 @@ SCENE_3D* scene_3d(RENDER_BUFFER* render_buf, INT max_objects, INT max_lights) {
     scene->renderable_cnt = 0;
     scene->light = calloc(max_lights, sizeof(OBJ_3D_CONTAINER*));
     scene->light_cnt = 0;
+    scene->queue = calloc(max_objects, sizeof(OBJ_3D_CONTAINER*));
+    scene->queue_cnt = 0;
+    scene->sort_objects = true;
+    scene->sort_faces = false;
+    scene->z_prepass = false;
+    scene->deferred = false;
+    scene->vis = NULL;
+    scene->vis_tiles = NULL;
+    scene->span_buffer = false;
+    scene->sbuf = NULL;
     copy_v4(&scene->camera.look_at, &(VEC_4){0.0, 0.0, 0.0, 0.0});
     copy_v4(&scene->camera.pos, &(VEC_4){0.0, 0.0, 0.0, 0.0});
     scene->camera.roll = 0.0;
@@ -49,6 +59,10 @@ void scene_3d_free(SCENE_3D* scene) {
     free(scene->root);
     free(scene->renderable);
     free(scene->light);
+    free(scene->queue);
+    ARGB_MAP_free(scene->vis);
+    free(scene->vis_tiles);
+    SPAN_BUFFER_free(scene->sbuf);
     free(scene);
 }
 
@@ -141,11 +155,162 @@ void scene_3d_transform_and_light(SCENE_3D* scene) {
         if (scene->light_settings.enabled)
             obj_3d_container_apply_light(scene->renderable[i]);
     }
+
+    scene_3d_build_render_queue(scene);
+}
+
+void scene_3d_build_render_queue(SCENE_3D* scene) {
+    OBJ_3D_CONTAINER *cont;
+    INT i, j, opaque_cnt = 0;
+
+    scene->queue_cnt = 0;
+    // Opaque objects go first, sorted front-to-back by their nearest projected Z
+    // (insertion sort: object counts are small and the order is stable between frames).
+    for (i = 0; i < scene->renderable_cnt; i++) {
+        cont = scene->renderable[i];
+        if (cont->obj->type == PARTICLES)
+            continue;
+        for (j = opaque_cnt; j > 0 && scene->sort_objects && scene->queue[j-1]->obj->zmin > cont->obj->zmin; j--)
+            scene->queue[j] = scene->queue[j-1];
+        scene->queue[j] = cont;
+        opaque_cnt++;
+        if (scene->sort_faces)
+            obj_3d_sort_front_faces(cont->obj);
+    }
+    // Non-opaque objects are drawn afterwards in insertion order
+    scene->queue_cnt = opaque_cnt;
+    for (i = 0; i < scene->renderable_cnt; i++)
+        if (scene->renderable[i]->obj->type == PARTICLES)
+            scene->queue[scene->queue_cnt++] = scene->renderable[i];
+}
+
+//Object types with shading expensive enough to be worth Z pre-pass
+bool z_prepass_type(OBJ_3D_TYPE type) {
+    return type == INTERP_DIFF_SPEC_TEXTURED || type == TX_MAP_BUMP_REFLECTION;
+}
+
+//Rendering passes of render queue objects
+#define PASS_FORWARD 0
+#define PASS_Z_PREPASS 1
+#define PASS_DEFERRED 2
+#define PASS_SPAN 3
+
+//Object types drawn with span buffer: single color faces
+bool span_type(OBJ_3D_TYPE type) {
+    return type == SOLID_UNSHADED || type == SOLID_DIFF || type == SOLID_SPEC || type == SOLID_DIFF_SPEC;
+}
+
+INT render_pass(SCENE_3D* scene, INT queue_index) {
+    if (scene->span_buffer && span_type(scene->queue[queue_index]->obj->type))
+        return PASS_SPAN;
+    if (scene->deferred && deferred_object(scene, queue_index))
+        return PASS_DEFERRED;
+    if (scene->z_prepass && z_prepass_type(scene->queue[queue_index]->obj->type))
+        return PASS_Z_PREPASS;
+    return PASS_FORWARD;
+}
+
+/*
+ Span buffer pass: faces of all span objects are inserted into span buffer and only their
+ visible parts are drawn, every covered pixel exactly once. Z of the spans is written as well
+ (if the render buffer has Z buffer), so remaining objects are Z tested against them.
+*/
+void scene_3d_render_spans(SCENE_3D* scene) {
+    OBJ_3D_CONTAINER *cont;
+    INT i, cnt;
+
+    if (scene->sbuf != NULL && scene->sbuf->height != scene->render_buf->height) {
+        SPAN_BUFFER_free(scene->sbuf);
+        scene->sbuf = NULL;
+    }
+    if (scene->sbuf == NULL)
+        scene->sbuf = SPAN_BUFFER_alloc(scene->render_buf->height);
+    SPAN_BUFFER_clear(scene->sbuf);
+    vr_set_span_buffer(scene->sbuf);
+    for (i = 0; i < scene->queue_cnt; i++)
+        if (render_pass(scene, i) == PASS_SPAN)
+            obj_3d_draw_solid_span(scene->queue[i]->obj);
+    cnt = SPAN_BUFFER_emit(scene->sbuf, scene->render_buf, scene->render_buf->z != NULL);
+    vr_overdraw_add_shaded(cnt);
+    if (scene->render_buf->z != NULL)
+        Z_MAP_update_tiles(scene->render_buf->z);
+    for (i = 0; i < scene->queue_cnt; i++) {
+        cont = scene->queue[i];
+        if (render_pass(scene, i) == PASS_SPAN && cont->obj->wireframe_on && scene->render_buf->background == NULL)
+            obj_3d_draw_wireframe(cont->obj);
+    }
+}
+
+/*
+ Render the object. With lazy background its wireframe is skipped, all wireframes are drawn
+ after the background is filled in, so they aren't overwritten by it (lines don't write Z).
+*/
+void scene_3d_render_object(SCENE_3D* scene, OBJ_3D_CONTAINER *cont) {
+    bool wireframe_on = cont->obj->wireframe_on;
+    if (scene->render_buf->background != NULL)
+        cont->obj->wireframe_on = false;
+    obj_3d_container_render(cont);
+    cont->obj->wireframe_on = wireframe_on;
 }
 
 void scene_3d_render(SCENE_3D* scene) {
+    OBJ_3D_CONTAINER *cont;
+    INT i;
+    bool prepass_used = false, deferred_used = false;
+
     vr_set_render_buffer(scene->render_buf);
-    for (INT i = 0; i < scene->renderable_cnt; i++) {
-        obj_3d_container_render(scene->renderable[i]);
+    if (scene->span_buffer)
+        scene_3d_render_spans(scene);
+    for (i = 0; i < scene->queue_cnt; i++) {
+        switch (render_pass(scene, i)) {
+            case PASS_Z_PREPASS: prepass_used = true; break;
+            case PASS_DEFERRED: deferred_used = true; break;
+            case PASS_SPAN: break;
+            default:
+                scene_3d_render_object(scene, scene->queue[i]);
+                //Refresh coarse Z buffer for the occlusion tests of next objects
+                Z_MAP_update_tiles(scene->render_buf->z);
+                break;
+        }
     }
-}
+    if (prepass_used) {
+        //Z-only pre-pass of expensive objects. After it Z buffer holds the final Z of forward rendered objects.
+        for (i = 0; i < scene->queue_cnt; i++) {
+            if (render_pass(scene, i) == PASS_Z_PREPASS) {
+                obj_3d_draw_z_only(scene->queue[i]->obj);
+                Z_MAP_update_tiles(scene->render_buf->z);
+            }
+        }
+        //Shade expensive objects only where their Z is equal to the final Z
+        for (i = 0; i < scene->queue_cnt; i++) {
+            if (render_pass(scene, i) == PASS_Z_PREPASS) {
+                cont = scene->queue[i];
+                cont->obj->z_equal = true;
+                scene_3d_render_object(scene, cont);
+                cont->obj->z_equal = false;
+            }
+        }
+    }
+    if (deferred_used) {
+        //Deferred objects are rasterized last, so visibility buffer contains only pixels
+        //not covered by nearer forward rendered geometry.
+        deferred_rasterize(scene);
+        deferred_shade(scene);
+        for (i = 0; i < scene->queue_cnt; i++) {
+            cont = scene->queue[i];
+            if (render_pass(scene, i) == PASS_DEFERRED && cont->obj->wireframe_on && scene->render_buf->background == NULL)
+                obj_3d_draw_wireframe(cont->obj);
+        }
+    }
+    if (scene->render_buf->background != NULL) {
+        //Lazy background: pixels not covered by the geometry are filled now, then wireframes are drawn
+        RENDER_BUFFER_resolve_background(scene->render_buf);
+        map_graph_flush(); //copy of the background may be deferred, wireframes are drawn directly
+        for (i = 0; i < scene->queue_cnt; i++)
+            if (scene->queue[i]->obj->wireframe_on)
+                obj_3d_draw_wireframe(scene->queue[i]->obj);
+    }
+#ifdef RENDER_STATS
+    vr_overdraw_count_coverage();
+#endif
+}
\ No newline at end of file
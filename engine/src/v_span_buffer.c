@@ -0,0 +1,208 @@
+/*  Software Rendering Demo Engine In C
+    Copyright (C) 2024 Andrzej Urbaniak
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "engine.h"
+
+/*
+ Span buffer (S-buffer) hidden surface removal.
+ Polygon bars are inserted as spans with linear Z into per row lists of sorted,
+ non-overlapping spans. Parts of spans hidden behind already inserted spans are clipped
+ away, so after all polygons are inserted each row holds only visible spans,
+ which are emitted into the render buffer exactly once.
+*/
+
+//Z of span s at pixel x
+#define SPAN_Z(s, x) ((int64_t)(s)->z + (int64_t)(s)->dz*((x) - (s)->x0))
+
+SPAN_BUFFER *SPAN_BUFFER_alloc(INT height) {
+    SPAN_BUFFER *sb = calloc(1, sizeof(SPAN_BUFFER));
+    sb->height = height;
+    sb->row = malloc(height*sizeof(INT));
+    sb->span_max = 16*height;
+    sb->span = malloc(sb->span_max*sizeof(SPAN));
+    SPAN_BUFFER_clear(sb);
+    return sb;
+}
+
+void SPAN_BUFFER_clear(SPAN_BUFFER *sb) {
+    if (sb == NULL)
+        return;
+    memset(sb->row, 0xFF, sb->height*sizeof(INT)); //-1: empty rows
+    sb->span_cnt = 0;
+}
+
+void SPAN_BUFFER_free(SPAN_BUFFER *sb) {
+    if (sb == NULL)
+        return;
+    free(sb->row);
+    free(sb->span);
+    free(sb);
+}
+
+/*
+ Create new span and link it in row y after span prev (or at the beginning of the row if prev is -1).
+ Returns index of the new span or -1 if the span pool can't grow.
+*/
+INT span_link(SPAN_BUFFER *sb, INT y, INT prev, INT x0, INT x1, int64_t z, INT dz, ARGB_PIXEL color) {
+    SPAN *s;
+    INT n;
+    if (sb->span_cnt == sb->span_max) {
+        s = realloc(sb->span, 2*sb->span_max*sizeof(SPAN));
+        if (s == NULL)
+            return -1;
+        sb->span = s;
+        sb->span_max *= 2;
+    }
+    n = sb->span_cnt++;
+    s = sb->span + n;
+    s->x0 = x0;    s->x1 = x1;
+    s->z = z;    s->dz = dz;
+    s->color = color;
+    if (prev == -1) {
+        s->next = sb->row[y];
+        sb->row[y] = n;
+    }
+    else {
+        s->next = sb->span[prev].next;
+        sb->span[prev].next = n;
+    }
+    return n;
+}
+
+/*
+ Insert span (x0, x1) in row y, with Z equal to z at x0 and incremented by dz for every pixel.
+ Only parts of the span nearer than already inserted spans are kept.
+ On equal Z earlier inserted span wins, as with Z buffer test.
+*/
+void SPAN_BUFFER_insert(SPAN_BUFFER *sb, INT y, INT x0, INT x1, INT z, INT dz, ARGB_PIXEL color) {
+    SPAN n = {.x0 = x0, .x1 = x1, .z = z, .dz = dz, .color = color}, *e;
+    INT ei, prev = -1, cur = x0, o0, o1, w0, w1, mid;
+    int64_t d0, d1, s;
+
+    if (y < 0 || y >= sb->height || x1 < x0)
+        return;
+    ei = sb->row[y];
+    while (ei != -1 && cur <= x1) {
+        e = sb->span + ei;
+        if (e->x1 < cur) {
+            prev = ei;
+            ei = e->next;
+            continue;
+        }
+        if (e->x0 > x1)
+            break;
+        if (e->x0 > cur) {
+            //Gap before existing span is filled by the new span
+            prev = span_link(sb, y, prev, cur, e->x0 - 1, SPAN_Z(&n, cur), dz, color);
+            if (prev == -1)
+                return;
+            e = sb->span + ei;
+            cur = e->x0;
+        }
+        //Overlap (o0, o1): find part (w0, w1) where the new span is nearer
+        o0 = cur;
+        o1 = x1 < e->x1 ? x1 : e->x1;
+        d0 = SPAN_Z(&n, o0) - SPAN_Z(e, o0);
+        d1 = SPAN_Z(&n, o1) - SPAN_Z(e, o1);
+        cur = o1 + 1;
+        if (d0 >= 0 && d1 >= 0) {
+            prev = ei;
+            ei = e->next;
+            continue;
+        }
+        s = (int64_t)dz - e->dz; //Z difference increment, spans intersect if d0 and d1 differ in sign
+        if (d0 < 0 && d1 < 0) {
+            w0 = o0;    w1 = o1;
+        }
+        else if (d0 < 0) {
+            w0 = o0;    w1 = o0 + (INT)((-d0 + s - 1)/s) - 1;
+        }
+        else {
+            w0 = o0 + (INT)(d0/-s) + 1;    w1 = o1;
+        }
+        //Split existing span into visible left part, the new span part and visible right part
+        if (w1 < e->x1) {
+            if (span_link(sb, y, ei, w1 + 1, e->x1, SPAN_Z(e, w1 + 1), e->dz, e->color) == -1)
+                return;
+            e = sb->span + ei;
+        }
+        if (w0 > e->x0) {
+            e->x1 = w0 - 1;
+            mid = span_link(sb, y, ei, w0, w1, SPAN_Z(&n, w0), dz, color);
+            if (mid == -1)
+                return;
+            prev = mid;
+        }
+        else {
+            e->x1 = w1;
+            e->z = SPAN_Z(&n, w0);
+            e->dz = dz;
+            e->color = color;
+            prev = ei;
+        }
+        ei = sb->span[prev].next;
+    }
+    if (cur <= x1)
+        span_link(sb, y, prev, cur, x1, SPAN_Z(&n, cur), dz, color);
+}
+
+/*
+ Draw all spans into render buffer. If write_z is true, Z of spans is written into its Z buffer too
+ (needed if Z tested geometry is rendered afterwards).
+ Returns count of drawn pixels.
+*/
+INT SPAN_BUFFER_emit(SPAN_BUFFER *sb, RENDER_BUFFER *rb, bool write_z) {
+    ARGB_PIXEL *draw_ptr, *end_ptr;
+    Z_PIXEL *zbuf_ptr;
+    Z16_PIXEL *zbuf16_ptr;
+    SPAN *s;
+    INT y, ei, z, cnt = 0;
+
+    write_z = write_z && rb->z != NULL;
+    for (y = 0; y < sb->height && y < rb->height; y++) {
+        for (ei = sb->row[y]; ei != -1; ei = s->next) {
+            s = sb->span + ei;
+            draw_ptr = MAP_ROW(rb->map, y) + s->x0;
+            end_ptr = draw_ptr + (s->x1 - s->x0 + 1);
+            cnt += s->x1 - s->x0 + 1;
+            ARGB_MAP_mark_dirty(rb->map, s->x0, y, s->x1, y);
+            if (write_z && rb->z->data16 != NULL) {
+                zbuf16_ptr = rb->z->data16 + y*rb->z->stride + s->x0;
+                for (z = s->z; draw_ptr < end_ptr; z += s->dz) {
+                    *draw_ptr++ = s->color;
+                    *zbuf16_ptr++ = Z_TO_Z16(z) < Z16_CLEAR ? Z_TO_Z16(z) : Z16_CLEAR;
+                }
+            }
+            else if (write_z) {
+                zbuf_ptr = MAP_ROW(rb->z, y) + s->x0;
+                for (z = s->z; draw_ptr < end_ptr; z += s->dz) {
+                    *draw_ptr++ = s->color;
+                    *zbuf_ptr++ = z;
+                }
+            }
+            else {
+                while (draw_ptr < end_ptr)
+                    *draw_ptr++ = s->color;
+            }
+        }
+    }
+    if (write_z && cnt > 0) {
+        //Z was lowered in the whole buffer, all coarse Z tiles are dirty
+        rb->z->dirty_x0 = 0;    rb->z->dirty_x1 = rb->z->tile_cols - 1;
+        rb->z->dirty_y0 = 0;    rb->z->dirty_y1 = rb->z->tile_rows - 1;
+    }
+    return cnt;
+}
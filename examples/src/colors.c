@@ -47,7 +47,7 @@ int main(int argc, char *argv[])
             // All pixels inside "tile" have same lightness value
             color.l = (FLOAT)((x/h_max)%x_tiles + ((y/s_max)%y_tiles)*x_tiles)/(FLOAT)(l_max-1);
             // Convert from HSL to RGB to ARGB_PIXEL and store it on target position on the screen
-            display[y*display_buffer()->width + x] = COLOR_to_ARGB_PIXEL(COLOR_hsl_to_rgb(&color));
+            display[y*display_buffer()->map->stride + x] = COLOR_to_ARGB_PIXEL(COLOR_hsl_to_rgb(&color));
         }
     }
 
@@ -33,12 +33,61 @@
 #define BLEND_FILTER_6_KEY 'y'
 #define BLEND_FILTER_7_KEY 'u'
 #define BLEND_FILTER_8_KEY 'i'
+#define PARALLEL_TOGGLE_KEY 'p'
+#define BENCHMARK_KEY 'b'
 
 #define ASSETS_DIR "assets/"
 #define WOOD_MAP "wood_1024.jpg"
 
-typedef enum {NO_FILTER, COPY_FILTER_1, COPY_FILTER_2, COPY_FILTER_3, COPY_FILTER_4, COPY_FILTER_5, COPY_FILTER_6, COPY_FILTER_7,
-              BLEND_FILTER_1, BLEND_FILTER_2, BLEND_FILTER_3, BLEND_FILTER_4, BLEND_FILTER_5, BLEND_FILTER_6, BLEND_FILTER_7} DEMO_MODE;
+#define BENCHMARK_W (3840)
+#define BENCHMARK_H (2160)
+#define BENCHMARK_RUNS (10)
+
+typedef enum {NO_FILTER, COPY_FILTER_1, COPY_FILTER_2, COPY_FILTER_3, COPY_FILTER_4, COPY_FILTER_5, COPY_FILTER_6, COPY_FILTER_7, COPY_FILTER_8,
+              BLEND_FILTER_1, BLEND_FILTER_2, BLEND_FILTER_3, BLEND_FILTER_4, BLEND_FILTER_5, BLEND_FILTER_6, BLEND_FILTER_7, BLEND_FILTER_8} DEMO_MODE;
+
+/*
+ Print times of layering, edge filter and Gaussian blur passes over 4K maps executed by 1, 2, 4 and all workers.
+*/
+void benchmark(GRADIENT *in_gradient, GRADIENT *bg_gradient, GRADIENT *edge_gradient) {
+    const INT workers[] = {1, 2, 4, parallel_workers()};
+    ARGB_MAP *in = ARGB_MAP_alloc(BENCHMARK_W, BENCHMARK_H, 0);
+    ARGB_MAP *bg = ARGB_MAP_alloc(BENCHMARK_W, BENCHMARK_H, 0);
+    ARGB_MAP *out = ARGB_MAP_alloc(BENCHMARK_W, BENCHMARK_H, 0);
+    bool parallel_was_on = parallel_enabled();
+    FLOAT start, layering, edge, blur;
+    INT i, r, last = 0;
+
+    ARGB_MAP_xor_pattern(in, in_gradient);
+    ARGB_MAP_vertical_pattern(bg, bg_gradient);
+    parallel_enable(true);
+    printf("%dx%d map passes [ms]:\n", BENCHMARK_W, BENCHMARK_H);
+    for (i = 0; i < 4; i++) {
+        if (workers[i] > parallel_workers() || workers[i] <= last)
+            continue;
+        last = workers[i];
+        parallel_limit(workers[i]);
+        start = engine_run_stats().time;
+        for (r = 0; r < BENCHMARK_RUNS; r++)
+            ARGB_MAP_blend_mul_global(out, bg, in, 0.5);
+        layering = engine_run_stats().time - start;
+        start += layering;
+        for (r = 0; r < BENCHMARK_RUNS; r++)
+            ARGB_MAP_green_gradient_global_copy(out, in, edge_gradient, MAX_EDGE_WIDTH);
+        edge = engine_run_stats().time - start;
+        start += edge;
+        for (r = 0; r < BENCHMARK_RUNS; r++)
+            ARGB_MAP_gaussian_blur_copy(out, in, 8.0, 8.0);
+        blur = engine_run_stats().time - start;
+        printf("%2d workers: layering %6.1f, edge filter %6.1f, Gaussian blur %6.1f\n", workers[i],
+               1000.0*layering/BENCHMARK_RUNS, 1000.0*edge/BENCHMARK_RUNS, 1000.0*blur/BENCHMARK_RUNS);
+    }
+    parallel_limit(0);
+    parallel_enable(parallel_was_on);
+    ARGB_MAP_free(in);
+    ARGB_MAP_free(bg);
+    ARGB_MAP_free(out);
+}
 
 int main(int argc, char *argv[])
 {
@@ -57,12 +106,14 @@ int main(int argc, char *argv[])
 
     printf("Map Filters example\n");
     printf("No filter key: %c\n", NO_FILTER_KEY);
-    printf("Copy Filter keys: %c, %c, %c, %c, %c, %c, %c\n",
+    printf("Copy Filter keys: %c, %c, %c, %c, %c, %c, %c, %c\n",
            COPY_FILTER_1_KEY, COPY_FILTER_2_KEY, COPY_FILTER_3_KEY, COPY_FILTER_4_KEY,
-           COPY_FILTER_5_KEY, COPY_FILTER_6_KEY, COPY_FILTER_7_KEY);
-    printf("Blend Filter keys: %c, %c, %c, %c, %c, %c, %c\n",
+           COPY_FILTER_5_KEY, COPY_FILTER_6_KEY, COPY_FILTER_7_KEY, COPY_FILTER_8_KEY);
+    printf("Blend Filter keys: %c, %c, %c, %c, %c, %c, %c, %c\n",
            BLEND_FILTER_1_KEY, BLEND_FILTER_2_KEY, BLEND_FILTER_3_KEY, BLEND_FILTER_4_KEY,
-           BLEND_FILTER_5_KEY, BLEND_FILTER_6_KEY, BLEND_FILTER_7_KEY);
+           BLEND_FILTER_5_KEY, BLEND_FILTER_6_KEY, BLEND_FILTER_7_KEY, BLEND_FILTER_8_KEY);
+    printf("Multithreaded filters toggle key: %c\n", PARALLEL_TOGGLE_KEY);
+    printf("4K map passes benchmark key: %c\n", BENCHMARK_KEY);
 
     #ifdef FULL_DESKTOP
         engine_init(0, 0, FULLSCREEN_CURRENT_MODE, window_title);
@@ -70,9 +121,6 @@ int main(int argc, char *argv[])
         engine_init(DISPLAY_W, DISPLAY_H, 0, window_title);
     #endif
 
-    tx_render_buffer = RENDER_BUFFER_alloc(
-            display_buffer()->width, display_buffer()->height, Z_BUFFER_ON);
-
     edge_p_map = ARGB_MAP_alloc(display_buffer()->width, display_buffer()->height, 0);
     blur_p_map = ARGB_MAP_alloc(display_buffer()->width, display_buffer()->height, 0);
     background_map = ARGB_MAP_alloc(display_buffer()->width, display_buffer()->height, 0);
@@ -145,6 +193,10 @@ int main(int argc, char *argv[])
             0.0, 0.0, 0.0, 1.0, 1.0, 1.0);
         scene_3d_transform_and_light(scene);
 
+        // filter input buffer is taken from the pool for this frame only, released by display_show()
+        if (mode != NO_FILTER)
+            tx_render_buffer = RENDER_BUFFER_acquire_frame(
+                display_buffer()->width, display_buffer()->height, Z_BUFFER_ON, false);
 
         if (mode == NO_FILTER) {
             scene->render_buf = display_buffer();
@@ -177,7 +229,7 @@ int main(int argc, char *argv[])
         }
         else if (mode == COPY_FILTER_3) {
             scene->render_buf = tx_render_buffer;
-            RENDER_BUFFER_ARGB_MAP_copy(tx_render_buffer, background_map);
+            RENDER_BUFFER_background(tx_render_buffer, background_map);
             scene_3d_render(scene);
             ARGB_MAP_blur_1xn_global_copy(display_buffer()->map, tx_render_buffer->map, 100);
         }
@@ -189,7 +241,7 @@ int main(int argc, char *argv[])
         }
         else if (mode == COPY_FILTER_4) {
             scene->render_buf = tx_render_buffer;
-            RENDER_BUFFER_ARGB_MAP_copy(tx_render_buffer, background_map);
+            RENDER_BUFFER_background(tx_render_buffer, background_map);
             scene_3d_render(scene);
             ARGB_MAP_blur_nx1_global_copy(display_buffer()->map, tx_render_buffer->map, 100);
         }
@@ -201,7 +253,7 @@ int main(int argc, char *argv[])
         }
         else if (mode == COPY_FILTER_5) {
             scene->render_buf = tx_render_buffer;
-            RENDER_BUFFER_ARGB_MAP_copy(tx_render_buffer, background_map);
+            RENDER_BUFFER_background(tx_render_buffer, background_map);
             scene_3d_render(scene);
             ARGB_MAP_blur_nx1_per_pixel_copy(display_buffer()->map, tx_render_buffer->map, blur_p_map);
         }
@@ -213,7 +265,7 @@ int main(int argc, char *argv[])
         }
         else if (mode == COPY_FILTER_6) {
             scene->render_buf = tx_render_buffer;
-            RENDER_BUFFER_ARGB_MAP_copy(tx_render_buffer, background_map);
+            RENDER_BUFFER_background(tx_render_buffer, background_map);
             scene_3d_render(scene);
             ARGB_MAP_pixelize_copy(display_buffer()->map, tx_render_buffer->map, 9);
         }
@@ -225,7 +277,7 @@ int main(int argc, char *argv[])
         }
         else if (mode == COPY_FILTER_7) {
             scene->render_buf = tx_render_buffer;
-            RENDER_BUFFER_ARGB_MAP_copy(tx_render_buffer, background_map);
+            RENDER_BUFFER_background(tx_render_buffer, background_map);
             scene_3d_render(scene);
             ARGB_MAP_rand_pixelize_copy(display_buffer()->map, tx_render_buffer->map,
                                        5, 60, 0,  5, 10, 0);
@@ -237,6 +289,18 @@ int main(int argc, char *argv[])
             ARGB_MAP_rand_pixelize_blend(display_buffer()->map, background_map, tx_render_buffer->map,
                                        5, 60, 0,  5, 10, 0);
         }
+        else if (mode == COPY_FILTER_8) {
+            scene->render_buf = tx_render_buffer;
+            RENDER_BUFFER_background(tx_render_buffer, background_map);
+            scene_3d_render(scene);
+            ARGB_MAP_gaussian_blur_copy(display_buffer()->map, tx_render_buffer->map, 8.0, 8.0);
+        }
+        else if (mode == BLEND_FILTER_8) {
+            scene->render_buf = tx_render_buffer;
+            RENDER_BUFFER_zero(tx_render_buffer);
+            scene_3d_render(scene);
+            ARGB_MAP_gaussian_blur_blend(display_buffer()->map, background_map, tx_render_buffer->map, 8.0, 8.0);
+        }
 
         display_show(0);
         periodic_fps_printf(1.0);
@@ -275,6 +339,9 @@ int main(int argc, char *argv[])
                     case COPY_FILTER_7_KEY:
                         mode = COPY_FILTER_7;
                         break;
+                    case COPY_FILTER_8_KEY:
+                        mode = COPY_FILTER_8;
+                        break;
 
                     case BLEND_FILTER_1_KEY:
                         mode = BLEND_FILTER_1;
@@ -297,6 +364,15 @@ int main(int argc, char *argv[])
                     case BLEND_FILTER_7_KEY:
                         mode = BLEND_FILTER_7;
                         break;
+                    case BLEND_FILTER_8_KEY:
+                        mode = BLEND_FILTER_8;
+                        break;
+                    case PARALLEL_TOGGLE_KEY:
+                        parallel_enable(!parallel_enabled());
+                        break;
+                    case BENCHMARK_KEY:
+                        benchmark(&back_gradient, &edge_p_gradient, &edge_copy_gradient);
+                        break;
                     default:
                         break;
                 }
@@ -309,7 +385,6 @@ int main(int argc, char *argv[])
     }
 
     printf("\n");
-    RENDER_BUFFER_free(tx_render_buffer);
     scene_3d_free(scene);
     ARGB_MAP_free(wood_map);
     ARGB_MAP_free(edge_p_map);
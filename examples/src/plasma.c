@@ -16,6 +16,9 @@
 
 #include "engine.h"
 
+#define DEFERRED_TOGGLE_KEY 'd'
+#define DIRTY_TRACKING_TOGGLE_KEY 't'
+
 int main(int argc, char *argv[])
 {
     const char *window_title = "SoRDIC Plasma example";
@@ -25,6 +28,10 @@ int main(int argc, char *argv[])
     ARGB_MAP *background_map = NULL, *alpha_map = NULL, *plasma_map = NULL, *xor_map = NULL;
     COLOR black = {.a = 1.0, .r = 0.0, .g = 0.0, .b = 0.0};
 
+    printf("Plasma example\n");
+    printf("Deferred compositing toggle key: %c\n", DEFERRED_TOGGLE_KEY);
+    printf("Display dirty tiles tracking toggle key: %c\n", DIRTY_TRACKING_TOGGLE_KEY);
+
     /** Initialize whole engine (including display system) */
     #ifdef FULL_DESKTOP
         engine_init(0, 0, FULLSCREEN_CURRENT_MODE, window_title);
@@ -93,6 +100,11 @@ int main(int argc, char *argv[])
     GRADIENT_add_point(&xor_gradient, 1.0,  &(COLOR){.a = 0.0, .b = 1.0, .g = 0.6, .r = 1.0});
     ARGB_MAP_xor_pattern(xor_map, &xor_gradient);
 
+    /** Layers are composited in a single tiled pass when the frame is shown. */
+    map_graph_defer(true);
+    /** Display buffer tiles are tracked, only tiles written since the last frame are uploaded. */
+    ARGB_MAP_track_dirty(display_buffer()->map, true);
+
     /** Loop rendering patterns animation. */
     while (!quit_flag) {
         FLOAT anim_t = engine_run_stats().time;
@@ -128,6 +140,12 @@ int main(int argc, char *argv[])
             if (event->type == QUIT_REQUEST) {
                 quit_flag = true;
             }
+            else if (event->type == KEY_PRESSED && event->code == DEFERRED_TOGGLE_KEY) {
+                map_graph_defer(!map_graph_deferred());
+            }
+            else if (event->type == KEY_PRESSED && event->code == DIRTY_TRACKING_TOGGLE_KEY) {
+                ARGB_MAP_track_dirty(display_buffer()->map, display_buffer()->map->dirty == NULL);
+            }
             event++;
         }
         #ifdef RUN_ONE_FRAME
@@ -73,8 +73,8 @@ int main(int argc, char *argv[])
             double ang = ((double)rand()/(double)(RAND_MAX))*6.2831;
             double ang_range = (6.2831-angmarg*(double)(VCOUNT))/(double)(VCOUNT);
             for (int i=0; i<VCOUNT; i++) {
-                vv[i][0] = r*sin(ang) + cx+px;
-                vv[i][1] = r*cos(ang) + cy+py;
+                vv[i][0] = (r*sin(ang) + cx+px)*SUBPIXEL_SIZE;
+                vv[i][1] = (r*cos(ang) + cy+py)*SUBPIXEL_SIZE;
                 ang -= angmarg + ((double)rand()/(double)(RAND_MAX))*ang_range;
             }
             polygon_solid(
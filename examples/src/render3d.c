@@ -27,6 +27,15 @@
 #define ROTATION_TOGGLE_KEY 'q'
 #define MOVE_UP_KEY 'w'
 #define WIREFRAME_TOGGLE_KEY 'e'
+#define PERSPECTIVE_TOGGLE_KEY 'l'
+#define BILINEAR_TOGGLE_KEY ';'
+#define HALFSPACE_TOGGLE_KEY ','
+#define Z_PREPASS_TOGGLE_KEY ']'
+#define DEFERRED_TOGGLE_KEY '/'
+#define SPAN_BUFFER_TOGGLE_KEY '.'
+#define Z16_TOGGLE_KEY '\''
+#define Z_EPOCH_TOGGLE_KEY '='
+#define DYN_RES_TOGGLE_KEY '-'
 #define MOVE_LEFT_KEY 'a'
 #define MOVE_DOWN_KEY 's'
 #define MOVE_RIGHT_KEY 'd'
@@ -68,7 +77,7 @@ int main(int argc, char *argv[])
     int i = 0, j = 0;
     FLOAT rotation_t = 0.0; // Current time
     FLOAT omega_x, omega_y, omega_z; //object angular velocities (constant)
-    bool rotation_on = false, wireframe_on = false;
+    bool rotation_on = false, wireframe_on = false, perspective_on = false, bilinear_on = false, halfspace_on = false;
     FLOAT a_x, a_y, a_z; //object initial angles
     FLOAT v_x, v_y; //object linear velocities when corresponding key pressed
     FLOAT p_x, p_y, p_z; //object position
@@ -87,10 +96,18 @@ int main(int argc, char *argv[])
     BUMP_MAP *bump_map = NULL;
     SCENE_3D *scene = NULL;
     OBJ_3D_CONTAINER *container = NULL;
+    DYN_RES *dyn_res = NULL;
+    bool dyn_res_on = false;
+    INT z_buf_on;
 
     printf("3D Object Rendering Types example\n");
     printf("Object type: %c, %c, %c, %c, %c, %c, %c\n", TOROID_1_KEY, TOROID_2_KEY, TOROID_3_KEY, CUBE_KEY, OCTAHEDRON_KEY, DODECAHEDRON_KEY, ICOSAHEDRON_KEY);
-    printf("Rotation on/off: %c, Wireframe: %c\n", ROTATION_TOGGLE_KEY, WIREFRAME_TOGGLE_KEY);
+    printf("Rotation on/off: %c, Wireframe: %c, Perspective correct texturing: %c, Bilinear filtering: %c\n",
+        ROTATION_TOGGLE_KEY, WIREFRAME_TOGGLE_KEY, PERSPECTIVE_TOGGLE_KEY, BILINEAR_TOGGLE_KEY);
+    printf("Z pre-pass: %c, Deferred shading: %c, Span buffer: %c, Half-space rasterizer: %c\n",
+        Z_PREPASS_TOGGLE_KEY, DEFERRED_TOGGLE_KEY, SPAN_BUFFER_TOGGLE_KEY, HALFSPACE_TOGGLE_KEY);
+    printf("16 bit Z buffer: %c, Frame epoch Z (clear-free Z buffer): %c, Dynamic resolution: %c\n",
+        Z16_TOGGLE_KEY, Z_EPOCH_TOGGLE_KEY, DYN_RES_TOGGLE_KEY);
     printf("Solid    unshaded: %c, diffuse: %c, specular: %c, diffuse+specular: %c\n",
         SOLID_UNSHADED_KEY,
         SOLID_DIFF_KEY,
@@ -130,12 +147,14 @@ int main(int argc, char *argv[])
     #endif
 
     wood_map = ARGB_MAP_read_image(runtime_file_path(argv[0], ASSETS_DIR WOOD_MAP), 50);
+    ARGB_MAP_tile(wood_map); //used only as a base map: tiled layout is more cache friendly
     height_map = ARGB_MAP_read_image(runtime_file_path(argv[0], ASSETS_DIR HEIGHT_MAP), 50);
     mountains_map = ARGB_MAP_read_image(runtime_file_path(argv[0], ASSETS_DIR MOUNTAINS_MAP), 0);
     specular_map = ARGB_MAP_read_image(runtime_file_path(argv[0], ASSETS_DIR SPECULAR_MAP), 0);
     bump_map = BUMP_MAP_from_ARGB_MAP(height_map, 0.1);
     /* Building scene data structures */
     scene = scene_3d(display_buffer(), 1, 0); // Allocate the scene for 1 renderable object
+    dyn_res = DYN_RES_alloc(display_buffer()->width, display_buffer()->height, Z_BUFFER_ON, 1.0/60);
     // Add still camera
     scene_3d_camera_set_settings(scene, &(CAMERA_SETTINGS){
         .look_at = {0.0, 0.0, 0.0, 0.0},
@@ -174,6 +193,9 @@ int main(int argc, char *argv[])
 
     rotation_on = false;
     wireframe_on = false;
+    perspective_on = false;
+    bilinear_on = false;
+    halfspace_on = false;
     obj_3d_type = SOLID_DIFF_SPEC;
     rotation_t = 0.0;
     //initialize all objects properties
@@ -188,7 +210,10 @@ int main(int argc, char *argv[])
             .add_map = specular_map,
             .reflection_map = specular_map,
             .specular_power = 5.0,
-            .wireframe_on = wireframe_on });
+            .wireframe_on = wireframe_on,
+            .perspective_on = perspective_on,
+            .bilinear_on = bilinear_on,
+            .halfspace_on = halfspace_on });
     }
 
     /** Add some checkerboard coloring to object faces/vertices */
@@ -218,7 +243,15 @@ int main(int argc, char *argv[])
     }
 
     while (!quit_flag) {
-        RENDER_BUFFER_zero(display_buffer());
+        if (dyn_res_on) {
+            // Render to the scaled buffer, upscaled to display after rendering
+            DYN_RES_begin(dyn_res);
+            scene->render_buf = dyn_res->buf;
+        }
+        else {
+            scene->render_buf = display_buffer();
+        }
+        RENDER_BUFFER_zero(scene->render_buf);
 
         rotation_t += (rotation_on ? 1. : 0.)*display_last_frame_interval();
         //rotate and perspective transform the cube
@@ -233,6 +266,9 @@ int main(int argc, char *argv[])
         // Execute a lighting calculation and rendering for the whole scene
         scene_3d_transform_and_light(scene);
         scene_3d_render(scene);
+        if (dyn_res_on) {
+            DYN_RES_end(dyn_res, display_buffer());
+        }
 
         display_show(0);
         periodic_fps_printf(1.0);
@@ -273,6 +309,37 @@ int main(int argc, char *argv[])
                     case WIREFRAME_TOGGLE_KEY:
                         wireframe_on = !wireframe_on;
                         break;
+                    case PERSPECTIVE_TOGGLE_KEY:
+                        perspective_on = !perspective_on;
+                        break;
+                    case BILINEAR_TOGGLE_KEY:
+                        bilinear_on = !bilinear_on;
+                        break;
+                    case HALFSPACE_TOGGLE_KEY:
+                        halfspace_on = !halfspace_on;
+                        break;
+                    case Z_PREPASS_TOGGLE_KEY:
+                        scene->z_prepass = !scene->z_prepass;
+                        break;
+                    case DEFERRED_TOGGLE_KEY:
+                        scene->deferred = !scene->deferred;
+                        break;
+                    case SPAN_BUFFER_TOGGLE_KEY:
+                        scene->span_buffer = !scene->span_buffer;
+                        break;
+                    case Z16_TOGGLE_KEY:
+                        //Both buffers the scene may be rendered into (with and without dynamic resolution)
+                        z_buf_on = display_buffer()->z->data16 != NULL ? Z_BUFFER_ON : Z_BUFFER_ON_16;
+                        RENDER_BUFFER_set_z_buffer(display_buffer(), z_buf_on);
+                        RENDER_BUFFER_set_z_buffer(dyn_res->buf, z_buf_on);
+                        break;
+                    case Z_EPOCH_TOGGLE_KEY:
+                        display_buffer()->z->epoch_on = !display_buffer()->z->epoch_on;
+                        dyn_res->buf->z->epoch_on = display_buffer()->z->epoch_on;
+                        break;
+                    case DYN_RES_TOGGLE_KEY:
+                        dyn_res_on = !dyn_res_on;
+                        break;
                     case SOLID_UNSHADED_KEY:
                         obj_3d_type = SOLID_UNSHADED;
                         break;
@@ -340,6 +407,9 @@ int main(int argc, char *argv[])
                 for (i = 0; i<OBJECTS_COUNT; i++) {
                     objects[i]->type = obj_3d_type;
                     objects[i]->wireframe_on = wireframe_on;
+                    objects[i]->perspective_on = perspective_on;
+                    objects[i]->bilinear_on = bilinear_on;
+                    objects[i]->halfspace_on = halfspace_on;
                 }
             }
             else if (event->type == KEY_HOLD) {
@@ -378,6 +448,7 @@ int main(int argc, char *argv[])
     }
 
     printf("\n");
+    DYN_RES_free(dyn_res);
     scene_3d_free(scene);
     for (i = 0; i < OBJECTS_COUNT; i++) {
         obj_3d_free(objects[i]);
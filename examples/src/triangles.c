@@ -66,8 +66,8 @@ int main(int argc, char *argv[])
 
         for (int i=0; i<PPF; i++) {
             for (int i=0; i<VCOUNT; i++) {
-                vv[i][0] = rand()%display_buffer()->width + cx+px;
-                vv[i][1] = rand()%display_buffer()->height + cy+py;
+                vv[i][0] = (rand()%display_buffer()->width + cx+px)*SUBPIXEL_SIZE;
+                vv[i][1] = (rand()%display_buffer()->height + cy+py)*SUBPIXEL_SIZE;
             }
 
             // Check orentation of vertices in vv.
@@ -90,7 +90,7 @@ int main(int argc, char *argv[])
                 &(COLOR){.r = (rand()&255)/255., .g = (rand()&255)/255., .b = (rand()&255)/255.}
             );
 
-            pixel_cnt += my_abs((int64_t)(vv[1][0]-vv[0][0])*(int64_t)(vv[2][1]-vv[0][1]) - (int64_t)(vv[2][0]-vv[0][0])*(int64_t)(vv[1][1]-vv[0][1]))/2;
+            pixel_cnt += my_abs((int64_t)(vv[1][0]-vv[0][0])*(int64_t)(vv[2][1]-vv[0][1]) - (int64_t)(vv[2][0]-vv[0][0])*(int64_t)(vv[1][1]-vv[0][1]))/(2*SUBPIXEL_SIZE*SUBPIXEL_SIZE);
         }
         polygon_cnt += PPF;
         display_show(0);